@@ -0,0 +1,455 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+/* bgwrite.c - write the output in a background thread.
+ * See bgwrite.h.
+ * The buffers form a ring. The flusher writes them out from head on,
+ * count of them are full (or being written), and the converter fills
+ * the one after those. It hands over a buffer when it is full, or
+ * right away when the flusher has nothing else to do, so that the
+ * output keeps flowing.
+ * The converter's stream is a stdio stream with our own write
+ * function (fopencookie() or funopen()), which copies each stdio
+ * buffer into the ring, without any system call.
+ * Compressed output is deflated by the flusher, as one gzip stream.
+ * The flusher only uses raw file descriptors and no stdio or malloc(),
+ * so the converter can still fork() its children.
+ */
+#if !defined(_WIN32)
+#define HAVE_FSYNC
+#if defined(__linux__)
+#define _GNU_SOURCE /* for fopencookie() */
+#define HAVE_FOPENCOOKIE
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) \
+		|| defined(__OpenBSD__) || defined(__DragonFly__)
+#define HAVE_FUNOPEN
+#else
+#define _POSIX_C_SOURCE 200112L
+#endif
+#if !defined(NO_THREADS) && (defined(HAVE_FOPENCOOKIE) \
+		|| defined(HAVE_FUNOPEN))
+#define HAVE_THREADS
+#if !defined(NO_ZLIB)
+#define HAVE_ZLIB
+#endif
+#endif
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_FSYNC
+#include <unistd.h>
+#endif
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "bgwrite.h"
+
+
+typedef struct {
+	char *data;
+	size_t len;
+} BgBuffer;
+
+struct _BgWriter {
+	FILE *front;        /* what the converter writes to */
+	FILE *out;          /* the real output */
+#ifdef HAVE_THREADS
+	int ofd;            /* fileno(out) */
+	BgBuffer *bufs;
+	int nbufs;
+	int head, count;    /* the full buffers */
+	int done;           /* front is closed, nothing more comes */
+	int error;          /* errno of the first failure */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t flusher;
+#endif
+#ifdef HAVE_ZLIB
+	int gzlevel;        /* compression level, 0 for none */
+	z_stream zs;
+	unsigned char *zbuf;
+#endif
+};
+
+/* output buffer of the compression */
+#define BGWRITE_ZBUFSIZE (256L*1024L)
+/* stdio buffer of front, copied into the ring whenever it is full */
+#define BGWRITE_FRONTBUFSIZE (64L*1024L)
+
+
+#ifdef HAVE_THREADS
+
+/* Write len bytes from data to the output. Returns 0 or errno. */
+static int
+BgWriteAll(BgWriter *bw, const char *data, size_t len)
+{
+	ssize_t put;
+
+	while(len > 0) {
+		put = write(bw->ofd, data, len);
+		if(put < 0) {
+			if(errno == EINTR) continue;
+			return errno;
+		}
+		data += put;
+		len -= (size_t)put;
+	}
+	return 0;
+}
+
+
+#ifdef HAVE_ZLIB
+/* Compress len bytes from data to the output, and finish the
+   stream if last is set. Returns 0 or errno. */
+static int
+BgDeflate(BgWriter *bw, const char *data, size_t len, int last)
+{
+	int error, status;
+
+	bw->zs.next_in = (unsigned char*)data;
+	bw->zs.avail_in = (uInt)len;
+	do {
+		bw->zs.next_out = bw->zbuf;
+		bw->zs.avail_out = BGWRITE_ZBUFSIZE;
+		status = deflate(&bw->zs, last ? Z_FINISH : Z_NO_FLUSH);
+		if(status == Z_STREAM_ERROR) return EIO;
+		error = BgWriteAll(bw, (const char*)bw->zbuf,
+				BGWRITE_ZBUFSIZE - bw->zs.avail_out);
+		if(error != 0) return error;
+	} while(bw->zs.avail_out == 0 || (last && status != Z_STREAM_END));
+	return 0;
+}
+#endif
+
+
+/* Write or compress len bytes from data, and finish the compressed
+   stream if last is set. Returns 0 or errno. */
+static int
+BgPut(BgWriter *bw, const char *data, size_t len, int last)
+{
+#ifdef HAVE_ZLIB
+	if(bw->gzlevel > 0) return BgDeflate(bw, data, len, last);
+#endif
+	return BgWriteAll(bw, data, len);
+}
+
+
+/* Write the full buffers to the output */
+static void *
+BgFlusher(void *arg)
+{
+	BgWriter *bw = (BgWriter*)arg;
+	BgBuffer *buf;
+	int error;
+
+	for(;;) {
+		pthread_mutex_lock(&bw->lock);
+		while(bw->count == 0 && !bw->done) {
+			pthread_cond_wait(&bw->cond, &bw->lock);
+		}
+		if(bw->count == 0) {
+			if(bw->error == 0) bw->error = BgPut(bw, NULL, 0, 1);
+			pthread_mutex_unlock(&bw->lock);
+			return NULL;
+		}
+		buf = &bw->bufs[bw->head];
+		error = bw->error;
+		pthread_mutex_unlock(&bw->lock);
+
+		/* after an error, keep draining, so the converter can finish */
+		if(error == 0) error = BgPut(bw, buf->data, buf->len, 0);
+
+		pthread_mutex_lock(&bw->lock);
+		if(bw->error == 0) bw->error = error;
+		buf->len = 0;
+		bw->head = (bw->head + 1) % bw->nbufs;
+		bw->count--;
+		pthread_cond_broadcast(&bw->cond);
+		pthread_mutex_unlock(&bw->lock);
+	}
+}
+
+
+static void
+BgFreeBuffers(BgWriter *bw)
+{
+	int i;
+
+#ifdef HAVE_ZLIB
+	if(bw->zbuf != NULL) {
+		(void)deflateEnd(&bw->zs);
+		free(bw->zbuf);
+		bw->zbuf = NULL;
+	}
+#endif
+	if(bw->bufs == NULL) return;
+	for(i = 0; i < bw->nbufs; i++) {
+		if(bw->bufs[i].data != NULL) free(bw->bufs[i].data);
+	}
+	free(bw->bufs);
+	bw->bufs = NULL;
+}
+
+
+/* Copy len bytes from data into the ring, for the flusher.
+   This is the write function of front. */
+static void
+BgAppend(BgWriter *bw, const char *data, size_t len)
+{
+	BgBuffer *buf;
+	size_t n;
+
+	while(len > 0) {
+		pthread_mutex_lock(&bw->lock);
+		while(bw->count == bw->nbufs) pthread_cond_wait(&bw->cond, &bw->lock);
+		buf = &bw->bufs[(bw->head + bw->count) % bw->nbufs];
+		pthread_mutex_unlock(&bw->lock);
+
+		/* the flusher doesn't touch the buffer we fill */
+		n = BGWRITE_BUFSIZE - buf->len;
+		if(n > len) n = len;
+		memcpy(buf->data + buf->len, data, n);
+		data += n;
+		len -= n;
+
+		pthread_mutex_lock(&bw->lock);
+		buf->len += n;
+		if(bw->count == 0 || buf->len == BGWRITE_BUFSIZE) {
+			bw->count++;
+			pthread_cond_broadcast(&bw->cond);
+		}
+		pthread_mutex_unlock(&bw->lock);
+	}
+}
+
+
+/* Hand over what is left, and wait until the flusher has written
+   it. This is the close function of front. */
+static void
+BgFinish(BgWriter *bw)
+{
+	pthread_mutex_lock(&bw->lock);
+	if(bw->bufs[(bw->head + bw->count) % bw->nbufs].len > 0
+			&& bw->count < bw->nbufs) {
+		bw->count++;
+	}
+	bw->done = 1;
+	pthread_cond_broadcast(&bw->cond);
+	pthread_mutex_unlock(&bw->lock);
+	pthread_join(bw->flusher, NULL);
+}
+
+
+#ifdef HAVE_FOPENCOOKIE
+static ssize_t
+BgCookieWrite(void *cookie, const char *data, size_t len)
+{
+	BgAppend((BgWriter*)cookie, data, len);
+	return (ssize_t)len;
+}
+
+static int
+BgCookieClose(void *cookie)
+{
+	BgFinish((BgWriter*)cookie);
+	return 0;
+}
+
+static FILE *
+BgOpenFront(BgWriter *bw)
+{
+	cookie_io_functions_t io;
+
+	io.read = NULL;
+	io.write = BgCookieWrite;
+	io.seek = NULL;
+	io.close = BgCookieClose;
+	return fopencookie(bw, "w", io);
+}
+#else /* HAVE_FUNOPEN */
+static int
+BgCookieWrite(void *cookie, const char *data, int len)
+{
+	BgAppend((BgWriter*)cookie, data, (size_t)len);
+	return len;
+}
+
+static int
+BgCookieClose(void *cookie)
+{
+	BgFinish((BgWriter*)cookie);
+	return 0;
+}
+
+static FILE *
+BgOpenFront(BgWriter *bw)
+{
+	return funopen(bw, NULL, BgCookieWrite, NULL, BgCookieClose);
+}
+#endif
+
+
+/* Set up the buffers, the flusher and front. Returns -1 if that
+   isn't possible, with nothing left behind. */
+static int
+BgStart(BgWriter *bw, int nbufs)
+{
+	int i;
+
+	bw->bufs = (BgBuffer*)calloc((size_t)nbufs, sizeof(BgBuffer));
+	if(bw->bufs == NULL) return -1;
+	bw->nbufs = nbufs;
+	for(i = 0; i < nbufs; i++) {
+		bw->bufs[i].data = (char*)malloc(BGWRITE_BUFSIZE);
+		if(bw->bufs[i].data == NULL) {
+			BgFreeBuffers(bw);
+			return -1;
+		}
+	}
+#ifdef HAVE_ZLIB
+	if(bw->gzlevel > 0) {
+		bw->zbuf = (unsigned char*)malloc(BGWRITE_ZBUFSIZE);
+		if(bw->zbuf == NULL) {
+			BgFreeBuffers(bw);
+			return -1;
+		}
+		/* 16 more window bits for a gzip header */
+		if(deflateInit2(&bw->zs, bw->gzlevel, Z_DEFLATED, 15 + 16, 8,
+				Z_DEFAULT_STRATEGY) != Z_OK) {
+			free(bw->zbuf);
+			bw->zbuf = NULL;
+			BgFreeBuffers(bw);
+			return -1;
+		}
+	}
+#endif
+	if(fflush(bw->out) != 0) {
+		BgFreeBuffers(bw);
+		return -1;
+	}
+	bw->ofd = fileno(bw->out);
+	pthread_mutex_init(&bw->lock, NULL);
+	pthread_cond_init(&bw->cond, NULL);
+	if(pthread_create(&bw->flusher, NULL, BgFlusher, bw) != 0) {
+		goto nothreads;
+	}
+	bw->front = BgOpenFront(bw);
+	if(bw->front == NULL) {
+		bw->error = ENOMEM; /* so the flusher writes nothing */
+		BgFinish(bw);
+		goto nothreads;
+	}
+	(void)setvbuf(bw->front, NULL, _IOFBF, BGWRITE_FRONTBUFSIZE);
+	return 0;
+
+nothreads:
+	pthread_cond_destroy(&bw->cond);
+	pthread_mutex_destroy(&bw->lock);
+	bw->front = bw->out;
+	BgFreeBuffers(bw);
+	return -1;
+}
+
+#endif /* HAVE_THREADS */
+
+
+BgWriter *
+BgWriteOpen(FILE *out, int nbufs, int gzlevel)
+{
+	BgWriter *bw;
+
+	bw = (BgWriter*)calloc(1, sizeof(BgWriter));
+	if(bw == NULL) return NULL;
+	bw->front = bw->out = out;
+	if(gzlevel > 0) {
+#ifdef HAVE_ZLIB
+		/* only the flusher can compress */
+		bw->gzlevel = gzlevel > 9 ? 9 : gzlevel;
+		if(BgStart(bw, nbufs > 0 ? nbufs : 1) == 0) return bw;
+#endif
+		free(bw);
+		return NULL;
+	}
+#ifdef HAVE_THREADS
+	if(nbufs > 0 && BgStart(bw, nbufs) != 0) {
+		bw->front = out; /* write directly */
+	}
+#endif
+	return bw;
+}
+
+
+FILE *
+BgWriteFile(BgWriter *bw)
+{
+	return bw->front;
+}
+
+
+int
+BgWriteClose(BgWriter *bw, int dosync)
+{
+	int error = 0;
+
+	errno = 0;
+#ifdef HAVE_THREADS
+	if(bw->front != bw->out) {
+		/* this waits for the flusher, see BgFinish() */
+		if(fclose(bw->front) != 0) error = errno;
+		if(error == 0) error = bw->error;
+		pthread_cond_destroy(&bw->cond);
+		pthread_mutex_destroy(&bw->lock);
+		BgFreeBuffers(bw);
+	}
+#endif
+	if(fflush(bw->out) != 0 && error == 0) error = errno;
+#ifdef HAVE_FSYNC
+	/* pipes and terminals can't be synced, nor do they need to */
+	if(dosync && fsync(fileno(bw->out)) != 0 && errno != EINVAL
+			&& error == 0) {
+		error = errno;
+	}
+#endif
+	if(fclose(bw->out) != 0 && error == 0) error = errno;
+	free(bw);
+	if(error != 0) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/* bgwrite.h - write the output in a background thread.
+ * The converter writes through stdio as usual, into a stream that
+ * collects the data in a number of large buffers. A thread writes
+ * the full buffers to the output file. The converter only has to
+ * wait when the output falls behind by more than all of the
+ * buffers together.
+ * The output can be gzip compressed on the way.
+ */
+#ifndef _BGWRITE_H
+#define _BGWRITE_H
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+#include <stdio.h>
+
+/* size of each of the buffers */
+#define BGWRITE_BUFSIZE (4L*1024L*1024L)
+/* compression level used for .gz files */
+#define BGWRITE_GZLEVEL 6
+
+typedef struct _BgWriter BgWriter;
+
+/* Take over out, using nbufs buffers, and compress with gzlevel
+   (1 to 9) unless that is 0. With nbufs < 1, or if there are no
+   threads, uncompressed data is written to out directly.
+   Returns NULL if out of memory, or if compression isn't possible. */
+extern BgWriter *BgWriteOpen(FILE *out, int nbufs, int gzlevel);
+/* the stream to write to */
+extern FILE *BgWriteFile(BgWriter *bw);
+/* Write all that is left, optionally sync the output to disk,
+   and close it. Returns 0, or -1 with errno set if anything
+   couldn't be written. */
+extern int BgWriteClose(BgWriter *bw, int dosync);
+
+#ifdef __cplusplus
+    }
+#endif
+#endif /* _BGWRITE_H */
@@ -26,21 +26,28 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#define HAVE_GETRUSAGE
+#endif
 
 #include <time.h>
 #include <stdio.h>
 #include <float.h>
 #include <errno.h>
 
-#include "readdxf.h"
-#include "convert.h"
-#include "tables.h"
+#ifdef HAVE_GETRUSAGE
+#include <sys/resource.h>
+#endif
 
+#include "dxfconv.h"
+#include "writerad.h"
+#include "bgwrite.h"
+#include "dxfindex.h"
 
-FILE *infp;
-FILE *outf;
 
 char Inputfile[MAXPATH], Outputfile[MAXPATH];
+int Makeindex = 0; /* -x: index the input instead of converting it */
 
 #define DXF2RAD_VER "1.1.0"
 /* 2016-12-21 1.1.0    reorganize sources, VC 2015, 64 bit */
@@ -87,7 +94,7 @@ Options_Type Options = {
 	},
 	0.1,  /* disttol  */
 	15.0 * DEG2RAD, /* angtol  */
-	1,    /* skipfrozen  */
+	0,    /* skipfrozen  */
 	1,    /* geom  */
 	NULL, /* prefix  */
 	0,    /* prefixlen */
@@ -97,6 +104,15 @@ Options_Type Options = {
 	0,    /* smooth  */
 	0,    /* ignorepolxwidth */
 	0,    /* ignorethickness */
+	1,    /* workers */
+	0,    /* instances */
+	NULL, /* blockprefix */
+	2,    /* outbuffers */
+	0,    /* syncoutput */
+	0,    /* gzlevel */
+	NULL, /* layers */
+	NULL, /* xlayers */
+	0,    /* freeblocks */
 };
 
 
@@ -169,14 +185,25 @@ void exit_with_usage(int exitval)
 		{"-G prefix","geometry modifier prefix (default \"l_\")"},
 	/*	{ "-l        "export by layer [excludes -c] (default)"}, */
 	/*	{ "-c        "export by color [excludes -l]"},  */
-	/*	{ "-f        "don't export frozen/off layers"},  */
+		{"-f",       "don't export frozen/off layers"},
+		{"-L layers","only export these layers (comma separated)"},
+		{"-X layers","don't export these layers (comma separated)"},
 		{"-a atol",  "angle tolerance for arc subdivision (default 15.0"
 			DEGREE_CHAR ")"},
 		{"-d dtol",  "distance tolerance for arc subdivision (default 0.1)"},
 		{"+v/-v",    "do/don't export views (default -v)"},
 		{"-V prefix","view file prefix (default \"<radfile>_\")"},
+		{"+i/-i",    "do/don't instance blocks with !xform (default -i)"},
+		{"-I prefix","block file prefix (default \"<radfile>_\")"},
+		{"-m",       "free blocks after their last insert (reads twice)"},
 		{"-r",       "report progress (repeat for verbosity)"},
 		{"-s scale", "multiply all dimensions with scale"},
+		{"-j procs", "convert entities in that many processes (default 1)"},
+		{"-b nbufs", "output buffers of the background writer, 0 for none"
+			" (default 2)"},
+		{"+y/-y",    "do/don't sync the output file to disk (default -y)"},
+		{"-z",       "gzip the output (default for <radfile>.gz)"},
+		{"-x",       "write the index <dxffile>" DXFINDEX_SUFFIX " and exit"},
 		{"-ennn",    "exclude entity types"},
 		{"+ennn",    "include entity types"},
 		{"",         "Where each 'n' is one out of (with defaults):"},
@@ -229,13 +256,33 @@ void disallow_plus(int arg)
 	}
 }
 
+/* "<radfile>_", or "<dxffile>_" without an output file */
+char *default_prefix(void)
+{
+	size_t pnlen;
+	char *prefix, *pn;
+
+	pnlen = strlen(Outputfile[0]?Outputfile:Inputfile);
+	prefix = malloc(pnlen+2);
+	strncpy(prefix, Outputfile[0]?Outputfile:Inputfile, pnlen+1);
+	pn = strrchr(prefix, '.');
+	if(pn != NULL && strcmp(pn, ".gz") == 0) { /* and ".rad" in front */
+		*pn = '\0';
+		pn = strrchr(prefix, '.');
+	}
+	if(pn != NULL) *pn = '\0';
+	strcat(prefix, "_");
+	return prefix;
+}
+
 void parseoptions(int argc, char*argv[])
 {
 	int c;
 	double dval;
+	long lval;
 	char *endptr;
 
-	while((c = dxf2rad_getopt(argc, argv, "HhglcfrvV:s:e:d:a:f:G:")) != EOF) {
+	while((c = dxf2rad_getopt(argc, argv, "HhglcfrvV:s:e:d:a:f:G:j:iI:b:yzL:X:xm")) != EOF) {
 		switch(c) {
 		case 'e':
 			parse_entarg();
@@ -286,6 +333,22 @@ void parseoptions(int argc, char*argv[])
 			Options.prefix = malloc(Options.prefixlen+1);
 			strncpy(Options.prefix, optarg, Options.prefixlen+1);
 			break;
+		case 'L':
+			disallow_plus(c);
+			if(Options.layers) {
+				fprintf(stderr, "Layers specified more than once\n");
+				exit_with_usage(-1);
+			}
+			Options.layers = optarg;
+			break;
+		case 'X':
+			disallow_plus(c);
+			if(Options.xlayers) {
+				fprintf(stderr, "Excluded layers specified more than once\n");
+				exit_with_usage(-1);
+			}
+			Options.xlayers = optarg;
+			break;
 		case 'g':
 			if(optsign == '-') Options.geom = 0;
 			else Options.geom = 1;
@@ -294,6 +357,23 @@ void parseoptions(int argc, char*argv[])
 			if(optsign == '-') Options.views = 0;
 			else Options.views = 1;
 			break;
+		case 'i':
+			if(optsign == '-') Options.instances = 0;
+			else Options.instances = 1;
+			break;
+		case 'I':
+			disallow_plus(c);
+			if(Options.blockprefix) {
+				fprintf(stderr, "Block prefix specified more than once\n");
+				exit_with_usage(-1);
+			}
+			if((strlen(optarg) + 32) > MAXSTRING) {
+				fprintf(stderr, "Block prefix too long\n");
+				exit_with_usage(-1);
+			}
+			Options.blockprefix = malloc(strlen(optarg)+1);
+			strcpy(Options.blockprefix, optarg);
+			break;
 		case 'V':
 			disallow_plus(c);
 			if(Options.viewprefix) {
@@ -340,6 +420,42 @@ void parseoptions(int argc, char*argv[])
 			}
 			Options.disttol = dval;
 			break;
+		case 'j':
+			disallow_plus(c);
+			lval = strtol((const char*)optarg, &endptr, 10);
+			if(lval < 1 || lval > 1024 || *endptr != '\0') {
+				fprintf(stderr, "Invalid number of processes: \"%s\"\n",
+						optarg);
+				exit_with_usage(-1);
+			}
+			Options.workers = (int)lval;
+			break;
+		case 'b':
+			disallow_plus(c);
+			lval = strtol((const char*)optarg, &endptr, 10);
+			if(lval < 0 || lval > 64 || *endptr != '\0') {
+				fprintf(stderr, "Invalid number of output buffers: \"%s\"\n",
+						optarg);
+				exit_with_usage(-1);
+			}
+			Options.outbuffers = (int)lval;
+			break;
+		case 'y':
+			if(optsign == '-') Options.syncoutput = 0;
+			else Options.syncoutput = 1;
+			break;
+		case 'z':
+			disallow_plus(c);
+			Options.gzlevel = BGWRITE_GZLEVEL;
+			break;
+		case 'x':
+			disallow_plus(c);
+			Makeindex = 1;
+			break;
+		case 'm':
+			disallow_plus(c);
+			Options.freeblocks = 1;
+			break;
 		case 'a':
 			disallow_plus(c);
 			dval = strtod((const char*)optarg, &endptr);
@@ -398,158 +514,125 @@ void parseoptions(int argc, char*argv[])
 		}
 		Outputfile[0] = '\0';
 	} else {
-		if ((strlen(argv[optind+1]) + 5) > MAXPATH){
+		size_t len = strlen(argv[optind+1]);
+		if ((len + 8) > MAXPATH){
 			fprintf(stderr, "Output file path name too long\n");
 			exit_with_usage(-1);
 		}
 		strncpy(Outputfile, argv[optind+1], MAXPATH);
-		if (strcspn(Outputfile,".") == strlen(Outputfile))
-			strncat(Outputfile, ".rad", 4);
+		if (len > 3 && strcmp(Outputfile + len - 3, ".gz") == 0) {
+			if (Options.gzlevel == 0) Options.gzlevel = BGWRITE_GZLEVEL;
+		} else {
+			if (strcspn(Outputfile,".") == len)
+				strncat(Outputfile, ".rad", 4);
+			if (Options.gzlevel)
+				strcat(Outputfile, ".gz");
+		}
 	}
 	if(Options.viewprefix == NULL) {
-		size_t pnlen;
-		char *pn;
-		pnlen = strlen(Outputfile[0]?Outputfile:Inputfile);
-		Options.viewprefix = malloc(pnlen+2);
-		strncpy(Options.viewprefix, Outputfile[0]?Outputfile:Inputfile, pnlen+1);
-		pn = strrchr(Options.viewprefix, '.');
-		if(pn != NULL) *pn = '\0';
-		strncat(pn, "_", 2);
+		Options.viewprefix = default_prefix();
 		Options.viewprefixlen = strlen(Options.viewprefix);
 	}
+	if(Options.blockprefix == NULL) {
+		Options.blockprefix = default_prefix();
+	}
+}
+
+
+/* -r: the memory the conversion took */
+void report_memory(DxfContext *ctx)
+{
+#ifdef HAVE_GETRUSAGE
+	struct rusage usage;
+	long peak;
+#endif
+
+	if(Options.freeblocks) {
+		fprintf(stderr, "  Block geometry: at most %lu of %lu KB in memory\n",
+				ctx->BlockPeak / 1024, ctx->BlockTotal / 1024);
+	}
+#ifdef HAVE_GETRUSAGE
+	if(getrusage(RUSAGE_SELF, &usage) == 0) {
+		peak = (long)usage.ru_maxrss;
+#ifdef __APPLE__
+		peak /= 1024; /* in bytes there */
+#endif
+		fprintf(stderr, "  Peak resident size: %ld KB\n", peak);
+	}
+#endif
 }
 
 
 int main (int argc, char *argv[])
 {
 	int status = 0;
-	static char eoferrmsg[] =
-		"Unexpected end of file in %s section of file \"%s\" (line %d)\n";
+	DxfContext *ctx;
+	DxfInput *infp;
+	DxfIndex *index;
+	FILE *outf = NULL;
+	BgWriter *writer = NULL;
 
 	parseoptions(argc, argv);
-	InitTables();
-	InitConvert();
+	if(Makeindex) {
+		return DxfIndexWrite(Inputfile, Options.verbose) == 0 ? 0 : 1;
+	}
+	ctx = DxfContextNew(&Options);
+	if(ctx == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		exit(1);
+	}
 
 	errno = 0;
-	infp = fopen(Inputfile, "r");
+	infp = DxfOpen(Inputfile);
 	if(!infp) {
 		fprintf(stderr, "Can't open file '%s' for input (E%d: %s)\n",
 			Inputfile, errno, strerror(errno));
 		exit(-1);
 	}
-	/* Initialise group  */
-	Group.line = 0;
-
-	/* Read DXF file and write Radiance data.  */
-	next_group(infp, &Group);
-	while (!feof(infp) && strcmp(Group.value,FILEEND) != 0) {
-		if(Group.code == 0) {
-			if(strcmp(Group.value, SECTION) == 0) {
-				next_group(infp, &Group); /* code 2 group */
-				if(strcmp(Group.value,HEADER) == 0) {
-					if(Options.verbose > 0) {
-						fprintf(stderr, "  Reading headers\n");
-					}
-					HeaderSection();
-					if(feof(infp)) {
-						fprintf(stderr, eoferrmsg,
-								"HEADER", Inputfile, Group.line);
-						status = -1;
-					}
-				}
-				else if(strcmp(Group.value,CLASSES) == 0) {
-					if(Options.verbose > 0) {
-						fprintf(stderr, "  Ignoring classes\n");
-					}
-					IgnoreSection();
-					if(feof(infp)) {
-						fprintf(stderr, eoferrmsg,
-								"CLASSES", Inputfile, Group.line);
-						status = -1;
-					}
-				}
-				else if(strcmp(Group.value,TABLES) == 0) {
-					if(Options.verbose > 0) {
-						fprintf(stderr, "  Reading tables\n");
-					}
-					TablesSection();
-					if(feof(infp)) {
-						fprintf(stderr, eoferrmsg,
-								"TABLES", Inputfile, Group.line);
-						status = -1;
-					}
-				}
-				else if(strcmp(Group.value,BLOCKS) == 0) {
-					if(Options.verbose > 0) {
-						fprintf(stderr, "  Reading blocks\n");
-					}
-					BlocksSection();
-					if(feof(infp)) {
-						fprintf(stderr, eoferrmsg,
-								"BLOCKS", Inputfile, Group.line);
-						status = -1;
-					}
-				}
-				else if(strcmp(Group.value,ENTITIES) == 0) {
-					if(Options.geom) {
-						int i;
-						time_t ltime;
-						if(*Outputfile == '\0') {
-							outf = stdout;
-						} else {
-							errno = 0;
-							outf = fopen((const char*)&Outputfile, "w");
-							if(outf == NULL) {
-								fprintf(stderr,
-										"Can't open file '%s' for output (E%d: %s)\n",
-										Outputfile, errno, strerror(errno));
-								exit(1);
-							}
-						}
-						(void)time(&ltime);
-						fprintf(outf, "## Radiance geometry file \"%s\"\n",
-								Outputfile[0] ? Outputfile : "<stdout>");
-						fprintf(outf, "## Converted by dxf2rad %s: %s##",
-								DXF2RAD_VER, ctime(&ltime));
-						for(i = 0; i < argc; i ++) {
-							fprintf(outf, " %s", argv[i]);
-						}
-						fprintf(outf, "\n\n");
-						if(Options.verbose > 0) {
-							fprintf(stderr, "  Reading entities\n");
-						}
-						EntitiesSection();
-						if(feof(infp)) {
-							fprintf(stderr, eoferrmsg,
-									"ENTITIES", Inputfile, Group.line);
-							status = -1;
-						}
-					} else {
-						if(Options.verbose > 0) {
-							fprintf(stderr, "  Ignoring entities\n");
-						}
-						IgnoreSection();
-						if(feof(infp)) {
-							fprintf(stderr, eoferrmsg,
-									"ENTITIES", Inputfile, Group.line);
-							status = -1;
-						}
-					}
-				}
-				else if(strcmp(Group.value,OBJECTS) == 0) {
-					if(Options.verbose > 0) {
-						fprintf(stderr, "  Ignoring objects\n");
-					}
-					IgnoreSection();
-					if(feof(infp)) {
-						fprintf(stderr, eoferrmsg,
-								"OBJECTS", Inputfile, Group.line);
-						status = -1;
-					}
-				}
+	index = DxfIndexOpen(Inputfile, infp, Options.verbose);
+	if(Options.geom) {
+		int i;
+		time_t ltime;
+		if(*Outputfile == '\0') {
+			outf = stdout;
+		} else {
+			errno = 0;
+			outf = fopen((const char*)&Outputfile, "w");
+			if(outf == NULL) {
+				fprintf(stderr,
+						"Can't open file '%s' for output (E%d: %s)\n",
+						Outputfile, errno, strerror(errno));
+				exit(1);
 			}
 		}
-		next_group(infp, &Group);
+		(void)setvbuf(outf, NULL, _IOFBF, WRITERAD_BUFSIZE);
+		writer = BgWriteOpen(outf, Options.outbuffers, Options.gzlevel);
+		if(writer == NULL) {
+			if(Options.gzlevel) {
+				fprintf(stderr, "Error: Can't compress the output.\n");
+			} else {
+				fprintf(stderr, "Error: Out of memory.\n");
+			}
+			exit(1);
+		}
+		outf = BgWriteFile(writer);
+		(void)time(&ltime);
+		fprintf(outf, "## Radiance geometry file \"%s\"\n",
+				Outputfile[0] ? Outputfile : "<stdout>");
+		fprintf(outf, "## Converted by dxf2rad %s: %s##",
+				DXF2RAD_VER, ctime(&ltime));
+		for(i = 0; i < argc; i ++) {
+			fprintf(outf, " %s", argv[i]);
+		}
+		fprintf(outf, "\n\n");
+	}
+
+	/* Read DXF file and write Radiance data.  */
+	if(index != NULL) {
+		status = DxfConvertIndexed(ctx, infp, index, Inputfile, outf);
+		DxfIndexClose(index);
+	} else {
+		status = DxfConvertInput(ctx, infp, Inputfile, outf);
 	}
 
 	if(outf) {
@@ -557,8 +640,15 @@ int main (int argc, char *argv[])
 			fprintf(outf, "\n## End of Radiance geometry file \"%s\"\n\n",
 					Outputfile[0] ? Outputfile : "<stdout>");
 		}
-		fclose(outf);
+		if(BgWriteClose(writer, Options.syncoutput) != 0) {
+			fprintf(stderr, "Error writing file '%s' (E%d: %s)\n",
+					Outputfile[0] ? Outputfile : "<stdout>",
+					errno, strerror(errno));
+			if(status == 0) status = 1;
+		}
 	}
-	fclose(infp);
+	if(Options.verbose > 0) report_memory(ctx);
+	DxfClose(infp);
+	DxfContextFree(ctx);
 	return status;
 }
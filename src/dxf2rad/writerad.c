@@ -33,6 +33,7 @@ SOFTWARE.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "geomtypes.h"
@@ -40,6 +41,111 @@ SOFTWARE.
 #include "dlltypes.h"
 #include "dllproto.h"
 #include "geomproto.h"
+#include "writerad.h"
+#include "dxfnum.h"
+
+
+/* Append v to buf as printf("%.8g") would, and return the new end.
+   We scale v to 8 digits before the decimal point with a single
+   multiplication or division by an exact power of ten, which is off
+   by less than a unit in the last place. If that leaves any doubt
+   about the rounding, or v is out of the range we can scale that
+   way, we let sprintf() do it. */
+static char *
+PutG8(char *buf, double v)
+{
+	char digits[8], *cp = buf;
+	double a, scaled, r, frac;
+	long n;
+	int e, i, last;
+
+	if(v == 0.0) {
+		if(1.0 / v < 0.0) *cp++ = '-';
+		*cp++ = '0';
+		return cp;
+	}
+	a = fabs(v);
+	if(!(a >= 1e-14 && a < 1e21)) goto slow; /* also NaN */
+	e = (int)floor(log10(a));
+	for(i = 0; i < 2; i++) { /* log10() may be off by one */
+		if(7 - e >= 0) scaled = a * dxf_pow10tab[7 - e];
+		else scaled = a / dxf_pow10tab[e - 7];
+		if(scaled >= 1e8) e++;
+		else if(scaled < 1e7) e--;
+		else break;
+	}
+	if(scaled < 1e7 || scaled >= 1e8) goto slow;
+	r = floor(scaled);
+	frac = scaled - r;
+	if(fabs(frac - 0.5) < 1e-6) goto slow; /* too close to call */
+	if(frac > 0.5) r += 1.0;
+	if(r >= 1e8) { /* 99999999.5 rounds up to the next power of ten */
+		r = 1e7;
+		e++;
+	}
+	n = (long)r;
+	for(i = 7; i >= 0; i--) {
+		digits[i] = (char)('0' + n % 10);
+		n /= 10;
+	}
+	for(last = 7; last > 0 && digits[last] == '0'; last--);
+
+	if(v < 0.0) *cp++ = '-';
+	if(e < -4 || e >= 8) { /* exponential */
+		*cp++ = digits[0];
+		if(last > 0) {
+			*cp++ = '.';
+			for(i = 1; i <= last; i++) *cp++ = digits[i];
+		}
+		*cp++ = 'e';
+		*cp++ = e < 0 ? '-' : '+';
+		if(e < 0) e = -e;
+		if(e >= 100) *cp++ = (char)('0' + e / 100);
+		*cp++ = (char)('0' + e / 10 % 10);
+		*cp++ = (char)('0' + e % 10);
+	} else if(e >= 0) {
+		for(i = 0; i <= e; i++) *cp++ = digits[i];
+		if(last > e) {
+			*cp++ = '.';
+			for(i = e + 1; i <= last; i++) *cp++ = digits[i];
+		}
+	} else {
+		*cp++ = '0';
+		*cp++ = '.';
+		for(i = -1; i > e; i--) *cp++ = '0';
+		for(i = 0; i <= last; i++) *cp++ = digits[i];
+	}
+	return cp;
+
+slow:
+	return cp + sprintf(cp, "%.8g", v);
+}
+
+
+/* Write n numbers in a line, separated by sep, like
+   fprintf(fp, "\t%.8g %.8g %.8g\n", x, y, z) would for n = 3. */
+static void
+PutNumbers(FILE *fp, char sep, int n, double x, double y, double z, double w)
+{
+	char line[128], *cp = line;
+
+	*cp++ = '\t';
+	cp = PutG8(cp, x);
+	if(n > 1) {
+		*cp++ = sep;
+		cp = PutG8(cp, y);
+	}
+	if(n > 2) {
+		*cp++ = sep;
+		cp = PutG8(cp, z);
+	}
+	if(n > 3) {
+		*cp++ = sep;
+		cp = PutG8(cp, w);
+	}
+	*cp++ = '\n';
+	fwrite(line, 1, (size_t)(cp - line), fp);
+}
 
 
 extern void 
@@ -49,12 +155,85 @@ WriteSimpleText(FILE *fp, SimpleText *texts)
 }
 
 
+/* Write one Cyl3, counting the primitives in cylCnt */
+static void WriteCyl3(FILE *fp, char *material,
+					int id, int *cylCnt, Cyl3 *cyl)
+{
+    Vector3 dir;
+
+	if(cyl->erad == 0.0) { /* it's a point/sphere */
+		int sign;
+		sign = (cyl->srad > 0 ? 1 : -1);
+		if (sign > 0) {
+			fprintf(fp, "\n%s sphere %s.%d.%d\n",
+				material, material, id, (*cylCnt)++);
+		} else {
+			fprintf(fp, "\n%s bubble %s.%d.%d\n",
+				material, material, id, (*cylCnt)++);
+		}
+		fprintf(fp, "0\n0\n4");
+		PutNumbers(fp, '\t', 4, cyl->svert.x, cyl->svert.y, cyl->svert.z,
+			fabs(cyl->srad));
+	} else if (cyl->length != 0.0) { /* it's a cylinder or tube */
+		if(cyl->length >= 0.0) {
+			fprintf(fp, "\n%s cylinder %s.%d.%d\n",
+				material, material, id, (*cylCnt)++);
+		} else {
+			fprintf(fp, "\n%s tube %s.%d.%d\n",
+				material, material, id, (*cylCnt)++);
+		}
+        fprintf(fp, "0\n0\n7");
+        PutNumbers(fp, ' ', 3, cyl->svert.x,
+                cyl->svert.y, cyl->svert.z, 0.0);
+        PutNumbers(fp, ' ', 3, cyl->evert.x,
+                cyl->evert.y, cyl->evert.z, 0.0);
+        PutNumbers(fp, ' ', 1, cyl->srad, 0.0, 0.0, 0.0);
+        /* bottom cap */
+        fprintf(fp, "\n%s ring %s.%d.%d\n",
+			material, material, id, (*cylCnt)++);
+        fprintf(fp, "0\n0\n8");
+        PutNumbers(fp, ' ', 3,
+			cyl->svert.x, cyl->svert.y, cyl->svert.z, 0.0);
+		if(cyl->length >= 0.0) {
+            (void)V3Normalize(V3Sub(&cyl->svert, &cyl->evert, &dir));
+		} else {
+            (void)V3Normalize(V3Sub(&cyl->evert, &cyl->svert, &dir));
+		}
+        PutNumbers(fp, ' ', 3, dir.x, dir.y, dir.z, 0.0);
+        PutNumbers(fp, ' ', 2, 0.0, cyl->srad, 0.0, 0.0);
+		/* top cap */
+        fprintf(fp, "\n%s ring %s.%d.%d\n",
+			material, material, id, (*cylCnt)++);
+        fprintf(fp, "0\n0\n8");
+        PutNumbers(fp, ' ', 3,
+			cyl->evert.x, cyl->evert.y, cyl->evert.z, 0.0);
+		if(cyl->length >= 0.0) {
+            (void)V3Normalize(V3Sub(&cyl->evert, &cyl->svert, &dir));
+		} else {
+            (void)V3Normalize(V3Sub(&cyl->svert, &cyl->evert, &dir));
+		}
+        PutNumbers(fp, ' ', 3, dir.x, dir.y, dir.z, 0.0);
+        PutNumbers(fp, ' ', 2, 0.0, cyl->srad, 0.0, 0.0);
+    } else {            /* it's a ring */
+        fprintf(fp, "\n%s ring %s.%d.%d\n",
+			material, material, id, (*cylCnt)++);
+        fprintf(fp, "0\n0\n8");
+        PutNumbers(fp, ' ', 3,
+			cyl->svert.x, cyl->svert.y, cyl->svert.z, 0.0);
+        (void)V3Normalize(&cyl->normal);
+        PutNumbers(fp, ' ', 3,
+				cyl->normal.x, cyl->normal.y, cyl->normal.z, 0.0);
+
+        PutNumbers(fp, ' ', 2, 0.0, cyl->srad, 0.0, 0.0);
+    }
+}
+
+
 extern int WriteCyl(FILE *fp, char *matName,
 					int id, Cyl3 *cyls)
 {
     int cylCnt = 0;
     Cyl3 *cyl;
-    Vector3 dir;
 	char *material = matName;
 
 #ifdef DEBUG
@@ -64,78 +243,35 @@ extern int WriteCyl(FILE *fp, char *matName,
         return 1;
     for (cyl = cyls; cyl; cyl = cyl->next) {
 		if(matName == NULL) material = cyl->material;
-		if(cyl->erad == 0.0) { /* it's a point/sphere */
-			int sign;
-			sign = (cyl->srad > 0 ? 1 : -1);
-			if (sign > 0) {
-				fprintf(fp, "\n%s sphere %s.%d.%d\n",
-					material, material, id, cylCnt++);
-			} else {
-				fprintf(fp, "\n%s bubble %s.%d.%d\n",
-					material, material, id, cylCnt++);
-			}
-			fprintf(fp, "0\n0\n4");
-			fprintf(fp, "\t%.8g\t%.8g\t%.8g\t%.8g\n",
-				cyl->svert.x, cyl->svert.y, cyl->svert.z,
-				fabs(cyl->srad));
-		} else if (cyl->length != 0.0) { /* it's a cylinder or tube */
-			if(cyl->length >= 0.0) {
-				fprintf(fp, "\n%s cylinder %s.%d.%d\n",
-					material, material, id, cylCnt++);
-			} else {
-				fprintf(fp, "\n%s tube %s.%d.%d\n",
-					material, material, id, cylCnt++);
-			}
-            fprintf(fp, "0\n0\n7");
-            fprintf(fp, "\t%.8g %.8g %.8g\n", cyl->svert.x,
-                    cyl->svert.y, cyl->svert.z);
-            fprintf(fp, "\t%.8g %.8g %.8g\n", cyl->evert.x,
-                    cyl->evert.y, cyl->evert.z);
-            fprintf(fp, "\t%.8g\n", cyl->srad);
-            /* bottom cap */
-            fprintf(fp, "\n%s ring %s.%d.%d\n",
-				material, material, id, cylCnt++);
-            fprintf(fp, "0\n0\n8");
-            fprintf(fp, "\t%.8g %.8g %.8g\n",
-				cyl->svert.x, cyl->svert.y, cyl->svert.z);
-			if(cyl->length >= 0.0) {
-	            (void)V3Normalize(V3Sub(&cyl->svert, &cyl->evert, &dir));
-			} else {
-	            (void)V3Normalize(V3Sub(&cyl->evert, &cyl->svert, &dir));
-			}
-            fprintf(fp, "\t%.8g %.8g %.8g\n", dir.x, dir.y, dir.z);
-            fprintf(fp, "\t0 %.8g\n", cyl->srad);
-			/* top cap */
-            fprintf(fp, "\n%s ring %s.%d.%d\n",
-				material, material, id, cylCnt++);
-            fprintf(fp, "0\n0\n8");
-            fprintf(fp, "\t%.8g %.8g %.8g\n",
-				cyl->evert.x, cyl->evert.y, cyl->evert.z);
-			if(cyl->length >= 0.0) {
-	            (void)V3Normalize(V3Sub(&cyl->evert, &cyl->svert, &dir));
-			} else {
-	            (void)V3Normalize(V3Sub(&cyl->svert, &cyl->evert, &dir));
-			}
-            fprintf(fp, "\t%.8g %.8g %.8g\n", dir.x, dir.y, dir.z);
-            fprintf(fp, "\t0 %.8g\n", cyl->srad);
-        } else {            /* it's a ring */
-            fprintf(fp, "\n%s ring %s.%d.%d\n",
-				material, material, id, cylCnt++);
-            fprintf(fp, "0\n0\n8");
-            fprintf(fp, "\t%.8g %.8g %.8g\n",
-				cyl->svert.x, cyl->svert.y, cyl->svert.z);
-            (void)V3Normalize(&cyl->normal);
-            fprintf(fp, "\t%.8g %.8g %.8g\n",
-					cyl->normal.x, cyl->normal.y, cyl->normal.z);
-
-            fprintf(fp, "\t0 %.8g\n", cyl->srad);
-        }
+		WriteCyl3(fp, material, id, &cylCnt, cyl);
     }
 	Cyl3FreeList(cyls);
     return 1;
 }
 
 
+/* Write cyls transformed by matrix, without copying the list, and
+   leave the originals alone. Cyls on layer floating are written on
+   layer instead. */
+extern int WriteCylXForm(FILE *fp, int id, Cyl3 *cyls, Matrix4 matrix,
+					char *floating, char *layer)
+{
+    int cylCnt = 0;
+    Cyl3 *cyl, tmp;
+
+    if (cyls == NULL)
+        return 1;
+    for (cyl = cyls; cyl; cyl = cyl->next) {
+		tmp = *cyl;
+		tmp.next = NULL;
+		M4TransformCyls(&tmp, matrix);
+		WriteCyl3(fp, tmp.material == floating ? layer : tmp.material,
+				id, &cylCnt, &tmp);
+    }
+    return 1;
+}
+
+
 /* ARGSUSED */
 extern int WritePoint(FILE *fp, char *matName,
 					  int id, Cyl3 *point)
@@ -154,8 +290,7 @@ extern int WritePoint(FILE *fp, char *matName,
     else
         fprintf(fp, "\n%s bubble %s.%d.%d\n", material, material, id, pntCnt);
     fprintf(fp, "0\n0\n4");
-    fprintf(fp, "\t%.8g\t%.8g\t%.8g\t%.8g\n",
-		point->svert.x, point->svert.y, point->svert.z,
+    PutNumbers(fp, '\t', 4, point->svert.x, point->svert.y, point->svert.z,
 		fabs(point->srad));
     return 1;
 }
@@ -190,12 +325,52 @@ extern int WritePoly(FILE *fp, char *matName, int id, Poly3 *polys)
                 ++polyCnt);
         fprintf(fp, "0\n0\n%d", poly->nverts * 3);
         for (i = 0; i < (int)poly->nverts; i++)
-            fprintf(fp, "\t%.8g\t%.8g\t%.8g\n", poly->verts[i].x,
-                    poly->verts[i].y, poly->verts[i].z);
+            PutNumbers(fp, '\t', 3, poly->verts[i].x,
+                    poly->verts[i].y, poly->verts[i].z, 0.0);
     }
     Poly3FreeList(polys);
     return 1;
 }
+
+
+/* Write the polys packed in buf transformed by matrix, straight from
+   the buffer. Polys on layer floating are written on layer instead.
+   which selects all of them, or only those on floating or not. */
+extern int WritePolyBuffer(FILE *fp, int id, PolyBuffer *buf,
+					Matrix4 matrix, char *floating, char *layer, int which)
+{
+    int polyCnt = 0, nverts;
+    long i, k;
+    Point3 p, pt;
+	char *material;
+
+    if (buf == NULL)
+        return 1;
+    for (i = 0; i < buf->npolys; i++) {
+		material = buf->materials[buf->matids[i]];
+		if (material == floating) {
+			if (which == POLYS_FIXED)
+				continue;
+			material = layer;
+		} else if (which == POLYS_FLOATING) {
+			continue;
+		}
+        nverts = (int)(buf->offsets[i+1] - buf->offsets[i]);
+        if (nverts < 3)
+            continue;
+        fprintf(fp, "\n%s polygon %s.%d.%d\n", material, material, id,
+                ++polyCnt);
+        fprintf(fp, "0\n0\n%d", nverts * 3);
+        for (k = buf->offsets[i]; k < buf->offsets[i+1]; k++) {
+			p.x = buf->xs[k];
+			p.y = buf->ys[k];
+			p.z = buf->zs[k];
+			(void)M4MultPoint3(&p, matrix, &pt);
+            PutNumbers(fp, '\t', 3, pt.x, pt.y, pt.z, 0.0);
+		}
+    }
+    return 1;
+}
 #ifdef __cplusplus
     }
 #endif
@@ -36,10 +36,23 @@ SOFTWARE.
 
 #include "dlltypes.h"
 
+/* stdio buffer for the output files, which then get written in
+   pieces of this size */
+#define WRITERAD_BUFSIZE (4L*1024L*1024L)
+
 extern void WriteSimpleText(FILE *fp, SimpleText *text);
 extern int WriteCyl(FILE *fp, char *matName,
 					int id, Cyl3 *cyls);
 extern int WritePoly(FILE *fp, char *matName, int id, Poly3 *polys);
+extern int WriteCylXForm(FILE *fp, int id, Cyl3 *cyls, Matrix4 matrix,
+					char *floating, char *layer);
+extern int WritePolyBuffer(FILE *fp, int id, PolyBuffer *buf,
+					Matrix4 matrix, char *floating, char *layer, int which);
+
+/* which polys WritePolyBuffer() writes */
+#define POLYS_ALL      0
+#define POLYS_FIXED    1  /* those not on the floating layer */
+#define POLYS_FLOATING 2  /* only those on it */
 
 #ifdef __cplusplus
     }
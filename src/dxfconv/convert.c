@@ -27,9 +27,15 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 
 */
+#include <stdlib.h>
+#include <limits.h>
+
 #include "readdxf.h"
 #include "convert.h"
 #include "tables.h"
+#include "dxfconv.h"
+#include "instance.h"
+#include "parallel.h"
 
 #include "geomtypes.h"
 #include "geomdefs.h"
@@ -37,64 +43,136 @@ SOFTWARE.
 #include "writerad.h"
 
 
-int id_index = 0;
-
-static Matrix4 ScaleMatrix;
-Acadvars_Type Acadvars = {
-	0,   /* screenh */
-	0,   /* screenv */
-	0.0, /* pdsize  */
-	0.0, /* viewsize */
-};
-
-
-void InitConvert(void)
+void InitConvert(DxfContext *ctx)
 {
+	/* flatten inserts completely */
+	ctx->ExpandPos = 0;
+	ctx->ExpandFrom = 0;
+	ctx->ExpandTo = LONG_MAX;
+
 	/* initialize a module wide scaling matrix  */
-	M4SetIdentity(ScaleMatrix);
-	if ((Options.scale != 0.0) && (Options.scale != 1.0))
-		M4Scale(ScaleMatrix, Options.scale, Options.scale, Options.scale);
+	M4SetIdentity(ctx->ScaleMatrix);
+	if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0))
+		M4Scale(ctx->ScaleMatrix, ctx->Options.scale,
+				ctx->Options.scale, ctx->Options.scale);
+
+	/* The polys and cyls of an entity are allocated here, and
+	   forgotten once they are written or copied into a block. */
+	GeomArenaInit(&ctx->Scratch, SCRATCH_ARENA_CHUNK);
 }
 
 
-int GetInsertdefToWCS(InsertDef *insertdef, Matrix4 matrix)
+/* Compute the transform of an insert relative to its container,
+   once. The block must be defined by now, for its base point.
+   The copies of a MINSERT array are offset along the rotated x and y
+   axes of the insert, by the unscaled spacing. */
+void GetInsertdefXForm(InsertDef *insertdef)
 {
-	Matrix4 nxform;
-	BlockDef *blockdef = insertdef->blockdef;
+	Matrix4 rot;
+	Point3 origin;
+	Vector3 spacing;
 
-	if(insertdef == NULL) return -1;
-	M4GetAcadXForm(matrix, &insertdef->zvect, 1,
+	if(insertdef->hasxform) return;
+	M4GetAcadXForm(insertdef->xform, &insertdef->zvect, 1,
 		&insertdef->inspt, insertdef->zrot,
 		insertdef->xscale, insertdef->yscale, insertdef->zscale,
-		&blockdef->basept);
+		&insertdef->blockdef->basept);
+	V3SET(0.0, 0.0, 0.0, &insertdef->coloffset);
+	insertdef->rowoffset = insertdef->coloffset;
+	if(insertdef->cols > 1 || insertdef->rows > 1) {
+		V3SET(0.0, 0.0, 0.0, &origin);
+		M4GetAcadXForm(rot, &insertdef->zvect, 1,
+			&origin, insertdef->zrot, 1.0, 1.0, 1.0, NULL);
+		V3SET(insertdef->colspacing, 0.0, 0.0, &spacing);
+		(void)M4MultVector3(&spacing, rot, &insertdef->coloffset);
+		V3SET(0.0, insertdef->rowspacing, 0.0, &spacing);
+		(void)M4MultVector3(&spacing, rot, &insertdef->rowoffset);
+	}
+	insertdef->hasxform = 1;
+}
 
-	while(insertdef->container) {
-		insertdef = insertdef->container;
-		blockdef = insertdef->blockdef;
-		M4GetAcadXForm(nxform, &insertdef->zvect, 1,
-			&insertdef->inspt, insertdef->zrot,
-			insertdef->xscale, insertdef->yscale, insertdef->zscale,
-			&blockdef->basept);
-		M4MatMult(nxform, matrix, matrix);
+
+/* The transform of one copy of a MINSERT array relative to the
+   container, 0/0 is the only copy of a plain insert. */
+void GetInsertdefCellXForm(InsertDef *insertdef, int col, int row,
+		Matrix4 matrix)
+{
+	GetInsertdefXForm(insertdef);
+	M4Copy(insertdef->xform, matrix);
+	if(col == 0 && row == 0) return;
+	matrix[0][3] += col * insertdef->coloffset.x + row * insertdef->rowoffset.x;
+	matrix[1][3] += col * insertdef->coloffset.y + row * insertdef->rowoffset.y;
+	matrix[2][3] += col * insertdef->coloffset.z + row * insertdef->rowoffset.z;
+}
+
+
+/* Set insertdef->toworld, the transform from the block to the WCS
+   for one copy of the insert, including the output scale.
+   A block is inserted in many places, so this is only valid while
+   we're working below this insertdef, and the container's matrix
+   must have been set before. */
+void GetInsertdefToWCS(DxfContext *ctx, InsertDef *insertdef,
+		int col, int row)
+{
+	Matrix4 local;
+
+	GetInsertdefCellXForm(insertdef, col, row, local);
+	if(insertdef->container != NULL) {
+		M4MatMult(insertdef->container->toworld, local, insertdef->toworld);
+	} else {
+		M4MatMult(ctx->ScaleMatrix, local, insertdef->toworld);
 	}
-	return 0;
 }
 
 
-void TransformInsertContents(FILE *outf, InsertDef *insertdef)
+/* Write the contents of the block of insertdef with its current
+   transform, and recurse into the child inserts.
+   When flattening in parts, the blocks are counted in ExpandPos,
+   and only those starting between ExpandFrom and ExpandTo are
+   written. */
+static void TransformInsertCell(DxfContext *ctx, InsertDef *insertdef,
+		char *blocklayer)
+{
+	BlockDef *blockdef = insertdef->blockdef;
+	InsertDef *curins = NULL;
+	long pos = ctx->ExpandPos;
+
+	ctx->ExpandPos += blockdef->size;
+	/* transform and write polys and cyls on the fly,
+	   fixing up floating layers */
+	/* XXX assumes BYLAYER  */
+	if(blockdef->polybuf != NULL && pos >= ctx->ExpandFrom
+			&& pos < ctx->ExpandTo) {
+		WritePolyBuffer(ctx->outf, ctx->id_index++, blockdef->polybuf,
+				insertdef->toworld, ctx->Layer0, blocklayer, POLYS_ALL);
+	}
+	if(blockdef->cyls != NULL && pos >= ctx->ExpandFrom
+			&& pos < ctx->ExpandTo) {
+		WriteCylXForm(ctx->outf, ctx->id_index++, blockdef->cyls,
+				insertdef->toworld, ctx->Layer0, blocklayer);
+	}
+	/* text isn't exported (WriteSimpleText() is a dummy),
+	   so there's no point in transforming it */
+	/* recurse down into child inserts */
+	for(curins = blockdef->inserts; curins; curins = curins->next) {
+		curins->container = insertdef;
+		TransformInsertContents(ctx, curins);
+	}
+}
+
+
+void TransformInsertContents(DxfContext *ctx, InsertDef *insertdef)
 {
 	BlockDef *blockdef = insertdef->blockdef;
-	Poly3 *newpoly = NULL, *curpoly = NULL;
-	Cyl3 *newcyl = NULL, *curcyl = NULL;
-	SimpleText *newtext = NULL;
-	Matrix4 matrix;
 	InsertDef *curins = NULL, *xcurins = NULL;
 	char *blocklayer = NULL;
 	int blockcolor = -1;
+	int col, row;
 
 	/* get floating layer/color and check block recursion */
 	for(curins = insertdef; curins; curins = curins->container) {
 		if(curins != insertdef && curins->blockdef == blockdef) {
+			if(ctx->ExpandFrom != 0) return; /* told that already */
 			fprintf(stderr, "Recursive block reference detected.\n");
 			fprintf(stderr, "Skipping insert: %s", blockdef->name);
 			for(xcurins = insertdef->container; xcurins;
@@ -104,90 +182,88 @@ void TransformInsertContents(FILE *outf, InsertDef *insertdef)
 			fprintf(stderr, " - WORLD\n");
 			return;
 		}
-		if(curins->layer != Layer0 && blocklayer == NULL) {
+		if(curins->layer != ctx->Layer0 && blocklayer == NULL) {
 			blocklayer = curins->layer;
 		}
 		if(curins->color != -1 && blockcolor == -1) {
 			blockcolor = curins->color;
 		}
 	}
-	if(blocklayer == NULL) blocklayer = Layer0;
+	if(blocklayer == NULL) blocklayer = ctx->Layer0;
 	if(blockcolor == -1) blockcolor = 7; /* default white */
 
-	/* get general transformation */
-	GetInsertdefToWCS(insertdef, matrix);
-	/* scale everything for output */
-	if ((Options.scale != 0.0) && (Options.scale != 1.0))
-		M4Scale(matrix, Options.scale, Options.scale, Options.scale);
-
 	/* blah blah */
-	if(Options.verbose > 1) {
+	if(ctx->Options.verbose > 1 && ctx->ExpandFrom == 0) {
 		fprintf(stderr, "    Transforming: %s", blockdef->name);
+		if(insertdef->cols > 1 || insertdef->rows > 1)
+			fprintf(stderr, " [%d x %d]", insertdef->cols, insertdef->rows);
 		for(curins = insertdef->container; curins; curins = curins->container)
 			fprintf(stderr, " >> %s", curins->blockdef->name);
 		fprintf(stderr, " >> WORLD\n");
 	}
-	/* transform and write polys */
-	if(blockdef->polys != NULL) {
-		newpoly = M4TransformPolysCopy(blockdef->polys, matrix);
-		/* XXX assumes BYLAYER  */
-		/* fix up floating layers  */
-		for(curpoly = newpoly; curpoly; curpoly = curpoly->next) {
-			if(curpoly->material == Layer0) {
-				curpoly->material = blocklayer;
-			}
-		}
-		WritePoly(outf, NULL, id_index++, newpoly);
-	}
-	/* transform and write cyls */
-	if(blockdef->cyls != NULL) {
-		newcyl = M4TransformCylsCopy(blockdef->cyls, matrix);
-		/* XXX assumes BYLAYER  */
-		/* fix up floating layers  */
-		for(curcyl = newcyl; curcyl; curcyl = curcyl->next) {
-			if(curcyl->material == Layer0) {
-				curcyl->material = blocklayer;
-			}
+	/* each copy gets its own general transformation,
+	   which our children build on */
+	for(row = 0; row < insertdef->rows; row++) {
+		for(col = 0; col < insertdef->cols; col++) {
+			/* our part is done, but the first part reports
+			   the problems for all of them */
+			if(ctx->ExpandPos >= ctx->ExpandTo && ctx->ExpandFrom != 0)
+				return;
+			GetInsertdefToWCS(ctx, insertdef, col, row);
+			TransformInsertCell(ctx, insertdef, blocklayer);
 		}
-		WriteCyl(outf, NULL, id_index++, newcyl);
-	}
-	/* transform and write text */
-	if(blockdef->texts != NULL) {
-		/* refcopy dosen't copy the actual text data! */
-		newtext = M4TransformSimpleTextRefcopy(blockdef->texts, matrix);
-		WriteSimpleText(outf, newtext);
-	}
-	/* recurse down into child inserts */
-	for(curins = blockdef->inserts; curins; curins = curins->next) {
-		curins->container = insertdef;
-		TransformInsertContents(outf, curins);
 	}
 }
 
 
-void ConvertBlockStart(Block_Type Block)
+void ConvertBlockStart(DxfContext *ctx, Block_Type Block)
 {
 	BlockDef *blockdef;
 
-	if(Options.verbose > 1) {
+	if(ctx->Options.verbose > 1) {
 		fprintf(stderr, "    Reading block definition: %s\n", Block.Name);
 	}
-	blockdef = GetBlockDef(Block.Name);
+	blockdef = GetBlockDef(ctx, Block.Name);
 	if(blockdef == NULL) {
 		blockdef = BlockAlloc(Block.Name);
-		AddBlockDef(blockdef);
+		if(blockdef == NULL) return;
+		AddBlockDef(ctx, blockdef);
 	}
-	if(blockdef == NULL) return;
 
 	blockdef->basept = Block.Base;
-	CurrentBlockDef = blockdef;
+	ctx->CurrentBlockDef = blockdef;
 
 	return;
 }
 
-void ConvertBlockEnd(Block_Type Block)
+/* Only remember where the entities of Block are, to read them when
+   it is first inserted. Many drawings carry lots of blocks that are
+   never used. Returns -1 if the block must be read now. */
+int ConvertBlockDefer(DxfContext *ctx, Block_Type Block)
 {
-	CurrentBlockDef = NULL;
+	BlockDef *blockdef;
+
+	blockdef = GetBlockDef(ctx, Block.Name);
+	if(blockdef != NULL) {
+		/* defined again, the parts are read in order */
+		ReadBlockDef(ctx, blockdef);
+		return -1;
+	}
+	blockdef = BlockAlloc(Block.Name);
+	if(blockdef == NULL) return -1;
+	AddBlockDef(ctx, blockdef);
+
+	blockdef->basept = Block.Base;
+	blockdef->source = Block.Body;
+	blockdef->sourceend = ctx->infp->end;
+	blockdef->sourceline = Block.BodyLine;
+	return 0;
+}
+
+void ConvertBlockEnd(DxfContext *ctx, Block_Type Block)
+{
+	if(ctx->CurrentBlockDef != NULL) BlockFinish(ctx, ctx->CurrentBlockDef);
+	ctx->CurrentBlockDef = NULL;
 	return;
 }
 
@@ -207,7 +283,7 @@ void get_screensize(View_Type View, double *vh, double *vv)
 	}
 }
 
-void ConvertView(View_Type View)
+void ConvertView(DxfContext *ctx, View_Type View)
 {
 	FILE *vf;
 	char vfn[MAXPATH];
@@ -219,9 +295,9 @@ void ConvertView(View_Type View)
 	Vector3 zunit = {0.0, 0.0, 1.0};
 	Matrix4 matrix;
 
-	if (Options.views == 0) return;
+	if (ctx->Options.views == 0) return;
 	if ((sizeof(vfn)
-		- Options.viewprefixlen
+		- ctx->Options.viewprefixlen
 		- strlen(View.Name)
 		- 4) < 0) {
 		fprintf(stderr,
@@ -273,11 +349,11 @@ void ConvertView(View_Type View)
 	}
 	get_screensize(View, &vh, &vv);
 
-	strncpy(vfn, Options.viewprefix, sizeof(vfn));
-	strncat(vfn, View.Name, sizeof(vfn)-Options.viewprefixlen-4);
-	strncat(vfn, ".vf", sizeof(vfn)-Options.viewprefixlen-1);
+	strncpy(vfn, ctx->Options.viewprefix, sizeof(vfn));
+	strncat(vfn, View.Name, sizeof(vfn)-ctx->Options.viewprefixlen-4);
+	strncat(vfn, ".vf", sizeof(vfn)-ctx->Options.viewprefixlen-1);
 	vfn[sizeof(vfn)-1] = '\0'; /* paranoia */
-	if(Options.verbose > 2) {
+	if(ctx->Options.verbose > 2) {
 		fprintf(stderr, "      Writing view file \"%s\"\n", vfn);
 	}
 	errno = 0;
@@ -287,12 +363,12 @@ void ConvertView(View_Type View)
 			View.Name, errno, strerror(errno));
 		return;
 	}
-	V3Scale(&vp, Options.scale);
-	va *= Options.scale;
-	vo *= Options.scale;
+	V3Scale(&vp, ctx->Options.scale);
+	va *= ctx->Options.scale;
+	vo *= ctx->Options.scale;
 	if(!(View.Mode & 1)) {
-		vh *= Options.scale;
-		vv *= Options.scale;
+		vh *= ctx->Options.scale;
+		vv *= ctx->Options.scale;
 	}
 	fprintf(vf, "rpict -vt%c", (View.Mode & 1) ? 'v':'l');
 	fprintf(vf, " -vp %g %g %g", vp.x, vp.y, vp.z);
@@ -303,12 +379,12 @@ void ConvertView(View_Type View)
 }
 
 
-void ConvertFace(Face3D_Type Face,int Vertices)
+void ConvertFace(DxfContext *ctx, Face3D_Type Face, int Vertices)
 {
 	Poly3 *poly = NULL, *polys = NULL;
 	char *layerdef = NULL;
 
-	layerdef = GetLayerDef(Face.Layer);
+	layerdef = Face.Layer;
 	if(layerdef == NULL) return;
 	if (Vertices < 3 )
 		fprintf(stderr,"Warning: Too few vertices in face. Ignored.\n");
@@ -316,14 +392,14 @@ void ConvertFace(Face3D_Type Face,int Vertices)
 		fprintf(stderr,"Warning: Too many vertices in face. Ignored.\n");
 	else {
 		if (Vertices == 3) {
-			if ((poly = Poly3Alloc(3, 1, NULL)) == NULL)
-				return;
+			if ((poly = Poly3ArenaAlloc(&ctx->Scratch, 3, 1, NULL)) == NULL)
+				goto done;
 			poly->verts[0] = Face.p[0];
 			poly->verts[1] = Face.p[1];
 			poly->verts[2] = Face.p[2];
 		} else if (Vertices == 4) {
-			if ((poly = Poly3Alloc(4, 1, NULL)) == NULL)
-				return;
+			if ((poly = Poly3ArenaAlloc(&ctx->Scratch, 4, 1, NULL)) == NULL)
+				goto done;
 			poly->verts[0] = Face.p[0];
 			poly->verts[1] = Face.p[1];
 			poly->verts[2] = Face.p[2];
@@ -331,69 +407,70 @@ void ConvertFace(Face3D_Type Face,int Vertices)
 		}
 		poly->material = layerdef;
 		if (!PolyCheckColinear(poly) || (PolyGetArea(poly) <= 0.0)) {
-			free(poly->verts);
-			free(poly);
-			return;
+			Poly3Free(&poly);
+			goto done;
 		}
-		if ((Vertices == 4) && (Options.smooth || !FaceCheckCoplanar(poly))) {
+		if ((Vertices == 4) && (ctx->Options.smooth || !FaceCheckCoplanar(poly))) {
 			if ((polys = FaceSubDivide(poly)) != NULL) {
 				Poly3Free(&poly);
 				poly = polys;
 			}
 		}
-		if(CurrentBlockDef != NULL) {
-			BlockAddPoly(CurrentBlockDef, poly);
+		if(ctx->CurrentBlockDef != NULL) {
+			BlockAddPoly(ctx->CurrentBlockDef, poly);
 		} else {
-			if ((Options.scale != 0.0) && (Options.scale != 1.0)) {
-				M4TransformPolys(poly, ScaleMatrix);
+			if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0)) {
+				M4TransformPolys(poly, ctx->ScaleMatrix);
 			}
-			WritePoly(outf, Face.Layer, id_index++, poly);
+			WritePoly(ctx->outf, Face.Layer, ctx->id_index++, poly);
 		}
 	}
+done:
+	GeomArenaReset(&ctx->Scratch);
 }
 
-void ConvertSmoothFace(Face3D_Type Face,Face3D_Type Normal,int Vertices)
+void ConvertSmoothFace(DxfContext *ctx, Face3D_Type Face,
+		Face3D_Type Normal, int Vertices)
 {
 	/* shortcut for now...  */
-	ConvertFace(Face, Vertices);
+	ConvertFace(ctx, Face, Vertices);
 }
 
 
-void ConvertTextEntity(Text_Type Text)
+void ConvertTextEntity(DxfContext *ctx, Text_Type Text)
 {
 	SimpleText *text;
 
 	text = SimpleTextAlloc(Text.Text, NULL);
 	text->position = Text.Location;
-	if(CurrentBlockDef != NULL) {
-		BlockAddText(CurrentBlockDef, text);
+	if(ctx->CurrentBlockDef != NULL) {
+		BlockAddText(ctx->CurrentBlockDef, text);
 	} else {
-		if ((Options.scale != 0.0) && (Options.scale != 1.0)) {
-			M4TransformSimpleTexts(text, ScaleMatrix);
+		if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0)) {
+			M4TransformSimpleTexts(text, ctx->ScaleMatrix);
 		}
-		WriteSimpleText(outf, text);
+		WriteSimpleText(ctx->outf, text);
 	}
 }
 
 
-void ConvertTraceEntity(Trace_Type Trace)
+void ConvertTraceEntity(DxfContext *ctx, Trace_Type Trace)
 {
 	Poly3 *poly = NULL;
 	char *layerdef = NULL;
 	Matrix4 mx;
 
-	layerdef = GetLayerDef(Trace.Layer);
+	layerdef = Trace.Layer;
 	if(layerdef == NULL) return;
-	if ((poly = Poly3Alloc(4, 1, NULL)) == NULL)
-		return;
+	if ((poly = Poly3ArenaAlloc(&ctx->Scratch, 4, 1, NULL)) == NULL)
+		goto done;
 	poly->verts[0] = Trace.p[0];
 	poly->verts[1] = Trace.p[1];
 	poly->verts[2] = Trace.p[2];
 	poly->verts[3] = Trace.p[3];
 	if (!PolyCheckColinear(poly) || (PolyGetArea(poly) <= 0.0)) {
-		free(poly->verts);
-		free(poly);
-		return;
+		Poly3Free(&poly);
+		goto done;
 	}
 	poly->material = layerdef;
 	if(Trace.Thickness != 0.0) {
@@ -404,52 +481,88 @@ void ConvertTraceEntity(Trace_Type Trace)
 	}
 	M4GetAcadXForm(mx, &Trace.Normal, 0, NULL, 0.0, 1.0, 1.0, 1.0, NULL);
 	M4TransformPolys(poly, mx);
-	if(CurrentBlockDef != NULL) {
-		BlockAddPoly(CurrentBlockDef, poly);
+	if(ctx->CurrentBlockDef != NULL) {
+		BlockAddPoly(ctx->CurrentBlockDef, poly);
 	} else {
-		if ((Options.scale != 0.0) && (Options.scale != 1.0)) {
-			M4TransformPolys(poly, ScaleMatrix);
+		if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0)) {
+			M4TransformPolys(poly, ctx->ScaleMatrix);
 		}
-		WritePoly(outf, Trace.Layer, id_index++, poly);
+		WritePoly(ctx->outf, Trace.Layer, ctx->id_index++, poly);
 	}
+done:
+	GeomArenaReset(&ctx->Scratch);
 }
 
 
-void ConvertInsertEntity(Insert_Type Insert)
+static InsertDef *NewInsertDef(DxfContext *ctx, Insert_Type *Insert)
 {
 	InsertDef *insertdef = NULL;
 	char *layerdef = NULL;
 
-	layerdef = GetLayerDef(Insert.Layer);
-	if(layerdef == NULL) return;
+	layerdef = Insert->Layer;
+	if(layerdef == NULL) return NULL;
 
-	insertdef = InsertAlloc(Insert.Name);
-	if(insertdef == NULL) return;
+	insertdef = InsertAlloc(ctx, Insert->Name);
+	if(insertdef == NULL) return NULL;
 
 	insertdef->layer = layerdef;
-	insertdef->inspt = Insert.Insertion;
-	insertdef->zvect = Insert.Normal;
-	insertdef->zrot = Insert.Rotation;
-	insertdef->xscale = Insert.Scale.x;
-	insertdef->yscale = Insert.Scale.y;
-	insertdef->zscale = Insert.Scale.z;
-
-	if(CurrentBlockDef != NULL) {
-		BlockAddInsert(CurrentBlockDef, insertdef);
+	insertdef->inspt = Insert->Insertion;
+	insertdef->zvect = Insert->Normal;
+	insertdef->zrot = Insert->Rotation;
+	insertdef->xscale = Insert->Scale.x;
+	insertdef->yscale = Insert->Scale.y;
+	insertdef->zscale = Insert->Scale.z;
+	/* MINSERT array */
+	if(Insert->ColumnCount > 1) insertdef->cols = (int)Insert->ColumnCount;
+	if(Insert->RowCount > 1) insertdef->rows = (int)Insert->RowCount;
+	insertdef->colspacing = Insert->ColumnSpacing;
+	insertdef->rowspacing = Insert->RowSpacing;
+	return insertdef;
+}
+
+void ConvertInsertEntity(DxfContext *ctx, Insert_Type Insert)
+{
+	InsertDef *insertdef = NULL, top;
+
+	insertdef = NewInsertDef(ctx, &Insert);
+	if(insertdef == NULL) return;
+
+	if(ctx->CurrentBlockDef != NULL) {
+		BlockAddInsert(ctx->CurrentBlockDef, insertdef);
 	} else {
-		TransformInsertContents(outf, insertdef);
+		/* on the stack, nothing to free if converting it fails */
+		top = *insertdef;
+		free(insertdef);
+		if((!ctx->Options.instances || InstanceInsert(ctx, &top) != 0)
+				&& ParallelInsert(ctx, &top) != 0) {
+			TransformInsertContents(ctx, &top);
+		}
+		BlockRelease(ctx, top.blockdef);
 	}
 }
 
-void ConvertLineEntity(Line_Type Line)
+/* For +i with -j: write the block files that a top level Insert
+   will refer to, before the insert itself is converted elsewhere. */
+void InstanceInsertEntity(DxfContext *ctx, Insert_Type Insert)
+{
+	InsertDef *insertdef = NULL, top;
+
+	insertdef = NewInsertDef(ctx, &Insert);
+	if(insertdef == NULL) return;
+	top = *insertdef;
+	free(insertdef);
+	(void)InstanceBlock(ctx, &top);
+}
+
+void ConvertLineEntity(DxfContext *ctx, Line_Type Line)
 {
 	Poly3 *poly;
 	char *layerdef = NULL;
 
-	if(!Options.ignorethickness && Line.Thickness == 0.0) return;
-	layerdef = GetLayerDef(Line.Layer);
+	if(!ctx->Options.ignorethickness && Line.Thickness == 0.0) return;
+	layerdef = Line.Layer;
 	if(layerdef == NULL) return;	
-	poly = Poly3Alloc(4, 1, NULL);
+	poly = Poly3ArenaAlloc(&ctx->Scratch, 4, 1, NULL);
 	if (poly == NULL) return;
 	
 	poly->verts[0] = Line.Start;
@@ -464,35 +577,36 @@ void ConvertLineEntity(Line_Type Line)
 	}
 	poly->material = layerdef;
 	
-	if(CurrentBlockDef != NULL) {
-		BlockAddPoly(CurrentBlockDef, poly);
+	if(ctx->CurrentBlockDef != NULL) {
+		BlockAddPoly(ctx->CurrentBlockDef, poly);
 	} else {
-		if ((Options.scale != 0.0) && (Options.scale != 1.0)) {
-			M4TransformPolys(poly, ScaleMatrix);
+		if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0)) {
+			M4TransformPolys(poly, ctx->ScaleMatrix);
 		}
-		WritePoly(outf, Line.Layer, id_index++, poly);
+		WritePoly(ctx->outf, Line.Layer, ctx->id_index++, poly);
 	}
+	GeomArenaReset(&ctx->Scratch);
 }
 
 
-void ConvertArcEntity(Arc_Type Arc)
+void ConvertArcEntity(DxfContext *ctx, Arc_Type Arc)
 {
 	int i;
 	Poly3 *poly, *arc, *polys;
 	char *layerdef = NULL;
 	Matrix4 mx;
 
-	if(!Options.ignorethickness && Arc.Thickness == 0.0) return;
-	layerdef = GetLayerDef(Arc.Layer);
+	if(!ctx->Options.ignorethickness && Arc.Thickness == 0.0) return;
+	layerdef = Arc.Layer;
 	if(layerdef == NULL) return;	
 
-	arc = SegmentArc(&Arc.Center, CW, Options.disttol, Options.angtol,
+	arc = SegmentArc(&Arc.Center, CW, ctx->Options.disttol, ctx->Options.angtol,
 			Arc.Radius, Arc.Startangle, Arc.Endangle);
 	if(arc == NULL) return;
-	poly = Poly3Alloc(arc->nverts+2, 0, arc);
+	poly = Poly3ArenaAlloc(&ctx->Scratch, arc->nverts+2, 0, arc);
 	if (poly == NULL) {
 		Poly3FreeList(arc);
-		return;
+		goto done;
 	}
 	for(i = 0; i < arc->nverts; i++) {
 		poly->verts[i+1] = arc->verts[i];
@@ -505,33 +619,36 @@ void ConvertArcEntity(Arc_Type Arc)
 	if (Arc.Thickness == 0) {
 		polys = poly;
 	} else {
-		if ((polys = CreateSideWalls(poly, Arc.Thickness)) == NULL)
-			return;
-		Poly3FreeList(poly);
+		polys = CreateSideWalls(poly, Arc.Thickness);
+		Poly3FreeList(poly); /* takes arc along */
+		if (polys == NULL)
+			goto done;
 	}
 
 	M4GetAcadXForm(mx, &Arc.Normal, 0, NULL, 0.0, 1.0, 1.0, 1.0, NULL);
 	M4TransformPolys(polys, mx);
-	if(CurrentBlockDef != NULL) {
-		BlockAddPoly(CurrentBlockDef, polys);
+	if(ctx->CurrentBlockDef != NULL) {
+		BlockAddPoly(ctx->CurrentBlockDef, polys);
 	} else {
-		if ((Options.scale != 0.0) && (Options.scale != 1.0)) {
-			M4TransformPolys(polys, ScaleMatrix);
+		if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0)) {
+			M4TransformPolys(polys, ctx->ScaleMatrix);
 		}
-		WritePoly(outf, Arc.Layer, id_index++, polys);
+		WritePoly(ctx->outf, Arc.Layer, ctx->id_index++, polys);
 	}
+done:
+	GeomArenaReset(&ctx->Scratch);
 }
 
 
-void ConvertCircleEntity(Circle_Type Circle)
+void ConvertCircleEntity(DxfContext *ctx, Circle_Type Circle)
 {
 	Cyl3 *cyl;
 	Matrix4 mx;
 	char *layerdef = NULL;
 
-	layerdef = GetLayerDef(Circle.Layer);
+	layerdef = Circle.Layer;
 	if(layerdef == NULL) return;	
-	cyl = Cyl3Alloc(NULL);
+	cyl = Cyl3ArenaAlloc(&ctx->Scratch, NULL);
 	if (cyl == NULL) return;
 	cyl->srad = cyl->erad = Circle.Radius;
 	cyl->length = Circle.Thickness;
@@ -549,27 +666,28 @@ void ConvertCircleEntity(Circle_Type Circle)
 	/* transform points from ECS to next higher level CS */
 	M4GetAcadXForm(mx, &Circle.Normal, 0, NULL, 0.0, 1.0, 1.0, 1.0, NULL);
 	M4TransformCyls(cyl, mx);
-	if(CurrentBlockDef != NULL) {
-		BlockAddCyl(CurrentBlockDef, cyl);
+	if(ctx->CurrentBlockDef != NULL) {
+		BlockAddCyl(ctx->CurrentBlockDef, cyl);
 	} else {
-		if ((Options.scale != 0.0) && (Options.scale != 1.0)) {
-			M4TransformCyls(cyl, ScaleMatrix);
+		if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0)) {
+			M4TransformCyls(cyl, ctx->ScaleMatrix);
 		}
-		WriteCyl(outf, Circle.Layer, id_index++, cyl);
+		WriteCyl(ctx->outf, Circle.Layer, ctx->id_index++, cyl);
 	}
+	GeomArenaReset(&ctx->Scratch);
 }
 
 
-void ConvertPointEntity(Point_Type Point)
+void ConvertPointEntity(DxfContext *ctx, Point_Type Point)
 {
 	Cyl3 *cyl;
 	char *layerdef = NULL;
 
-	layerdef = GetLayerDef(Point.Layer);
+	layerdef = Point.Layer;
 	if(layerdef == NULL) return;	
-	if(Point.Thickness == 0.0) Point.Thickness = Acadvars.pdsize;
+	if(Point.Thickness == 0.0) Point.Thickness = ctx->Acadvars.pdsize;
 	if(Point.Thickness == 0.0) return;
-	cyl = Cyl3Alloc(NULL);
+	cyl = Cyl3ArenaAlloc(&ctx->Scratch, NULL);
 	if (cyl == NULL) return;
 
 	cyl->srad = Point.Thickness;
@@ -577,24 +695,25 @@ void ConvertPointEntity(Point_Type Point)
 	cyl->svert = Point.Center;
 	cyl->material = layerdef;
 
-	if(CurrentBlockDef != NULL) {
-		BlockAddCyl(CurrentBlockDef, cyl);
+	if(ctx->CurrentBlockDef != NULL) {
+		BlockAddCyl(ctx->CurrentBlockDef, cyl);
 	} else {
-		if ((Options.scale != 0.0) && (Options.scale != 1.0)) {
-			M4TransformCyls(cyl, ScaleMatrix);
+		if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0)) {
+			M4TransformCyls(cyl, ctx->ScaleMatrix);
 		}
-		WriteCyl(outf, Point.Layer, id_index++, cyl);
+		WriteCyl(ctx->outf, Point.Layer, ctx->id_index++, cyl);
 	}
+	GeomArenaReset(&ctx->Scratch);
 }
 
 
-void Convert3DFaceEntity(Face3D_Type Face3D)
+void Convert3DFaceEntity(DxfContext *ctx, Face3D_Type Face3D)
 {
-	ConvertFace(Face3D,4);
+	ConvertFace(ctx, Face3D,4);
 }
 
 
-void ConvertPline(PolyLine_Type Pline, Point3 Mesh[],
+void ConvertPline(DxfContext *ctx, PolyLine_Type Pline, Point3 Mesh[],
 				double Bulges[])
 {
 	int i, jj, k;
@@ -605,7 +724,7 @@ void ConvertPline(PolyLine_Type Pline, Point3 Mesh[],
 	Matrix4 mx;
 	char *layerdef = NULL;
 
-	layerdef = GetLayerDef(Pline.Layer);
+	layerdef = Pline.Layer;
 	if(layerdef == NULL) return;
 	for(i = 1; i <= vertnum; i++) {
 		/* let's expand all the bulges first, so that we
@@ -621,8 +740,8 @@ void ConvertPline(PolyLine_Type Pline, Point3 Mesh[],
 			else p2 = &Mesh[i+1];
 			radius = BulgeToArc(&Mesh[i], p2, Bulges[i],
 				&dir, &center, &a1, &a2);
-			arc = SegmentArc(&center, dir, Options.disttol,
-				Options.angtol, radius, a1, a2);
+			arc = SegmentArc(&center, dir, ctx->Options.disttol,
+				ctx->Options.angtol, radius, a1, a2);
 			nvertnum += arc->nverts;
 			if(lastarc == NULL) {
 				arcs = lastarc = arc;
@@ -632,7 +751,7 @@ void ConvertPline(PolyLine_Type Pline, Point3 Mesh[],
 			}
 		}
 	}
-	poly = Poly3Alloc(nvertnum, Pline.Flags & 1, NULL);
+	poly = Poly3ArenaAlloc(&ctx->Scratch, nvertnum, Pline.Flags & 1, NULL);
 	poly->material = layerdef; /* points into table */
 	curarc = arcs;
 	for(i = 1, jj = 0; i <= vertnum; i++) {
@@ -669,19 +788,20 @@ void ConvertPline(PolyLine_Type Pline, Point3 Mesh[],
 	M4GetAcadXForm(mx, &Pline.Normal, 0, NULL, 0.0, 1.0, 1.0, 1.0, NULL);
 	M4TransformPolys(poly, mx);
 
-	if(CurrentBlockDef != NULL) {
-		BlockAddPoly(CurrentBlockDef, poly);
+	if(ctx->CurrentBlockDef != NULL) {
+		BlockAddPoly(ctx->CurrentBlockDef, poly);
 	} else {
-		if ((Options.scale != 0.0) && (Options.scale != 1.0)) {
-			M4TransformPolys(poly, ScaleMatrix);
+		if ((ctx->Options.scale != 0.0) && (ctx->Options.scale != 1.0)) {
+			M4TransformPolys(poly, ctx->ScaleMatrix);
 		}
-		WritePoly(outf, Pline.Layer, id_index++, poly);
+		WritePoly(ctx->outf, Pline.Layer, ctx->id_index++, poly);
 	}
+	GeomArenaReset(&ctx->Scratch);
 }
 
 
 
-void  ConvertMesh(PolyLine_Type PolyLine,Point3 Mesh[],
+void  ConvertMesh(DxfContext *ctx, PolyLine_Type PolyLine,Point3 Mesh[],
 				Point3 Normals[], int Faces[][4],unsigned int VCount[])
 {
 	
@@ -691,7 +811,7 @@ void  ConvertMesh(PolyLine_Type PolyLine,Point3 Mesh[],
 	Face3D_Type Normal;
 #endif
 	
-	strncpy(Face.Layer, PolyLine.Layer, MAXSTRING);
+	Face.Layer = PolyLine.Layer;
 	if (PolyLine.Flags & 16 || PolyLine.Flags & 64) {
 		
 		N=PolyLine.N_Count,M=PolyLine.M_Count;
@@ -711,11 +831,11 @@ void  ConvertMesh(PolyLine_Type PolyLine,Point3 Mesh[],
 					Normal.p[1] = Normals[(j-1)%M*N+(i%N)+1];
 					Normal.p[2] = Normals[(j-1)%M*N+(i-1)%N+1];
 					Normal.p[3] = Normals[(j%M)*N+(i-1)%N+1];
-					if (Options.smooth)
-						ConvertSmoothFace(Face,Normal,4);
+					if (ctx->Options.smooth)
+						ConvertSmoothFace(ctx, Face,Normal,4);
 					else
 #endif
-						ConvertFace(Face,4);
+						ConvertFace(ctx, Face,4);
 				}
 			}
 		}
@@ -729,11 +849,11 @@ void  ConvertMesh(PolyLine_Type PolyLine,Point3 Mesh[],
 #endif
 				}
 #ifdef WITH_SMOOTHING
-				if (Options.smooth)
-					ConvertSmoothFace(Face,Normal,VCount[i]);
+				if (ctx->Options.smooth)
+					ConvertSmoothFace(ctx, Face,Normal,VCount[i]);
 				else
 #endif
-					ConvertFace(Face,VCount[i]);
+					ConvertFace(ctx, Face,VCount[i]);
 			}
 		}
 		
@@ -33,15 +33,12 @@ SOFTWARE.
     extern "C" {
 #endif
 
-extern FILE *outf;
-
 typedef struct {
 	int screenh;
 	int screenv;
 	double pdsize;
 	double viewsize;
 } Acadvars_Type;
-extern Acadvars_Type Acadvars;
 
 typedef struct Opt_Def{
 	int verbose;
@@ -60,29 +57,46 @@ typedef struct Opt_Def{
 	int smooth;
 	int ignorepolywidth;
 	int ignorethickness;
+	int workers;
+	int instances;
+	char *blockprefix;
+	int outbuffers;
+	int syncoutput;
+	int gzlevel;
+	char *layers;
+	char *xlayers;
+	int freeblocks;
 } Options_Type;
 
-extern void InitConvert(void);
-extern Options_Type Options;
+#ifndef _DXFCONTEXT_T
+#define _DXFCONTEXT_T
+typedef struct _DxfContext DxfContext;
+#endif
+
+/* largest chunk of the per entity scratch arena */
+#define SCRATCH_ARENA_CHUNK (64L*1024L)
 
-void ConvertTextEntity(Text_Type);
-void ConvertBlockStart(Block_Type);
-void ConvertBlockEnd(Block_Type);
-void ConvertView(View_Type);
-void ConvertInsertEntity(Insert_Type);
-void ConvertLineEntity(Line_Type);
-void ConvertArcEntity(Arc_Type);
-void ConvertCircleEntity(Circle_Type);
-void ConvertPointEntity(Point_Type);
-void Convert3DFaceEntity(Face3D_Type);
-void ConvertTraceEntity(Trace_Type);
-void ConvertMesh(PolyLine_Type,
+extern void InitConvert(DxfContext *ctx);
+
+void ConvertTextEntity(DxfContext *ctx, Text_Type);
+void ConvertBlockStart(DxfContext *ctx, Block_Type);
+int ConvertBlockDefer(DxfContext *ctx, Block_Type);
+void ConvertBlockEnd(DxfContext *ctx, Block_Type);
+void ConvertView(DxfContext *ctx, View_Type);
+void ConvertInsertEntity(DxfContext *ctx, Insert_Type);
+void InstanceInsertEntity(DxfContext *ctx, Insert_Type);
+void ConvertLineEntity(DxfContext *ctx, Line_Type);
+void ConvertArcEntity(DxfContext *ctx, Arc_Type);
+void ConvertCircleEntity(DxfContext *ctx, Circle_Type);
+void ConvertPointEntity(DxfContext *ctx, Point_Type);
+void Convert3DFaceEntity(DxfContext *ctx, Face3D_Type);
+void ConvertTraceEntity(DxfContext *ctx, Trace_Type);
+void ConvertMesh(DxfContext *ctx, PolyLine_Type,
 				Point3[],Point3[],
 				int[][4],unsigned int[]);
-void ConvertPline(PolyLine_Type, Point3[],
+void ConvertPline(DxfContext *ctx, PolyLine_Type, Point3[],
 				double[]);
 
-
 #ifdef __cplusplus
     }
 #endif
@@ -0,0 +1,459 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/* dxfconv.c - convert a DXF drawing, with all state in a DxfContext */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dxfconv.h"
+#include "geomproto.h"
+#include "dxfindex.h"
+
+
+DxfContext *DxfContextNew(const Options_Type *options)
+{
+	DxfContext *ctx;
+
+	ctx = (DxfContext*)calloc(1, sizeof(DxfContext));
+	if(ctx == NULL) return NULL;
+	ctx->Options = *options;
+	if(InitTables(ctx) != 0) {
+		DxfContextFree(ctx);
+		return NULL;
+	}
+	InitConvert(ctx);
+	return ctx;
+}
+
+
+void DxfContextFree(DxfContext *ctx)
+{
+	if(ctx == NULL) return;
+	FreeTables(ctx);
+	GeomArenaFree(&ctx->Scratch);
+	free(ctx->Mesh);
+	free(ctx->Bulges);
+	free(ctx->Faces);
+	free(ctx->VCount);
+	free(ctx->Normals);
+	free(ctx);
+}
+
+
+void DxfFail(DxfContext *ctx, const char *msg)
+{
+	if(msg != NULL) fprintf(stderr, "Error: %s.\n", msg);
+	if(ctx->Failure == NULL) abort(); /* not below an entry point */
+	longjmp(*ctx->Failure, 1);
+}
+
+
+void DxfCheckInput(DxfContext *ctx, DxfInput *in)
+{
+	if(DxfBad(in)) DxfFail(ctx, NULL); /* next_group() told why */
+}
+
+
+/* Convert the sections found in ctx->infp */
+static int ConvertSections(DxfContext *ctx)
+{
+	int status = 0;
+	const char *section;
+	static char eoferrmsg[] =
+		"Unexpected end of file in %s section of file \"%s\" (line %d)\n";
+
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp)
+			&& (ctx->Group.code != 0 || ctx->Group.keyword != kw_EOF)) {
+		if(ctx->Group.code == 0 && ctx->Group.keyword == kw_SECTION) {
+			next_group(ctx->infp, &ctx->Group); /* code 2 group */
+			section = NULL;
+			switch(ctx->Group.keyword) {
+			case kw_HEADER:
+				if(ctx->Options.verbose > 0) {
+					fprintf(stderr, "  Reading headers\n");
+				}
+				HeaderSection(ctx);
+				section = "HEADER";
+				break;
+			case kw_CLASSES:
+				if(ctx->Options.verbose > 0) {
+					fprintf(stderr, "  Ignoring classes\n");
+				}
+				IgnoreSection(ctx);
+				section = "CLASSES";
+				break;
+			case kw_TABLES:
+				if(ctx->Options.verbose > 0) {
+					fprintf(stderr, "  Reading tables\n");
+				}
+				TablesSection(ctx);
+				section = "TABLES";
+				break;
+			case kw_BLOCKS:
+				if(ctx->Options.geom && ctx->outf != NULL) {
+					if(ctx->Options.verbose > 0) {
+						fprintf(stderr, "  Reading blocks\n");
+					}
+					BlocksSection(ctx);
+				} else { /* only needed for the entities */
+					if(ctx->Options.verbose > 0) {
+						fprintf(stderr, "  Ignoring blocks\n");
+					}
+					IgnoreSection(ctx);
+				}
+				section = "BLOCKS";
+				break;
+			case kw_ENTITIES:
+				if(ctx->Options.geom && ctx->outf != NULL) {
+					if(ctx->Options.verbose > 0) {
+						fprintf(stderr, "  Reading entities\n");
+					}
+					EntitiesSection(ctx);
+				} else {
+					if(ctx->Options.verbose > 0) {
+						fprintf(stderr, "  Ignoring entities\n");
+					}
+					IgnoreSection(ctx);
+				}
+				section = "ENTITIES";
+				break;
+			case kw_OBJECTS:
+				if(ctx->Options.verbose > 0) {
+					fprintf(stderr, "  Ignoring objects\n");
+				}
+				IgnoreSection(ctx);
+				section = "OBJECTS";
+				break;
+			default:
+				break;
+			}
+			DxfCheckInput(ctx, ctx->infp);
+			if(section != NULL && DxfEof(ctx->infp)) {
+				fprintf(stderr, eoferrmsg,
+						section, ctx->Inputname, ctx->Group.line);
+				status = -1;
+			}
+		}
+		next_group(ctx->infp, &ctx->Group);
+	}
+	DxfCheckInput(ctx, ctx->infp);
+	return status;
+}
+
+
+int DxfConvertInput(DxfContext *ctx, DxfInput *in, const char *name,
+		FILE *out)
+{
+	jmp_buf failure;
+	int status;
+
+	ctx->infp = in;
+	ctx->outf = out;
+	ctx->Inputname = name;
+	/* Initialise group  */
+	ctx->Group.line = 0;
+
+	if(setjmp(failure) != 0) {
+		ctx->Failure = NULL;
+		ctx->infp = NULL;
+		return -1;
+	}
+	ctx->Failure = &failure;
+	/* Read DXF file and write Radiance data.  */
+	status = ConvertSections(ctx);
+	ctx->Failure = NULL;
+	ctx->infp = NULL;
+	return status;
+}
+
+
+/* Read the part of the drawing from start to end, with line lines in
+   front of it, with reader. */
+static void ReadRange(DxfContext *ctx, DxfInput *in, long start, long end,
+		int line, void (*reader)(DxfContext *ctx))
+{
+	DxfInput view;
+
+	DxfInitRange(&view, in, in->map + start, in->map + end);
+	ctx->infp = &view;
+	ctx->Group.line = line;
+	reader(ctx);
+	ctx->infp = NULL;
+	DxfCheckInput(ctx, &view);
+}
+
+static void ReadSections(DxfContext *ctx)
+{
+	(void)ConvertSections(ctx);
+}
+
+static void ReadBlockRange(DxfContext *ctx)
+{
+	next_group(ctx->infp, &ctx->Group); /* first block */
+	ReadBlocks(ctx);
+}
+
+static void ReadEntityRange(DxfContext *ctx)
+{
+	next_group(ctx->infp, &ctx->Group); /* first entity */
+	ReadEntities(ctx, kw_LAST); /* up to the end of the range */
+}
+
+
+/* Mark block and the blocks inserted in it as needed */
+static void NeedBlock(DxfIndex *idx, char *needed, unsigned long block,
+		unsigned long *stack)
+{
+	unsigned long depth = 0, i;
+	DxfIndexBlock *def;
+
+	if(block == DXFINDEX_NONE || needed[block]) return;
+	needed[block] = 1;
+	stack[depth++] = block;
+	while(depth > 0) {
+		def = &idx->blocks[stack[--depth]];
+		for(i = 0; i < def->nchildren; i++) {
+			block = def->children[i];
+			if(block == DXFINDEX_NONE || needed[block]) continue;
+			needed[block] = 1;
+			stack[depth++] = block;
+		}
+	}
+}
+
+
+/* Read only the blocks inserted by the entities that are exported,
+   directly or through other blocks. needed and stack have room for
+   one more than all blocks, needed is all 0. */
+static int IndexedBlocks(DxfContext *ctx, DxfInput *in, DxfIndex *idx,
+		const char *hidden, char *needed, unsigned long *stack)
+{
+	DxfIndexEntity entity;
+	unsigned long i, j, count = 0;
+	int rc;
+
+	if(DxfIndexRewind(idx) != 0) return -1;
+	while((rc = DxfIndexNext(idx, &entity)) > 0) {
+		if(entity.type == kw_INSERT && (entity.layer == DXFINDEX_NONE
+					|| !hidden[entity.layer])) {
+			NeedBlock(idx, needed, entity.block, stack);
+		}
+	}
+	/* neighbours are read together */
+	for(i = 0; rc == 0 && i < idx->nblocks; i = j) {
+		if(!needed[i]) {
+			j = i + 1;
+			continue;
+		}
+		for(j = i + 1; j < idx->nblocks && needed[j]
+				&& idx->blocks[j].start == idx->blocks[j-1].end; j++) {
+			;
+		}
+		ReadRange(ctx, in, idx->blocks[i].start, idx->blocks[j-1].end,
+				idx->blocks[i].line, ReadBlockRange);
+		count += j - i;
+	}
+	if(ctx->Options.verbose > 1) {
+		fprintf(stderr, "    Read %lu of %lu blocks\n",
+				count, idx->nblocks);
+	}
+	return rc;
+}
+
+
+/* Read the exported entities of section, in runs of neighbours */
+static int IndexedEntities(DxfContext *ctx, DxfInput *in, DxfIndex *idx,
+		const char *hidden, DxfIndexSection *section)
+{
+	DxfIndexEntity entity;
+	long start = -1;
+	unsigned long count = 0, total = 0;
+	int line = 0, rc;
+
+	if(DxfIndexRewind(idx) != 0) return -1;
+	while((rc = DxfIndexNext(idx, &entity)) > 0) {
+		if(entity.start < section->start || entity.start >= section->endsec) {
+			continue;
+		}
+		total++;
+		if(entity.layer != DXFINDEX_NONE && hidden[entity.layer]) {
+			if(start >= 0) {
+				ReadRange(ctx, in, start, entity.start, line,
+						ReadEntityRange);
+				start = -1;
+			}
+			continue;
+		}
+		if(start < 0) {
+			start = entity.start;
+			line = entity.line;
+		}
+		count++;
+	}
+	if(rc == 0 && start >= 0) {
+		ReadRange(ctx, in, start, section->endsec, line, ReadEntityRange);
+	}
+	if(ctx->Options.verbose > 1) {
+		fprintf(stderr, "    Read %lu of %lu entities\n", count, total);
+	}
+	return rc;
+}
+
+
+/* Convert the sections of a drawing in memory with the help of its
+   index. Only the sections we need are read, and of those only the
+   blocks that are inserted and the entities on exported layers.
+   Without hidden layers, the ENTITIES section is read as usual,
+   possibly in several processes, otherwise the runs of exported
+   entities are converted here, as if there was only one. hidden has
+   room for one more than all layers, needed and stack see
+   IndexedBlocks(). */
+static int IndexedSections(DxfContext *ctx, DxfInput *in, DxfIndex *idx,
+		char *hidden, char *needed, unsigned long *stack)
+{
+	DxfIndexSection *section;
+	char layer[MAXSTRING];
+	unsigned long i, j;
+	int status = 0, anyhidden = 0, havehidden = 0, geom;
+
+	geom = ctx->Options.geom && ctx->outf != NULL;
+	for(i = 0; i < idx->nsections && status == 0; i++) {
+		section = &idx->sections[i];
+		switch(section->keyword) {
+		case kw_HEADER:
+		case kw_TABLES:
+			ReadRange(ctx, in, section->start, section->end, section->line,
+					ReadSections);
+			break;
+		case kw_BLOCKS:
+		case kw_ENTITIES:
+			if(!geom) break;
+			if(!havehidden) { /* the tables are read by now */
+				for(j = 0; j < idx->nlayers; j++) {
+					LayerName(ctx, idx->layers[j].name,
+							strlen(idx->layers[j].name), layer);
+					hidden[j] = (char)LayerHidden(ctx, layer);
+					if(hidden[j]) anyhidden = 1;
+				}
+				havehidden = 1;
+			}
+			if(section->keyword == kw_BLOCKS) {
+				if(ctx->Options.verbose > 0) {
+					fprintf(stderr, "  Reading blocks\n");
+				}
+				status = IndexedBlocks(ctx, in, idx, hidden, needed, stack);
+			} else if(anyhidden) {
+				if(ctx->Options.verbose > 0) {
+					fprintf(stderr, "  Reading entities\n");
+				}
+				if(ctx->Options.freeblocks) {
+					ReadRange(ctx, in, section->start, section->end,
+							section->line, CountBlockReferences);
+				}
+				status = IndexedEntities(ctx, in, idx, hidden, section);
+			} else {
+				ReadRange(ctx, in, section->start, section->end,
+						section->line, ReadSections);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return status;
+}
+
+
+/* The arrays are allocated here, so that they are freed on failure */
+int DxfConvertIndexed(DxfContext *ctx, DxfInput *in, DxfIndex *idx,
+		const char *name, FILE *out)
+{
+	jmp_buf failure;
+	char *hidden, *needed;
+	unsigned long *stack;
+	int status;
+
+	ctx->outf = out;
+	ctx->Inputname = name;
+	hidden = (char*)calloc(idx->nlayers + 1, 1);
+	needed = (char*)calloc(idx->nblocks + 1, 1);
+	stack = (unsigned long*)malloc((idx->nblocks + 1) * sizeof(unsigned long));
+	if(hidden == NULL || needed == NULL || stack == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		status = -1;
+	} else if(setjmp(failure) == 0) {
+		ctx->Failure = &failure;
+		status = IndexedSections(ctx, in, idx, hidden, needed, stack);
+		if(status != 0) {
+			fprintf(stderr, "Error reading the index of file \"%s\"\n",
+					name);
+		}
+	} else {
+		status = -1;
+	}
+	ctx->Failure = NULL;
+	ctx->infp = NULL;
+	free(stack);
+	free(needed);
+	free(hidden);
+	return status;
+}
+
+
+int DxfConvertFile(DxfContext *ctx, const char *path, FILE *out)
+{
+	DxfInput *in;
+	int status;
+
+	errno = 0;
+	in = DxfOpen(path);
+	if(in == NULL) return -1;
+	status = DxfConvertInput(ctx, in, path, out);
+	DxfClose(in);
+	return status;
+}
+
+
+int DxfConvertBuffer(DxfContext *ctx, const char *buf, size_t len,
+		FILE *out)
+{
+	DxfInput *in;
+	int status;
+
+	errno = 0;
+	in = DxfOpenBuffer(buf, len);
+	if(in == NULL) return -1;
+	status = DxfConvertInput(ctx, in, "<buffer>", out);
+	DxfClose(in);
+	return status;
+}
@@ -0,0 +1,132 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/* dxfconv.h - the converter as a library.
+ * All state of a conversion lives in a DxfContext, so several
+ * drawings can be converted at the same time, eg. in threads.
+ * A context converts one drawing. Create a new one for each.
+ */
+#ifndef _DXFCONV_H
+#define _DXFCONV_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <setjmp.h>
+
+#include "readdxf.h"
+#include "convert.h"
+#include "tables.h"
+
+struct _DxfContext {
+	Options_Type  Options;   /* the strings are owned by the caller */
+	DxfInput      *infp;
+	FILE          *outf;
+	const char    *Inputname; /* for messages */
+	jmp_buf       *Failure;  /* where DxfFail() returns to */
+
+	/* reader state */
+	Group_Type    Group;     /* A group : Code and value  */
+	Text_Type     Text;      /* A line of text  */
+	View_Type     View;      /* A view  */
+	Vertex_Type   Vertex;    /* A vertex  */
+	Line_Type     Line;      /* A line  */
+	Arc_Type      Arc;       /* An arc  */
+	Circle_Type   Circle;    /* A circle/cylinder  */
+	Point_Type    Point;     /* A point (sphere)  */
+	Face3D_Type   Face3D;    /* A 3D face  */
+	Trace_Type    Trace;     /* A Trace or 2D-Solid  */
+	PolyLine_Type PolyLine;  /* A polygon/polyface mesh  */
+	Block_Type    Block;     /* A block  */
+	Insert_Type   Insert;    /* An insert  */
+	int           Hidden;    /* the entity read is on a hidden layer */
+
+	/* polyline vertex data, grown when needed, freed with the context */
+	size_t        mesh_size;
+	Point3        *Mesh;     /* vertices  */
+	double        *Bulges;   /* bulge per vertex   */
+	size_t        faces_size;
+	xface         *Faces;    /* faces (3 or 4 vertices each)  */
+	unsigned int  *VCount;   /* vertice count per face  */
+	size_t        normals_size;
+	Point3        *Normals;  /* vertice normals  */
+
+	/* converter state */
+	int           id_index;
+	long          ExpandPos;     /* flattening: size of the blocks so far */
+	long          ExpandFrom;    /* only write blocks starting in here */
+	long          ExpandTo;
+	Matrix4       ScaleMatrix;
+	GeomArena     Scratch;       /* geometry of the entity converted */
+	unsigned long BlockBytes;    /* memory of the block geometry */
+	unsigned long BlockPeak;     /* the most of it at one time */
+	unsigned long BlockTotal;    /* all of it read so far */
+	Acadvars_Type Acadvars;
+
+	/* tables */
+	NameTable     BlockTable;
+	NameTable     LayerTable;
+	NameTable     RawLayerTable; /* group 8 values -> LayerTable names */
+	NameTable     BlockFiles;    /* instancing: file names in use */
+	NameTable     ShownLayers;   /* -L: only export these layers */
+	NameTable     HiddenLayers;  /* -X, frozen and off: not these */
+	BlockDef      *CurrentBlockDef;
+	char          *Layer0;
+};
+
+extern DxfContext *DxfContextNew(const Options_Type *options);
+extern void DxfContextFree(DxfContext *ctx);
+
+/* Convert a drawing, writing the geometry to out (may be NULL if
+   Options.geom is off). Return 0, or -1 if the input was incomplete
+   or couldn't be opened (errno tells then), or if the conversion
+   failed, after telling why on stderr. A context that failed can
+   only be freed. */
+extern int DxfConvertInput(DxfContext *ctx, DxfInput *in,
+		const char *name, FILE *out);
+extern int DxfConvertFile(DxfContext *ctx, const char *path, FILE *out);
+/* The same for a drawing that was opened with its index */
+struct _DxfIndex;
+extern int DxfConvertIndexed(DxfContext *ctx, DxfInput *in,
+		struct _DxfIndex *idx, const char *name, FILE *out);
+extern int DxfConvertBuffer(DxfContext *ctx, const char *buf, size_t len,
+		FILE *out);
+
+/* For the converter: give up on the drawing, after telling why if msg
+   isn't NULL. Returns to ctx->Failure, set by the entry points above
+   and by whoever has to clean up on the way. */
+extern void DxfFail(DxfContext *ctx, const char *msg);
+/* Fail if reading in stopped at a line that was too long */
+extern void DxfCheckInput(DxfContext *ctx, DxfInput *in);
+
+#ifdef __cplusplus
+	}
+#endif
+#endif /* _DXFCONV_H */
@@ -0,0 +1,804 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#define _FILE_OFFSET_BITS 64
+#if !defined(NO_MMAP)
+#define HAVE_MMAP
+#endif
+#if !defined(NO_THREADS) && !defined(NO_ZLIB)
+#define HAVE_ZLIB
+#endif
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <pthread.h>
+#include <zlib.h>
+#endif
+
+#include "dxfin.h"
+
+
+static void DxfFill(DxfInput *in, size_t need);
+
+#ifdef HAVE_ZLIB
+/* Compressed input is inflated by a thread of its own into a ring
+   buffer, from where DxfFill() picks it up. */
+struct _DxfInflater {
+	FILE *fp;           /* the compressed stream, or */
+	const char *src;    /* the mapped compressed file */
+	size_t srcleft;
+	z_stream zs;
+	unsigned char *inbuf;
+	int ended;          /* a gzip member ended, maybe followed by more */
+	char *ring;
+	size_t head, count; /* the inflated bytes not taken yet */
+	int done;           /* no more will come */
+	int stop;           /* DxfClose() wants us to finish */
+	const char *error;  /* why we stopped early */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+};
+
+/* size of the ring, and of the compressed pieces read */
+#define DXFIN_RINGSIZE (2*DXFIN_BUFSIZE)
+#define DXFIN_INBUFSIZE (256L*1024L)
+/* don't make the reader wait for more than this at a time */
+#define DXFIN_INFLATESTEP (256L*1024L)
+
+
+/* Get the next piece of compressed input. Returns 0 at the end. */
+static size_t
+DxfInflateInput(struct _DxfInflater *inf)
+{
+	size_t n;
+
+	if(inf->fp != NULL) {
+		n = fread(inf->inbuf, 1, DXFIN_INBUFSIZE, inf->fp);
+		if(n == 0 && ferror(inf->fp)) inf->error = "read error";
+		inf->zs.next_in = inf->inbuf;
+	} else {
+		n = inf->srcleft < 0x40000000L ? inf->srcleft : 0x40000000L;
+		inf->zs.next_in = (unsigned char*)inf->src;
+		inf->src += n;
+		inf->srcleft -= n;
+	}
+	inf->zs.avail_in = (uInt)n;
+	return n;
+}
+
+
+static void *
+DxfInflateThread(void *arg)
+{
+	struct _DxfInflater *inf = (struct _DxfInflater*)arg;
+	size_t tail, room;
+	int status, stop;
+
+	for(;;) {
+		if(inf->zs.avail_in == 0 && DxfInflateInput(inf) == 0) {
+			if(!inf->ended && inf->error == NULL) {
+				inf->error = "unexpected end of file";
+			}
+			break;
+		}
+		pthread_mutex_lock(&inf->lock);
+		while(inf->count == DXFIN_RINGSIZE && !inf->stop) {
+			pthread_cond_wait(&inf->cond, &inf->lock);
+		}
+		tail = (inf->head + inf->count) % DXFIN_RINGSIZE;
+		room = DXFIN_RINGSIZE - inf->count;
+		stop = inf->stop;
+		pthread_mutex_unlock(&inf->lock);
+		if(stop) break;
+		if(room > DXFIN_RINGSIZE - tail) room = DXFIN_RINGSIZE - tail;
+		if(room > DXFIN_INFLATESTEP) room = DXFIN_INFLATESTEP;
+
+		inf->zs.next_out = (unsigned char*)inf->ring + tail;
+		inf->zs.avail_out = (uInt)room;
+		status = inflate(&inf->zs, Z_NO_FLUSH);
+		if(status == Z_STREAM_END) {
+			/* concatenated members are fine */
+			inf->ended = 1;
+			inflateReset(&inf->zs);
+		} else if(status == Z_DATA_ERROR && inf->ended) {
+			break; /* trailing garbage, as gzip ignores it */
+		} else if(status != Z_OK && status != Z_BUF_ERROR) {
+			inf->error = inf->zs.msg ? inf->zs.msg : "corrupt data";
+			break;
+		} else if(room != inf->zs.avail_out) {
+			inf->ended = 0;
+		}
+
+		pthread_mutex_lock(&inf->lock);
+		inf->count += room - inf->zs.avail_out;
+		pthread_cond_broadcast(&inf->cond);
+		pthread_mutex_unlock(&inf->lock);
+	}
+	pthread_mutex_lock(&inf->lock);
+	inf->done = 1;
+	pthread_cond_broadcast(&inf->cond);
+	pthread_mutex_unlock(&inf->lock);
+	return NULL;
+}
+
+
+/* Read up to n inflated bytes, like fread() */
+static size_t
+DxfInflateRead(DxfInput *in, char *dest, size_t n)
+{
+	struct _DxfInflater *inf = in->inflater;
+	size_t got = 0, take;
+
+	while(got < n) {
+		pthread_mutex_lock(&inf->lock);
+		while(inf->count == 0 && !inf->done) {
+			pthread_cond_wait(&inf->cond, &inf->lock);
+		}
+		take = inf->count;
+		pthread_mutex_unlock(&inf->lock);
+		if(take == 0) {
+			if(inf->error != NULL) {
+				fprintf(stderr, "Error decompressing the input: %s\n",
+						inf->error);
+				inf->error = NULL;
+			}
+			break;
+		}
+		/* the ring from head on is ours until we count it off */
+		if(take > n - got) take = n - got;
+		if(take > DXFIN_RINGSIZE - inf->head) {
+			take = DXFIN_RINGSIZE - inf->head;
+		}
+		memcpy(dest + got, inf->ring + inf->head, take);
+		got += take;
+
+		pthread_mutex_lock(&inf->lock);
+		inf->head = (inf->head + take) % DXFIN_RINGSIZE;
+		inf->count -= take;
+		pthread_cond_broadcast(&inf->cond);
+		pthread_mutex_unlock(&inf->lock);
+	}
+	return got;
+}
+
+
+static void
+DxfInflaterFree(struct _DxfInflater *inf)
+{
+	if(inf->inbuf != NULL) free(inf->inbuf);
+	if(inf->ring != NULL) free(inf->ring);
+	free(inf);
+}
+
+
+/* Stop the thread and let go of everything */
+static void
+DxfInflateStop(DxfInput *in)
+{
+	struct _DxfInflater *inf = in->inflater;
+
+	pthread_mutex_lock(&inf->lock);
+	inf->stop = 1;
+	pthread_cond_broadcast(&inf->cond);
+	pthread_mutex_unlock(&inf->lock);
+	pthread_join(inf->thread, NULL);
+	(void)inflateEnd(&inf->zs);
+	pthread_cond_destroy(&inf->cond);
+	pthread_mutex_destroy(&inf->lock);
+	DxfInflaterFree(inf);
+	in->inflater = NULL;
+}
+
+
+/* Read a gzip compressed input through an inflater thread.
+   The bytes read so far are the start of the compressed data.
+   Returns -1 if that isn't possible. */
+static int
+DxfInflateStart(DxfInput *in)
+{
+	struct _DxfInflater *inf;
+	size_t have = (size_t)(in->end - in->pos);
+
+	inf = (struct _DxfInflater*)calloc(1, sizeof(struct _DxfInflater));
+	if(inf == NULL) return -1;
+	inf->ring = (char*)malloc(DXFIN_RINGSIZE);
+	inf->inbuf = (unsigned char*)malloc(DXFIN_INBUFSIZE > have
+			? DXFIN_INBUFSIZE : have);
+	if(in->buf == NULL) {
+		in->buf = (char*)malloc(DXFIN_BUFSIZE);
+		in->bufsize = DXFIN_BUFSIZE;
+	}
+	if(inf->ring == NULL || inf->inbuf == NULL || in->buf == NULL) {
+		DxfInflaterFree(inf);
+		return -1;
+	}
+	if(in->fp != NULL) {
+		/* what is buffered already comes first */
+		inf->fp = in->fp;
+		memcpy(inf->inbuf, in->pos, have);
+		inf->zs.next_in = inf->inbuf;
+		inf->zs.avail_in = (uInt)have;
+	} else {
+		inf->src = in->pos;
+		inf->srcleft = have;
+	}
+	/* 32 more window bits to expect a gzip or zlib header */
+	if(inflateInit2(&inf->zs, 15 + 32) != Z_OK) {
+		DxfInflaterFree(inf);
+		return -1;
+	}
+	pthread_mutex_init(&inf->lock, NULL);
+	pthread_cond_init(&inf->cond, NULL);
+	if(pthread_create(&inf->thread, NULL, DxfInflateThread, inf) != 0) {
+		(void)inflateEnd(&inf->zs);
+		pthread_cond_destroy(&inf->cond);
+		pthread_mutex_destroy(&inf->lock);
+		DxfInflaterFree(inf);
+		return -1;
+	}
+	in->inflater = inf;
+	in->pos = in->end = in->buf;
+	in->streameof = 0;
+	return 0;
+}
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_MMAP
+/* Map a regular file as a whole. Anything else (pipes, devices,
+   empty files, files too big for our address space) returns NULL,
+   and the caller falls back to buffered reading. */
+static DxfInput *
+DxfOpenMapped(const char *path)
+{
+	DxfInput *in;
+	struct stat st;
+	void *map;
+	int fd;
+
+	/* don't open a named pipe here, that would lose the writer */
+	if(stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return NULL;
+	fd = open(path, O_RDONLY);
+	if(fd < 0) return NULL;
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0
+			|| (off_t)(size_t)st.st_size != st.st_size) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return NULL;
+	(void)posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	in = (DxfInput*)calloc(1, sizeof(DxfInput));
+	if(in == NULL) {
+		munmap(map, (size_t)st.st_size);
+		return NULL;
+	}
+	in->map = (char*)map;
+	in->maplen = (size_t)st.st_size;
+	in->pos = in->map;
+	in->end = in->map + in->maplen;
+	in->streameof = 1;
+	return in;
+}
+#endif /* HAVE_MMAP */
+
+
+/* Check for gzip compressed data, and read it through an inflater.
+   Returns -1 if it is compressed and we can't. */
+static int
+DxfCheckCompressed(DxfInput *in)
+{
+	const unsigned char *p;
+
+	if(in->fp != NULL) DxfFill(in, 2);
+	p = (const unsigned char*)in->pos;
+	if((size_t)(in->end - in->pos) < 2 || p[0] != 0x1f || p[1] != 0x8b) {
+		return 0;
+	}
+#ifdef HAVE_ZLIB
+	if(DxfInflateStart(in) == 0) return 0;
+#endif
+	return -1;
+}
+
+
+/* Check for the binary sentinel and skip it.
+   Release 12 binary files have 1 byte group codes, later ones 2 bytes.
+   The first group is always (0, "SECTION"), which tells them apart. */
+static void
+DxfCheckBinary(DxfInput *in)
+{
+	const unsigned char *p;
+
+	if(!DxfInMemory(in)) DxfFill(in, DXF_BINARY_SENTINEL_LEN + 2);
+	if((size_t)(in->end - in->pos) < DXF_BINARY_SENTINEL_LEN + 2
+			|| memcmp(in->pos, DXF_BINARY_SENTINEL,
+				DXF_BINARY_SENTINEL_LEN) != 0) {
+		return;
+	}
+	in->pos += DXF_BINARY_SENTINEL_LEN;
+	p = (const unsigned char*)in->pos;
+	in->binary = (p[0] == 0 && p[1] != 0) ? 1 : 2;
+}
+
+
+DxfInput *
+DxfOpen(const char *path)
+{
+	DxfInput *in = NULL;
+	FILE *fp;
+
+#ifdef HAVE_MMAP
+	in = DxfOpenMapped(path);
+	if(in != NULL) {
+		if(DxfCheckCompressed(in) != 0) {
+			DxfClose(in);
+			errno = EINVAL;
+			return NULL;
+		}
+		DxfCheckBinary(in);
+		return in;
+	}
+#endif
+	errno = 0;
+	fp = fopen(path, "rb");
+	if(fp == NULL) return NULL;
+	in = DxfOpenStream(fp);
+	if(in == NULL) fclose(fp);
+	return in;
+}
+
+
+DxfInput *
+DxfOpenStream(FILE *fp)
+{
+	DxfInput *in;
+
+	in = (DxfInput*)calloc(1, sizeof(DxfInput));
+	if(in == NULL) return NULL;
+	in->buf = (char*)malloc(DXFIN_BUFSIZE);
+	if(in->buf == NULL) {
+		free(in);
+		return NULL;
+	}
+	in->bufsize = DXFIN_BUFSIZE;
+	in->fp = fp;
+	in->pos = in->end = in->buf;
+	if(DxfCheckCompressed(in) != 0) {
+		in->fp = NULL; /* the caller still owns it */
+		DxfClose(in);
+		errno = EINVAL;
+		return NULL;
+	}
+	DxfCheckBinary(in);
+	return in;
+}
+
+
+/* Read from a buffer owned by the caller, which must stay valid
+   until DxfClose(). */
+DxfInput *
+DxfOpenBuffer(const char *buf, size_t len)
+{
+	DxfInput *in;
+
+	in = (DxfInput*)calloc(1, sizeof(DxfInput));
+	if(in == NULL) return NULL;
+	in->pos = buf;
+	in->end = buf + len;
+	in->streameof = 1;
+	DxfCheckBinary(in);
+	return in;
+}
+
+
+/* Make view read the memory from start up to end, which holds a part
+   of in, or bytes captured from it. The memory must stay valid as
+   long as the view is read. A view owns nothing, it is not closed
+   and may live on the stack. */
+void
+DxfInitRange(DxfInput *view, DxfInput *in, const char *start,
+		const char *end)
+{
+	memset(view, 0, sizeof(DxfInput));
+	view->pos = start;
+	view->end = end;
+	view->streameof = 1;
+	view->binary = in->binary;
+}
+
+
+/* Capture the bytes read from here on. Inputs in memory are
+   captured in place, buffered ones are copied to in->cap. */
+void
+DxfCaptureStart(DxfInput *in)
+{
+	in->mark = in->pos;
+	in->caplen = 0;
+	in->capfail = 0;
+}
+
+
+/* Append the bytes from the mark up to pos to in->cap */
+static void
+DxfCaptureSave(DxfInput *in)
+{
+	size_t n = (size_t)(in->pos - in->mark), size;
+	char *cap;
+
+	if(DxfInMemory(in) || n == 0) return;
+	if(in->caplen + n > in->capsize) {
+		size = in->capsize ? in->capsize : DXFIN_BUFSIZE / 4;
+		while(size < in->caplen + n) size *= 2;
+		cap = (char*)realloc(in->cap, size);
+		if(cap == NULL) {
+			in->capfail = 1;
+			in->mark = in->pos;
+			return;
+		}
+		in->cap = cap;
+		in->capsize = size;
+	}
+	memcpy(in->cap + in->caplen, in->mark, n);
+	in->caplen += n;
+	in->mark = in->pos;
+}
+
+
+/* The number of bytes captured so far */
+size_t
+DxfCaptureLength(DxfInput *in)
+{
+	return in->caplen + (size_t)(in->pos - in->mark);
+}
+
+
+/* The bytes captured so far, DxfCaptureLength() of them, valid until
+   the next read. NULL if we ran out of memory. */
+const char *
+DxfCaptured(DxfInput *in)
+{
+	if(DxfInMemory(in)) return in->mark;
+	DxfCaptureSave(in);
+	return in->capfail ? NULL : in->cap;
+}
+
+
+/* Forget the first n captured bytes, after DxfCaptured() */
+void
+DxfCaptureDrop(DxfInput *in, size_t n)
+{
+	if(DxfInMemory(in)) {
+		in->mark += n;
+		return;
+	}
+	if(n > in->caplen) n = in->caplen;
+	memmove(in->cap, in->cap + n, in->caplen - n);
+	in->caplen -= n;
+}
+
+
+void
+DxfCaptureStop(DxfInput *in)
+{
+	if(in->cap != NULL) free(in->cap);
+	in->cap = NULL;
+	in->mark = NULL;
+	in->caplen = in->capsize = 0;
+}
+
+
+void
+DxfClose(DxfInput *in)
+{
+	if(in == NULL) return;
+#ifdef HAVE_ZLIB
+	if(in->inflater != NULL) DxfInflateStop(in);
+#endif
+	if(in->cap != NULL) free(in->cap);
+#ifdef HAVE_MMAP
+	if(in->map != NULL) munmap(in->map, in->maplen);
+#endif
+	if(in->fp != NULL) fclose(in->fp);
+	if(in->buf != NULL) free(in->buf);
+	free(in);
+}
+
+
+/* Make sure that at least need bytes are buffered, unless the
+   stream runs out first. Unread data moves to the buffer start. */
+static void
+DxfFill(DxfInput *in, size_t need)
+{
+	size_t have, got;
+
+	have = (size_t)(in->end - in->pos);
+	if(in->streameof || have >= need) return;
+	if(in->mark != NULL) { /* the read bytes are going away */
+		DxfCaptureSave(in);
+		in->mark = in->buf;
+	}
+	memmove(in->buf, in->pos, have);
+#ifdef HAVE_ZLIB
+	if(in->inflater != NULL) {
+		got = DxfInflateRead(in, in->buf + have, in->bufsize - have);
+	} else
+#endif
+	got = fread(in->buf + have, 1, in->bufsize - have, in->fp);
+	if(got == 0) in->streameof = 1;
+	in->pos = in->buf;
+	in->end = in->buf + have + got;
+}
+
+
+/* Get the next line, accepting \n, \r\n, and \r as terminators.
+   The line is returned in place without its terminator, and stays
+   valid until the next call.
+   Returns 1 for a complete line, 0 if the line was cut after
+   maxlen characters (the rest stays unread), and -1 at the end of
+   input. As with getc(), eof is flagged as soon as we had to look
+   past the last byte, even if a line was returned. */
+int
+DxfGetLine(DxfInput *in, size_t maxlen, const char **line, size_t *len)
+{
+	const char *cp, *lim;
+
+	if(!DxfInMemory(in) && (size_t)(in->end - in->pos) <= maxlen) {
+		DxfFill(in, maxlen + 1);
+	}
+	cp = in->pos;
+	if(cp >= in->end) {
+		in->eof = 1;
+		*line = cp;
+		*len = 0;
+		return -1;
+	}
+	lim = in->end;
+	if((size_t)(lim - cp) > maxlen) lim = cp + maxlen;
+	while(cp < lim && *cp != '\n' && *cp != '\r') cp++;
+	*line = in->pos;
+	*len = (size_t)(cp - in->pos);
+	if(cp == in->end) {  /* unterminated last line */
+		in->pos = cp;
+		in->eof = 1;
+		return 1;
+	}
+	if(cp == lim) {  /* too long */
+		in->pos = cp;
+		return 0;
+	}
+	/* DOS or Apple file. A '\r' as the last byte doesn't run into
+	   the end: the line is complete. */
+	if(*cp++ == '\r' && cp < in->end && *cp == '\n') cp++;
+	in->pos = cp;
+	return 1;
+}
+
+
+/* Get the next 0-terminated string of a binary file, in place.
+   Returns like DxfGetLine(). */
+int
+DxfGetString(DxfInput *in, size_t maxlen, const char **str, size_t *len)
+{
+	const char *cp, *lim;
+
+	if(!DxfInMemory(in) && (size_t)(in->end - in->pos) <= maxlen) {
+		DxfFill(in, maxlen + 1);
+	}
+	cp = in->pos;
+	*str = cp;
+	*len = 0;
+	if(cp >= in->end) {
+		in->eof = 1;
+		return -1;
+	}
+	lim = in->end;
+	if((size_t)(lim - cp) > maxlen) lim = cp + maxlen;
+	while(cp < lim && *cp != '\0') cp++;
+	*len = (size_t)(cp - in->pos);
+	if(cp == in->end) {  /* unterminated */
+		in->pos = cp;
+		in->eof = 1;
+		return 1;
+	}
+	in->pos = cp;
+	if(cp == lim) return 0;  /* too long */
+	in->pos++;
+	return 1;
+}
+
+
+/* Get the next n bytes (not more than DXFIN_BUFSIZE), in place.
+   Returns 0, or -1 if the input ends before. */
+int
+DxfGetBytes(DxfInput *in, size_t n, const unsigned char **data)
+{
+	if(!DxfInMemory(in) && (size_t)(in->end - in->pos) < n) {
+		DxfFill(in, n);
+	}
+	if((size_t)(in->end - in->pos) < n) {
+		in->pos = in->end;
+		in->eof = 1;
+		return -1;
+	}
+	*data = (const unsigned char*)in->pos;
+	in->pos += n;
+	return 0;
+}
+
+
+/* Skipping ahead. The windows searched at a time, and how much of
+   the end of a window is searched again in the next one. */
+#define DXFIN_SKIPWINDOW DXFIN_BUFSIZE
+#define DXFIN_SKIPKEEP (2*4096L + 64L)
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\v' || (c) == '\f')
+#define IS_EOL(c) ((c) == '\n' || (c) == '\r')
+
+/* The number of lines from p up to end, which is at a line start */
+static long
+DxfCountLines(const char *p, const char *end)
+{
+	const char *cp;
+	long n = 0;
+
+	for(cp = p; (cp = memchr(cp, '\n', (size_t)(end - cp))) != NULL; cp++) {
+		n++;
+	}
+	/* and Apple style line ends, if any */
+	for(cp = p; (cp = memchr(cp, '\r', (size_t)(end - cp))) != NULL; cp++) {
+		if(cp + 1 == end || cp[1] != '\n') n++;
+	}
+	return n;
+}
+
+
+/* Is there a group with the value line from v to e, which is the
+   rest of the line? Returns the start of its code line, or NULL.
+   start is at the start of a line. */
+static const char *
+DxfGroupStart(const char *start, const char *v, const char *e,
+		const char *end, int final)
+{
+	const char *cp;
+
+	while(e < end && IS_BLANK(*e)) e++;
+	if(e == end ? !final : !IS_EOL(*e)) return NULL;
+	/* the code line in front, blanks and digits only */
+	if(v == start || !IS_EOL(v[-1])) return NULL;
+	cp = v - 1;
+	if(*cp == '\n' && cp > start && cp[-1] == '\r') cp--;
+	while(cp > start && (IS_BLANK(cp[-1]) || (cp[-1] >= '0' && cp[-1] <= '9'))) {
+		cp--;
+	}
+	if(cp > start && (cp[-1] == '-' || cp[-1] == '+')) cp--;
+	while(cp > start && IS_BLANK(cp[-1])) cp--;
+	if(cp > start && !IS_EOL(cp[-1])) return NULL;
+	return cp;
+}
+
+
+/* Find the first group from start up to end with one of values.
+   Returns the start of its code line, or NULL. */
+static const char *
+DxfFindGroup(const char *start, const char *end,
+		const char *const *values, int final)
+{
+	const char *best = NULL, *cp, *found;
+	const char *const *vp, *const *wp;
+	size_t len;
+
+	/* one memchr() pass for each first character, up to the best yet */
+	for(vp = values; *vp != NULL; vp++) {
+		for(wp = values; wp < vp && (*wp)[0] != (*vp)[0]; wp++);
+		if(wp < vp) continue; /* had that one */
+		cp = start;
+		while(cp < (best ? best : end)
+				&& (cp = memchr(cp, (*vp)[0], (size_t)((best ? best : end)
+						- cp))) != NULL) {
+			for(wp = vp; *wp != NULL; wp++) {
+				len = strlen(*wp);
+				if((*wp)[0] != *cp || (size_t)(end - cp) < len
+						|| memcmp(cp, *wp, len) != 0) {
+					continue;
+				}
+				found = DxfGroupStart(start, cp, cp + len, end, final);
+				if(found != NULL) {
+					best = found;
+					break;
+				}
+			}
+			if(*wp != NULL) break;
+			cp++;
+		}
+	}
+	return best;
+}
+
+
+/* Skip ahead in a text file to the next group with one of values
+   (a NULL terminated list), without reading the groups in between.
+   The group is left unread, and the lines skipped are added to
+   *lines. Returns 0 if there is one, or -1 at the end of input, with
+   everything skipped. Binary files can't be skipped like this, they
+   return 1 and must be read as usual. */
+int
+DxfSkipTo(DxfInput *in, const char *const *values, long *lines)
+{
+	const char *lim, *found, *next;
+	int final;
+
+	if(in->binary) return 1;
+	for(;;) {
+		if(!DxfInMemory(in)) DxfFill(in, in->bufsize);
+		lim = in->end;
+		if(lim - in->pos > DXFIN_SKIPWINDOW) lim = in->pos + DXFIN_SKIPWINDOW;
+		final = lim == in->end && in->streameof;
+		found = DxfFindGroup(in->pos, lim, values, final);
+		if(found != NULL) {
+			*lines += DxfCountLines(in->pos, found);
+			in->pos = found;
+			return 0;
+		}
+		if(final) {
+			*lines += DxfCountLines(in->pos, in->end);
+			in->pos = in->end;
+			in->eof = 1;
+			return -1;
+		}
+		if(lim - in->pos <= DXFIN_SKIPKEEP) continue; /* read the rest */
+		/* go on from a line start near the end, so that a group cut
+		   off by the window is found in the next round */
+		next = lim - DXFIN_SKIPKEEP;
+		while(next > in->pos && !IS_EOL(next[-1])) next--;
+		if(next == in->pos) {
+			next = lim - DXFIN_SKIPKEEP; /* a line as long as the window? */
+		} else if(next[-1] == '\r' && *next == '\n') {
+			next++;
+		}
+		*lines += DxfCountLines(in->pos, next);
+		in->pos = next;
+	}
+}
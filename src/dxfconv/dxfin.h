@@ -0,0 +1,102 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* dxfin.h - raw input for the DXF reader.
+ * The whole file is memory mapped where possible, otherwise it is
+ * read through a large buffer. Lines are handed out as pointers
+ * into that memory, without copying.
+ * A buffer in memory can be read the same way.
+ * Binary DXF files are recognized by their sentinel, which is skipped.
+ * The raw bytes read can be captured, to be read again later.
+ * Gzip compressed files are inflated on the fly by a thread.
+ * Text files can be searched for groups we are interested in,
+ * skipping those in between.
+ */
+#ifndef _DXFIN_H
+#define _DXFIN_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+/* read buffer size for inputs that can't be mapped */
+#define DXFIN_BUFSIZE (4L*1024L*1024L)
+
+/* the start of a binary DXF file, including the trailing 0 byte */
+#define DXF_BINARY_SENTINEL "AutoCAD Binary DXF\r\n\032"
+#define DXF_BINARY_SENTINEL_LEN 22
+
+typedef struct {
+	FILE *fp;          /* buffered stream, NULL if in memory */
+	struct _DxfInflater *inflater; /* reads compressed fp or map */
+	char *map;         /* file mapping, NULL if buffered */
+	size_t maplen;
+	char *buf;         /* read buffer */
+	size_t bufsize;
+	const char *pos;   /* next unread byte */
+	const char *end;   /* end of valid data */
+	int streameof;     /* nothing more to read from fp */
+	int eof;           /* a read ran into the end of input */
+	int bad;           /* stopped at a group code line too long */
+	int binary;        /* binary file: size of the group codes, else 0 */
+	const char *mark;  /* capture: start of the bytes not in cap yet */
+	char *cap;         /* captured bytes, if buffered */
+	size_t caplen;
+	size_t capsize;
+	int capfail;       /* out of memory while capturing */
+} DxfInput;
+
+#define DxfEof(in) ((in)->eof)
+#define DxfBad(in) ((in)->bad)
+/* all of the input is in memory (mapped, or a buffer) */
+#define DxfInMemory(in) ((in)->fp == NULL && (in)->inflater == NULL)
+
+extern DxfInput *DxfOpen(const char *path);
+extern DxfInput *DxfOpenStream(FILE *fp);
+extern DxfInput *DxfOpenBuffer(const char *buf, size_t len);
+extern void DxfInitRange(DxfInput *view, DxfInput *in,
+		const char *start, const char *end);
+extern void DxfCaptureStart(DxfInput *in);
+extern size_t DxfCaptureLength(DxfInput *in);
+extern const char *DxfCaptured(DxfInput *in);
+extern void DxfCaptureDrop(DxfInput *in, size_t n);
+extern void DxfCaptureStop(DxfInput *in);
+extern void DxfClose(DxfInput *in);
+extern int DxfGetLine(DxfInput *in, size_t maxlen,
+		const char **line, size_t *len);
+extern int DxfGetString(DxfInput *in, size_t maxlen,
+		const char **str, size_t *len);
+extern int DxfGetBytes(DxfInput *in, size_t n, const unsigned char **data);
+extern int DxfSkipTo(DxfInput *in, const char *const *values, long *lines);
+
+#ifdef __cplusplus
+	}
+#endif
+#endif /* _DXFIN_H */
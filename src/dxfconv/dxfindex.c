@@ -0,0 +1,784 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/* dxfindex.c - write and read the sidecar index of a DXF file.
+ * All numbers are little endian, offsets and handles with 8 bytes,
+ * everything else with 4. A header is followed by the entity
+ * records, which are read one at a time while converting, and by
+ * the tables of sections, layers and blocks, which are read as a
+ * whole. The offsets count from the start of the drawing.
+ */
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "dxfconv.h"
+#include "dxfindex.h"
+
+
+#define HEADER_SIZE 64
+#define ENTITY_SIZE 32
+#define SECTION_SIZE 32
+/* longer names in an index are taken as damage */
+#define MAXNAME 65536L
+
+
+static void PutU32(unsigned char *p, unsigned long v)
+{
+	p[0] = (unsigned char)(v & 0xff);
+	p[1] = (unsigned char)((v >> 8) & 0xff);
+	p[2] = (unsigned char)((v >> 16) & 0xff);
+	p[3] = (unsigned char)((v >> 24) & 0xff);
+}
+
+/* the high half is 0 where a long has 32 bits */
+static void PutU64(unsigned char *p, unsigned long v)
+{
+	PutU32(p, v & 0xffffffffUL);
+	PutU32(p + 4, (v >> 16) >> 16);
+}
+
+static unsigned long GetU32(const unsigned char *p)
+{
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8)
+		| ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static unsigned long GetU64(const unsigned char *p)
+{
+	return GetU32(p) | ((GetU32(p + 4) << 16) << 16);
+}
+
+
+/* The index of "dir/drawing.dxf" is "dir/drawing.dxfidx".
+   The caller frees the name. */
+char *DxfIndexPath(const char *path)
+{
+	const char *dot, *base;
+	char *idxpath;
+	size_t len;
+
+	base = strrchr(path, '/');
+	if(base == NULL) base = strrchr(path, '\\');
+	base = base ? base + 1 : path;
+	dot = strrchr(base, '.');
+	len = dot ? (size_t)(dot - path) : strlen(path);
+	idxpath = (char*)malloc(len + sizeof(DXFINDEX_SUFFIX));
+	if(idxpath == NULL) return NULL;
+	memcpy(idxpath, path, len);
+	strcpy(idxpath + len, DXFINDEX_SUFFIX);
+	return idxpath;
+}
+
+
+/* The modification time of the drawing, for the stamp */
+static int DrawingStamp(const char *path, unsigned long *size,
+		unsigned long *mtime)
+{
+	struct stat st;
+
+	if(stat(path, &st) != 0) return -1;
+	*size = (unsigned long)st.st_size;
+	*mtime = (unsigned long)st.st_mtime;
+	return 0;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Writing */
+
+typedef struct {
+	char *name;
+	unsigned long id;
+	unsigned long count;
+} BuildLayer;
+
+typedef struct {
+	DxfIndexBlock block;
+	unsigned long id;
+	size_t nnames;
+	size_t namessize;
+	char **names;      /* of the inserted blocks, resolved at the end */
+} BuildBlock;
+
+/* what the groups of the current entity are looked at for */
+#define H_NONE 0
+#define H_ENTITY 1  /* an entity in the ENTITIES section */
+#define H_BLOCK 2   /* a block header */
+#define H_INSERT 3  /* an insert in a block */
+
+typedef struct {
+	DxfInput *in;
+	FILE *fp;
+	Group_Type group;
+	DxfIndexSection *sections;
+	size_t nsections;
+	size_t sectionssize;
+	NameTable layertable;
+	BuildLayer **layers;
+	size_t nlayers;
+	size_t layerssize;
+	NameTable blocktable;
+	BuildBlock **blocks;
+	size_t nblocks;
+	size_t blockssize;
+	DxfIndexEntity entity;  /* not written yet */
+	int haveentity;
+	unsigned long nentities;
+	int failed;        /* out of memory or write error */
+} Builder;
+
+
+static char *CopyValue(const char *s, size_t len)
+{
+	char *copy;
+
+	copy = (char*)malloc(len + 1);
+	if(copy == NULL) return NULL;
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+
+/* Grow an array of n elements of size bytes to hold one more */
+static void *Grow(void *array, size_t n, size_t *allocated, size_t size)
+{
+	void *newarray;
+
+	if(n < *allocated) return array;
+	newarray = realloc(array, (*allocated ? *allocated * 2 : 16) * size);
+	if(newarray == NULL) return NULL;
+	*allocated = *allocated ? *allocated * 2 : 16;
+	return newarray;
+}
+
+
+static unsigned long LayerId(Builder *b, const char *value, size_t len)
+{
+	BuildLayer *layer, **layers;
+
+	layer = (BuildLayer*)NameTableGetN(&b->layertable, value, len);
+	if(layer != NULL) return layer->id;
+	layers = (BuildLayer**)Grow(b->layers, b->nlayers, &b->layerssize,
+			sizeof(BuildLayer*));
+	layer = (BuildLayer*)calloc(1, sizeof(BuildLayer));
+	if(layers == NULL || layer == NULL) {
+		if(layers != NULL) b->layers = layers;
+		free(layer);
+		b->failed = 1;
+		return DXFINDEX_NONE;
+	}
+	b->layers = layers;
+	layer->name = CopyValue(value, len);
+	if(layer->name == NULL
+			|| NameTableAdd(&b->layertable, layer->name, layer) != 0) {
+		free(layer->name);
+		free(layer);
+		b->failed = 1;
+		return DXFINDEX_NONE;
+	}
+	layer->id = (unsigned long)b->nlayers;
+	b->layers[b->nlayers++] = layer;
+	return layer->id;
+}
+
+
+static BuildBlock *NewBlock(Builder *b, long start, int line)
+{
+	BuildBlock *block, **blocks;
+
+	blocks = (BuildBlock**)Grow(b->blocks, b->nblocks, &b->blockssize,
+			sizeof(BuildBlock*));
+	if(blocks == NULL) {
+		b->failed = 1;
+		return NULL;
+	}
+	b->blocks = blocks;
+	block = (BuildBlock*)calloc(1, sizeof(BuildBlock));
+	if(block == NULL) {
+		b->failed = 1;
+		return NULL;
+	}
+	block->block.start = block->block.end = start;
+	block->block.line = line;
+	block->id = (unsigned long)b->nblocks;
+	b->blocks[b->nblocks++] = block;
+	return block;
+}
+
+
+static void BlockChild(Builder *b, BuildBlock *block,
+		const char *value, size_t len)
+{
+	char **names;
+
+	names = (char**)Grow(block->names, block->nnames, &block->namessize,
+			sizeof(char*));
+	if(names == NULL) {
+		b->failed = 1;
+		return;
+	}
+	block->names = names;
+	block->names[block->nnames] = CopyValue(value, len);
+	if(block->names[block->nnames] == NULL) b->failed = 1;
+	else block->nnames++;
+}
+
+
+static unsigned long ParseHandle(const char *s, size_t len)
+{
+	unsigned long h = 0;
+	int d;
+
+	while(len-- > 0) {
+		if(*s >= '0' && *s <= '9') d = *s - '0';
+		else if(*s >= 'A' && *s <= 'F') d = *s - 'A' + 10;
+		else if(*s >= 'a' && *s <= 'f') d = *s - 'a' + 10;
+		else break;
+		h = (h << 4) | (unsigned long)d;
+		s++;
+	}
+	return h;
+}
+
+
+static void FlushEntity(Builder *b)
+{
+	unsigned char rec[ENTITY_SIZE];
+	DxfIndexEntity *e = &b->entity;
+
+	if(!b->haveentity) return;
+	b->haveentity = 0;
+	if(e->layer != DXFINDEX_NONE) b->layers[e->layer]->count++;
+	PutU64(rec, (unsigned long)e->start);
+	PutU64(rec + 8, e->handle);
+	PutU32(rec + 16, (unsigned long)e->line);
+	PutU32(rec + 20, e->layer);
+	PutU32(rec + 24, e->block);
+	PutU32(rec + 28, (unsigned long)e->type);
+	if(fwrite(rec, ENTITY_SIZE, 1, b->fp) != 1) b->failed = 1;
+	b->nentities++;
+}
+
+
+/* Read the whole drawing, writing the entity records as we go.
+   Returns 0, or -1 if the drawing ended within a section, or at a
+   line that was too long. */
+static int ScanDrawing(Builder *b)
+{
+	DxfInput *in = b->in;
+	Group_Type *g = &b->group;
+	DxfIndexSection *section = NULL;
+	BuildBlock *block = NULL, *inserted;
+	int head = H_NONE, endblk = 0, named = 0, line;
+	long here;
+
+	for(;;) {
+		here = (long)(in->pos - in->map);
+		line = g->line;
+		if(next_group(in, g) != 0 || b->failed) break;
+		if(g->code != 0) {
+			if(section != NULL && !named && g->code == 2) {
+				section->keyword = g->keyword;
+				named = 1;
+			}
+			switch(head) {
+			case H_ENTITY:
+				if(g->code == 8 && b->entity.layer == DXFINDEX_NONE) {
+					b->entity.layer = LayerId(b, g->value, g->length);
+				} else if(g->code == 5) {
+					b->entity.handle = ParseHandle(g->value, g->length);
+				} else if(g->code == 2 && b->entity.type == kw_INSERT
+						&& b->entity.block == DXFINDEX_NONE) {
+					inserted = (BuildBlock*)NameTableGetN(&b->blocktable,
+							g->value, g->length);
+					if(inserted != NULL) b->entity.block = inserted->id;
+				}
+				break;
+			case H_BLOCK:
+				if(g->code == 2 && block != NULL && block->block.name == NULL) {
+					block->block.name = CopyValue(g->value, g->length);
+					if(block->block.name == NULL
+							|| NameTableAdd(&b->blocktable,
+								block->block.name, block) != 0) {
+						b->failed = 1;
+					}
+				}
+				break;
+			case H_INSERT:
+				if(g->code == 2 && block != NULL) {
+					BlockChild(b, block, g->value, g->length);
+					head = H_NONE;
+				}
+				break;
+			}
+			continue;
+		}
+
+		head = H_NONE;
+		if(section != NULL && section->keyword == kw_BLOCKS
+				&& block != NULL && endblk) {
+			block->block.end = here;
+			block = NULL;
+			endblk = 0;
+		}
+		if(g->keyword == kw_SECTION) {
+			FlushEntity(b);
+			section = (DxfIndexSection*)Grow(b->sections, b->nsections,
+					&b->sectionssize, sizeof(DxfIndexSection));
+			if(section == NULL) {
+				b->failed = 1;
+				break;
+			}
+			b->sections = section;
+			section = &b->sections[b->nsections++];
+			memset(section, 0, sizeof(DxfIndexSection));
+			section->keyword = kw_NONE;
+			section->start = here;
+			section->line = line;
+			named = 0;
+		} else if(g->keyword == kw_ENDSEC && section != NULL) {
+			FlushEntity(b);
+			section->endsec = here;
+			section->end = (long)(in->pos - in->map);
+			section = NULL;
+			block = NULL;
+		} else if(section == NULL) {
+			continue;
+		} else if(section->keyword == kw_BLOCKS) {
+			if(g->keyword == kw_BLOCK) {
+				block = NewBlock(b, here, line);
+				head = H_BLOCK;
+			} else if(g->keyword == kw_ENDBLK) {
+				endblk = 1;
+			} else if(g->keyword == kw_INSERT) {
+				head = H_INSERT;
+			}
+		} else if(section->keyword == kw_ENTITIES
+				&& g->keyword != kw_SEQEND
+				&& !group_is(g, "VERTEX") && !group_is(g, "ATTRIB")) {
+			FlushEntity(b);
+			b->entity.start = here;
+			b->entity.line = line;
+			b->entity.type = g->keyword;
+			b->entity.layer = DXFINDEX_NONE;
+			b->entity.block = DXFINDEX_NONE;
+			b->entity.handle = 0;
+			b->haveentity = 1;
+			head = H_ENTITY;
+		}
+	}
+	FlushEntity(b);
+	return section == NULL && !DxfBad(in) ? 0 : -1;
+}
+
+
+static int PutString(FILE *fp, const char *s)
+{
+	unsigned char len[4];
+	size_t n = s ? strlen(s) : 0;
+
+	PutU32(len, (unsigned long)n);
+	if(fwrite(len, 4, 1, fp) != 1) return -1;
+	if(n > 0 && fwrite(s, n, 1, fp) != 1) return -1;
+	return 0;
+}
+
+
+/* The tables behind the entity records */
+static int WriteTables(Builder *b)
+{
+	unsigned char buf[SECTION_SIZE];
+	DxfIndexSection *section;
+	BuildBlock *block, *child;
+	size_t i, j;
+
+	for(i = 0; i < b->nsections; i++) {
+		section = &b->sections[i];
+		PutU64(buf, (unsigned long)section->start);
+		PutU64(buf + 8, (unsigned long)section->endsec);
+		PutU64(buf + 16, (unsigned long)section->end);
+		PutU32(buf + 24, (unsigned long)section->line);
+		PutU32(buf + 28, (unsigned long)section->keyword);
+		if(fwrite(buf, SECTION_SIZE, 1, b->fp) != 1) return -1;
+	}
+	for(i = 0; i < b->nlayers; i++) {
+		PutU32(buf, b->layers[i]->count);
+		if(fwrite(buf, 4, 1, b->fp) != 1
+				|| PutString(b->fp, b->layers[i]->name) != 0) {
+			return -1;
+		}
+	}
+	for(i = 0; i < b->nblocks; i++) {
+		block = b->blocks[i];
+		PutU64(buf, (unsigned long)block->block.start);
+		PutU64(buf + 8, (unsigned long)block->block.end);
+		PutU32(buf + 16, (unsigned long)block->block.line);
+		PutU32(buf + 20, (unsigned long)block->nnames);
+		if(fwrite(buf, 24, 1, b->fp) != 1
+				|| PutString(b->fp, block->block.name) != 0) {
+			return -1;
+		}
+		/* blocks that don't exist are inserted as nothing */
+		for(j = 0; j < block->nnames; j++) {
+			child = (BuildBlock*)NameTableGet(&b->blocktable,
+					block->names[j]);
+			PutU32(buf, child ? child->id : DXFINDEX_NONE);
+			if(fwrite(buf, 4, 1, b->fp) != 1) return -1;
+		}
+	}
+	return 0;
+}
+
+
+static void FreeBuilder(Builder *b)
+{
+	size_t i, j;
+
+	for(i = 0; i < b->nlayers; i++) {
+		free(b->layers[i]->name);
+		free(b->layers[i]);
+	}
+	free(b->layers);
+	NameTableFree(&b->layertable);
+	for(i = 0; i < b->nblocks; i++) {
+		for(j = 0; j < b->blocks[i]->nnames; j++) {
+			free(b->blocks[i]->names[j]);
+		}
+		free(b->blocks[i]->names);
+		free(b->blocks[i]->block.name);
+		free(b->blocks[i]);
+	}
+	free(b->blocks);
+	NameTableFree(&b->blocktable);
+	free(b->sections);
+}
+
+
+/* Index the drawing in path. Only uncompressed drawings that can be
+   mapped into memory are indexed, as only those can be read from the
+   middle. Returns 0, or -1 after telling why not. */
+int DxfIndexWrite(const char *path, int verbose)
+{
+	Builder b;
+	char *idxpath;
+	unsigned char header[HEADER_SIZE];
+	unsigned long size, mtime;
+	long tables;
+	int status = -1, truncated = 0;
+
+	memset(&b, 0, sizeof(Builder));
+	errno = 0;
+	b.in = DxfOpen(path);
+	if(b.in == NULL) {
+		fprintf(stderr, "Can't open file '%s' for input (E%d: %s)\n",
+			path, errno, strerror(errno));
+		return -1;
+	}
+	if(b.in->map == NULL || b.in->inflater != NULL
+			|| DrawingStamp(path, &size, &mtime) != 0) {
+		fprintf(stderr, "Can't index '%s', only uncompressed"
+				" regular files can be indexed\n", path);
+		DxfClose(b.in);
+		return -1;
+	}
+	idxpath = DxfIndexPath(path);
+	if(idxpath == NULL || NameTableInit(&b.layertable) != 0
+			|| NameTableInit(&b.blocktable) != 0) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		DxfClose(b.in);
+		FreeBuilder(&b);
+		free(idxpath);
+		return -1;
+	}
+	errno = 0;
+	b.fp = fopen(idxpath, "wb");
+	if(b.fp == NULL) {
+		fprintf(stderr, "Can't open file '%s' for output (E%d: %s)\n",
+				idxpath, errno, strerror(errno));
+		DxfClose(b.in);
+		FreeBuilder(&b);
+		free(idxpath);
+		return -1;
+	}
+	if(verbose > 0) fprintf(stderr, "  Indexing %s\n", path);
+	errno = 0;
+
+	memset(header, 0, HEADER_SIZE);
+	if(fwrite(header, HEADER_SIZE, 1, b.fp) != 1) b.failed = 1;
+	if(!b.failed && ScanDrawing(&b) != 0 && !b.failed) {
+		if(!DxfBad(b.in)) {
+			fprintf(stderr, "Can't index '%s', unexpected end of file"
+					" (line %d)\n", path, b.group.line);
+		}
+		truncated = 1;
+	} else if(!b.failed && (tables = ftell(b.fp)) >= 0
+			&& WriteTables(&b) == 0) {
+		memcpy(header, DXFINDEX_MAGIC, DXFINDEX_MAGIC_LEN);
+		PutU64(header + 16, size);
+		PutU64(header + 24, mtime);
+		PutU64(header + 32, b.nentities);
+		PutU64(header + 40, (unsigned long)tables);
+		PutU32(header + 48, (unsigned long)b.nsections);
+		PutU32(header + 52, (unsigned long)b.nlayers);
+		PutU32(header + 56, (unsigned long)b.nblocks);
+		if(fseek(b.fp, 0L, SEEK_SET) == 0
+				&& fwrite(header, HEADER_SIZE, 1, b.fp) == 1) {
+			status = 0;
+		}
+	}
+	if(fclose(b.fp) != 0) status = -1;
+	if(status == 0 && verbose > 0) {
+		fprintf(stderr, "    %lu entities on %lu layers, %lu blocks\n",
+				b.nentities, (unsigned long)b.nlayers,
+				(unsigned long)b.nblocks);
+	}
+	if(status != 0) {
+		if(!truncated) {
+			fprintf(stderr, "Error writing file '%s' (E%d: %s)\n",
+					idxpath, errno, strerror(errno));
+		}
+		(void)remove(idxpath);
+	}
+	DxfClose(b.in);
+	FreeBuilder(&b);
+	free(idxpath);
+	return status;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Reading */
+
+static char *GetString(FILE *fp)
+{
+	unsigned char buf[4];
+	unsigned long len;
+	char *s;
+
+	if(fread(buf, 4, 1, fp) != 1) return NULL;
+	len = GetU32(buf);
+	if(len > MAXNAME) return NULL;
+	s = (char*)malloc(len + 1);
+	if(s == NULL) return NULL;
+	if(len > 0 && fread(s, len, 1, fp) != 1) {
+		free(s);
+		return NULL;
+	}
+	s[len] = '\0';
+	return s;
+}
+
+
+/* Everything but the entities. The offsets must be in the drawing. */
+static int ReadTables(DxfIndex *idx)
+{
+	unsigned char buf[SECTION_SIZE];
+	DxfIndexSection *section;
+	DxfIndexBlock *block;
+	unsigned long i, j;
+
+	for(i = 0; i < idx->nsections; i++) {
+		section = &idx->sections[i];
+		if(fread(buf, SECTION_SIZE, 1, idx->fp) != 1) return -1;
+		section->start = (long)GetU64(buf);
+		section->endsec = (long)GetU64(buf + 8);
+		section->end = (long)GetU64(buf + 16);
+		section->line = (int)GetU32(buf + 24);
+		section->keyword = (int)GetU32(buf + 28);
+		if(section->start < 0 || section->start > section->endsec
+				|| section->endsec > section->end
+				|| (unsigned long)section->end > idx->size) {
+			return -1;
+		}
+	}
+	for(i = 0; i < idx->nlayers; i++) {
+		if(fread(buf, 4, 1, idx->fp) != 1) return -1;
+		idx->layers[i].count = GetU32(buf);
+		idx->layers[i].name = GetString(idx->fp);
+		if(idx->layers[i].name == NULL) return -1;
+	}
+	for(i = 0; i < idx->nblocks; i++) {
+		block = &idx->blocks[i];
+		if(fread(buf, 24, 1, idx->fp) != 1) return -1;
+		block->start = (long)GetU64(buf);
+		block->end = (long)GetU64(buf + 8);
+		block->line = (int)GetU32(buf + 16);
+		block->nchildren = GetU32(buf + 20);
+		block->name = GetString(idx->fp);
+		if(block->name == NULL || block->start < 0
+				|| block->start > block->end
+				|| (unsigned long)block->end > idx->size
+				|| block->nchildren > idx->size) {
+			return -1;
+		}
+		if(block->nchildren == 0) continue;
+		block->children = (unsigned long*)malloc(
+				block->nchildren * sizeof(unsigned long));
+		if(block->children == NULL) return -1;
+		for(j = 0; j < block->nchildren; j++) {
+			if(fread(buf, 4, 1, idx->fp) != 1) return -1;
+			block->children[j] = GetU32(buf);
+			if(block->children[j] >= idx->nblocks
+					&& block->children[j] != DXFINDEX_NONE) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+/* Open the index of the drawing in path, which is read through in.
+   Returns NULL if there is none, if it doesn't match the drawing
+   any more, or if the drawing isn't in memory, so it can't be
+   read from the middle. */
+DxfIndex *DxfIndexOpen(const char *path, DxfInput *in, int verbose)
+{
+	DxfIndex *idx;
+	FILE *fp;
+	char *idxpath;
+	unsigned char header[HEADER_SIZE];
+	unsigned long size, mtime;
+
+	if(in->map == NULL || in->inflater != NULL) return NULL;
+	idxpath = DxfIndexPath(path);
+	if(idxpath == NULL) return NULL;
+	fp = fopen(idxpath, "rb");
+	if(fp == NULL) {
+		free(idxpath);
+		return NULL;
+	}
+	idx = (DxfIndex*)calloc(1, sizeof(DxfIndex));
+	if(idx == NULL) {
+		fclose(fp);
+		free(idxpath);
+		return NULL;
+	}
+	idx->fp = fp;
+	if(fread(header, HEADER_SIZE, 1, fp) != 1
+			|| memcmp(header, DXFINDEX_MAGIC, DXFINDEX_MAGIC_LEN) != 0
+			|| DrawingStamp(path, &size, &mtime) != 0
+			|| GetU64(header + 16) != size || GetU64(header + 24) != mtime
+			|| size != (unsigned long)in->maplen) {
+		fprintf(stderr, "Index file '%s' is out of date, not used\n",
+				idxpath);
+		DxfIndexClose(idx);
+		free(idxpath);
+		return NULL;
+	}
+	idx->size = size;
+	idx->nentities = GetU64(header + 32);
+	idx->nsections = GetU32(header + 48);
+	idx->nlayers = GetU32(header + 52);
+	idx->nblocks = GetU32(header + 56);
+	if(idx->nsections > size || idx->nlayers > size || idx->nblocks > size
+			|| (idx->sections = (DxfIndexSection*)calloc(idx->nsections + 1,
+					sizeof(DxfIndexSection))) == NULL
+			|| (idx->layers = (DxfIndexLayer*)calloc(idx->nlayers + 1,
+					sizeof(DxfIndexLayer))) == NULL
+			|| (idx->blocks = (DxfIndexBlock*)calloc(idx->nblocks + 1,
+					sizeof(DxfIndexBlock))) == NULL
+			|| fseek(fp, (long)GetU64(header + 40), SEEK_SET) != 0
+			|| ReadTables(idx) != 0 || DxfIndexRewind(idx) != 0) {
+		fprintf(stderr, "Index file '%s' is damaged, not used\n", idxpath);
+		DxfIndexClose(idx);
+		free(idxpath);
+		return NULL;
+	}
+	if(verbose > 0) fprintf(stderr, "  Using index file %s\n", idxpath);
+	free(idxpath);
+	return idx;
+}
+
+
+/* Go back to the first entity */
+int DxfIndexRewind(DxfIndex *idx)
+{
+	idx->next = 0;
+	return fseek(idx->fp, (long)HEADER_SIZE, SEEK_SET);
+}
+
+
+/* Read the next entity. Returns 1, 0 after the last one, or -1 if
+   the index is damaged. */
+int DxfIndexNext(DxfIndex *idx, DxfIndexEntity *entity)
+{
+	unsigned char rec[ENTITY_SIZE];
+
+	if(idx->next >= idx->nentities) return 0;
+	if(fread(rec, ENTITY_SIZE, 1, idx->fp) != 1) return -1;
+	idx->next++;
+	entity->start = (long)GetU64(rec);
+	entity->handle = GetU64(rec + 8);
+	entity->line = (int)GetU32(rec + 16);
+	entity->layer = GetU32(rec + 20);
+	entity->block = GetU32(rec + 24);
+	entity->type = (int)GetU32(rec + 28);
+	if(entity->start < 0 || (unsigned long)entity->start >= idx->size
+			|| (entity->layer >= idx->nlayers
+				&& entity->layer != DXFINDEX_NONE)
+			|| (entity->block >= idx->nblocks
+				&& entity->block != DXFINDEX_NONE)) {
+		return -1;
+	}
+	return 1;
+}
+
+
+void DxfIndexClose(DxfIndex *idx)
+{
+	unsigned long i;
+
+	if(idx == NULL) return;
+	if(idx->fp != NULL) fclose(idx->fp);
+	if(idx->layers != NULL) {
+		for(i = 0; i < idx->nlayers; i++) free(idx->layers[i].name);
+		free(idx->layers);
+	}
+	if(idx->blocks != NULL) {
+		for(i = 0; i < idx->nblocks; i++) {
+			free(idx->blocks[i].name);
+			free(idx->blocks[i].children);
+		}
+		free(idx->blocks);
+	}
+	free(idx->sections);
+	free(idx);
+}
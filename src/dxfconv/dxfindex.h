@@ -0,0 +1,114 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/* dxfindex.h - a sidecar index of a DXF file.
+ * The index tells where the sections, the block definitions and the
+ * entities of a drawing are, with the type, layer and handle of each
+ * entity and the number of entities on each layer. It is stamped
+ * with the size and modification time of the drawing, and only used
+ * while they still match.
+ * With the drawing in memory, the converter can then read just the
+ * parts it needs.
+ */
+#ifndef _DXFINDEX_H
+#define _DXFINDEX_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+#include "dxfin.h"
+
+/* "drawing.dxf" is indexed in "drawing.dxfidx" */
+#define DXFINDEX_SUFFIX ".dxfidx"
+/* the start of an index file, with the version of its format */
+#define DXFINDEX_MAGIC "dxf2rad index 1\n"
+#define DXFINDEX_MAGIC_LEN 16
+/* no layer or block */
+#define DXFINDEX_NONE 0xffffffffUL
+
+typedef struct {
+	int keyword;          /* KeywordType of the section */
+	long start;           /* the (0, SECTION) group */
+	long endsec;          /* the (0, ENDSEC) group */
+	long end;             /* behind the ENDSEC group */
+	int line;             /* lines in front of start */
+} DxfIndexSection;
+
+typedef struct {
+	char *name;           /* as in group 8 */
+	unsigned long count;  /* entities in the ENTITIES section */
+} DxfIndexLayer;
+
+typedef struct {
+	char *name;
+	long start;           /* the (0, BLOCK) group */
+	long end;             /* behind the ENDBLK entity */
+	int line;
+	unsigned long nchildren;
+	unsigned long *children;  /* the blocks inserted in this one */
+} DxfIndexBlock;
+
+/* An entity of the ENTITIES section. Vertices, attributes and the
+   SEQEND belong to the entity in front of them. */
+typedef struct {
+	long start;           /* the (0, type) group */
+	int line;
+	int type;             /* KeywordType, kw_NONE if unknown */
+	unsigned long layer;  /* index into the layers, or DXFINDEX_NONE */
+	unsigned long block;  /* for inserts, or DXFINDEX_NONE */
+	unsigned long handle;
+} DxfIndexEntity;
+
+typedef struct _DxfIndex {
+	FILE *fp;             /* reads the entities */
+	unsigned long size;   /* of the drawing */
+	unsigned long nentities;
+	unsigned long next;   /* entities read */
+	unsigned long nsections;
+	DxfIndexSection *sections;
+	unsigned long nlayers;
+	DxfIndexLayer *layers;
+	unsigned long nblocks;
+	DxfIndexBlock *blocks;
+} DxfIndex;
+
+extern char *DxfIndexPath(const char *path);
+extern int DxfIndexWrite(const char *path, int verbose);
+extern DxfIndex *DxfIndexOpen(const char *path, DxfInput *in, int verbose);
+extern int DxfIndexRewind(DxfIndex *idx);
+extern int DxfIndexNext(DxfIndex *idx, DxfIndexEntity *entity);
+extern void DxfIndexClose(DxfIndex *idx);
+
+#ifdef __cplusplus
+	}
+#endif
+#endif /* _DXFINDEX_H */
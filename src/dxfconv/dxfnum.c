@@ -0,0 +1,161 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dxfnum.h"
+
+/* Both atof() and atoi() skip the same white space as isspace() */
+#define IS_SPACE(c) ((c)==' '||(c)=='\t'||(c)=='\n'||(c)=='\v'||(c)=='\f'||(c)=='\r')
+#define IS_DIGIT(c) ((c)>='0'&&(c)<='9')
+
+/* Longest value we hand to the library functions, as MAXLINE */
+#define NUMBUF 4096
+
+/* The fast path below relies on every multiplication and division
+   being rounded once to double precision. Compilers evaluating in
+   extended precision (x87) would round twice, so they don't get it. */
+#if defined(__FLT_EVAL_METHOD__) && (__FLT_EVAL_METHOD__ != 0)
+#define NO_FAST_ATOF
+#endif
+
+/* mantissas below this are exact in a double */
+#define MANT_LIMIT 9007199254740992.0  /* 2^53 */
+
+/* all of those are exact in a double */
+const double dxf_pow10tab[DXF_MAX_POW10 + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+	1e21, 1e22
+};
+
+
+static double
+slow_atof(const char *s, size_t len)
+{
+	char buf[NUMBUF];
+
+	if(len >= sizeof(buf)) len = sizeof(buf) - 1;
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	return atof(buf);
+}
+
+
+/* Convert a decimal number like atof().
+   The usual DXF number has at most 16 significant digits and a small
+   exponent. Then both the collected digits and the power of ten are
+   exact doubles, and a single multiplication or division gives the
+   correctly rounded result (Clinger's fast path). Anything else
+   (more digits, big exponents, hex, inf, nan) goes to the library. */
+double
+dxf_atof(const char *s, size_t len)
+{
+#ifdef NO_FAST_ATOF
+	return slow_atof(s, len);
+#else
+	const char *cp = s, *end = s + len;
+	double mant = 0.0;
+	int neg = 0, ndigits = 0, exp10 = 0, e, eneg;
+
+	while(cp < end && IS_SPACE(*cp)) cp++;
+	if(cp < end && (*cp == '-' || *cp == '+')) {
+		neg = (*cp++ == '-');
+	}
+	if(cp + 1 < end && cp[0] == '0' && (cp[1] == 'x' || cp[1] == 'X')) {
+		return slow_atof(s, len);
+	}
+	for(; cp < end && IS_DIGIT(*cp); cp++, ndigits++) {
+		mant = mant * 10.0 + (*cp - '0');
+		if(mant >= MANT_LIMIT) return slow_atof(s, len);
+	}
+	if(cp < end && *cp == '.') {
+		for(cp++; cp < end && IS_DIGIT(*cp); cp++, ndigits++) {
+			mant = mant * 10.0 + (*cp - '0');
+			if(mant >= MANT_LIMIT) return slow_atof(s, len);
+			exp10--;
+		}
+	}
+	if(ndigits == 0) return slow_atof(s, len); /* nothing, or inf/nan */
+	if(cp < end && (*cp == 'e' || *cp == 'E')) {
+		const char *ep = cp + 1;
+		eneg = 0;
+		if(ep < end && (*ep == '-' || *ep == '+')) {
+			eneg = (*ep++ == '-');
+		}
+		if(ep < end && IS_DIGIT(*ep)) { /* else "e" isn't part of it */
+			for(e = 0; ep < end && IS_DIGIT(*ep); ep++) {
+				e = e * 10 + (*ep - '0');
+				if(e > 9999) return slow_atof(s, len);
+			}
+			exp10 += eneg ? -e : e;
+		}
+	}
+	if(mant != 0.0) {
+		if(exp10 < -DXF_MAX_POW10 || exp10 > DXF_MAX_POW10) {
+			return slow_atof(s, len);
+		}
+		if(exp10 < 0) mant /= dxf_pow10tab[-exp10];
+		else if(exp10 > 0) mant *= dxf_pow10tab[exp10];
+	}
+	return neg ? -mant : mant;
+#endif /* NO_FAST_ATOF */
+}
+
+
+/* Convert a decimal integer like atoi().
+   Nine digits can't overflow, longer numbers go to the library
+   to get its overflow behaviour. */
+int
+dxf_atoi(const char *s, size_t len)
+{
+	const char *cp = s, *end = s + len;
+	int val = 0, neg = 0, ndigits;
+
+	while(cp < end && IS_SPACE(*cp)) cp++;
+	if(cp < end && (*cp == '-' || *cp == '+')) {
+		neg = (*cp++ == '-');
+	}
+	while(cp < end && *cp == '0') cp++;
+	for(ndigits = 0; cp < end && IS_DIGIT(*cp); cp++, ndigits++) {
+		if(ndigits == 9) {
+			char buf[NUMBUF];
+
+			if(len >= sizeof(buf)) len = sizeof(buf) - 1;
+			memcpy(buf, s, len);
+			buf[len] = '\0';
+			return atoi(buf);
+		}
+		val = val * 10 + (*cp - '0');
+	}
+	return neg ? -val : val;
+}
+
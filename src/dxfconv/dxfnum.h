@@ -0,0 +1,53 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* dxfnum.h - number conversion for group values.
+ * Works on counted strings, ignores the locale, and returns exactly
+ * what atof() and atoi() would return in the "C" locale.
+ */
+#ifndef _DXFNUM_H
+#define _DXFNUM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* The powers of ten from 1e0 to 1e22, which are exact as doubles.
+   The fast paths for reading and writing numbers rely on that. */
+#define DXF_MAX_POW10 22
+extern const double dxf_pow10tab[DXF_MAX_POW10 + 1];
+
+extern double dxf_atof(const char *s, size_t len);
+extern int dxf_atoi(const char *s, size_t len);
+
+#ifdef __cplusplus
+	}
+#endif
+#endif /* _DXFNUM_H */
@@ -0,0 +1,386 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+/* instance.c - write each block once, and insert it with !xform.
+ * The geometry of a block goes into up to two files: one for the
+ * fixed layers, and one for layer 0, which takes the layer of the
+ * insert with "xform -m". Nested inserts become !xform lines in
+ * the files of their container.
+ * Radiance can only mirror, scale uniformly, rotate and translate
+ * an instance, so inserts with other transforms are still flattened,
+ * at the top level by TransformInsertContents().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "geomtypes.h"
+#include "geomdefs.h"
+#include "geomproto.h"
+#include "dxfconv.h"
+#include "instance.h"
+#include "writerad.h"
+
+
+/* relative tolerance for a transform to count as a similarity */
+#define XFORM_EPS 1e-9
+
+#define INST_FIXED 1  /* there is a file for the fixed layers */
+#define INST_FLOAT 2  /* there is a file for layer 0 */
+#define INST_DONE  4  /* the files are written */
+#define INST_BUSY  8  /* the block is being written or flattened */
+
+
+/* Describe matrix as xform options, with a leading space.
+   Returns -1 if matrix isn't a similarity transform. */
+static int XformArgs(Matrix4 m, char *buf)
+{
+	double len[3], r[3][3], s, det, rx, ry, rz;
+	int i, j, mirror;
+
+	if(m[3][0] != 0.0 || m[3][1] != 0.0 || m[3][2] != 0.0
+			|| m[3][3] != 1.0) {
+		return -1;
+	}
+	for(j = 0; j < 3; j++) {
+		len[j] = sqrt(m[0][j]*m[0][j] + m[1][j]*m[1][j] + m[2][j]*m[2][j]);
+	}
+	s = len[0];
+	if(s <= 0.0 || fabs(len[1] - s) > XFORM_EPS * s
+			|| fabs(len[2] - s) > XFORM_EPS * s) {
+		return -1;
+	}
+	for(i = 0; i < 3; i++) {
+		j = (i + 1) % 3;
+		if(fabs(m[0][i]*m[0][j] + m[1][i]*m[1][j] + m[2][i]*m[2][j])
+				> XFORM_EPS * s * s) {
+			return -1;
+		}
+	}
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) r[i][j] = m[i][j] / s;
+	}
+	det = r[0][0] * (r[1][1]*r[2][2] - r[1][2]*r[2][1])
+		- r[0][1] * (r[1][0]*r[2][2] - r[1][2]*r[2][0])
+		+ r[0][2] * (r[1][0]*r[2][1] - r[1][1]*r[2][0]);
+	mirror = det < 0.0;
+	if(mirror) { /* xform mirrors first, so undo that: r * mz */
+		for(i = 0; i < 3; i++) r[i][2] = -r[i][2];
+	}
+	/* xform rotates about x, then y, then z: r = rz * ry * rx */
+	if(fabs(r[2][0]) < 1.0 - XFORM_EPS) {
+		ry = asin(-r[2][0]);
+		rx = atan2(r[2][1], r[2][2]);
+		rz = atan2(r[1][0], r[0][0]);
+	} else { /* gimbal lock, only rx + rz matters */
+		ry = r[2][0] < 0.0 ? M_PI/2.0 : -M_PI/2.0;
+		rx = 0.0;
+		rz = atan2(-r[0][1], r[1][1]);
+	}
+
+	*buf = '\0';
+	if(mirror) buf += sprintf(buf, " -mz");
+	if(fabs(s - 1.0) > XFORM_EPS) buf += sprintf(buf, " -s %.12g", s);
+	if(fabs(rx) > XFORM_EPS) buf += sprintf(buf, " -rx %.12g", rx/DEG2RAD);
+	if(fabs(ry) > XFORM_EPS) buf += sprintf(buf, " -ry %.12g", ry/DEG2RAD);
+	if(fabs(rz) > XFORM_EPS) buf += sprintf(buf, " -rz %.12g", rz/DEG2RAD);
+	if(m[0][3] != 0.0 || m[1][3] != 0.0 || m[2][3] != 0.0) {
+		sprintf(buf, " -t %.12g %.12g %.12g", m[0][3], m[1][3], m[2][3]);
+	}
+	return 0;
+}
+
+
+/* Choose file names for block that no other block uses */
+static int BlockFileNames(DxfContext *ctx, BlockDef *block)
+{
+	const char *prefix = ctx->Options.blockprefix;
+	char base[MAXSTRING], name[MAXSTRING];
+	size_t len;
+	int n;
+
+	if(prefix == NULL) prefix = "";
+	strncpy(name, block->name, sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+	RegulateName(name);
+	len = strlen(prefix) + strlen(name) + 24;
+	block->instfile = (char*)malloc(len);
+	block->instfile0 = (char*)malloc(len);
+	if(block->instfile == NULL || block->instfile0 == NULL) return -1;
+	for(n = 1; ; n++) {
+		if(n == 1) sprintf(base, "%.*s", MAXSTRING - 24, name);
+		else sprintf(base, "%.*s_%d", MAXSTRING - 24, name, n);
+		sprintf(block->instfile, "%s%s.rad", prefix, base);
+		sprintf(block->instfile0, "%s%s_0.rad", prefix, base);
+		if(NameTableGet(&ctx->BlockFiles, block->instfile) == NULL
+				&& NameTableGet(&ctx->BlockFiles, block->instfile0) == NULL) {
+			break;
+		}
+	}
+	if(NameTableAdd(&ctx->BlockFiles, block->instfile, block) != 0
+			|| NameTableAdd(&ctx->BlockFiles, block->instfile0, block) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Open one of the files of block when the first thing gets written */
+static FILE *BlockFile(DxfContext *ctx, BlockDef *block, FILE **fp,
+		const char *path)
+{
+	if(*fp != NULL) return *fp;
+	*fp = fopen(path, "w");
+	if(*fp == NULL) {
+		fprintf(stderr, "Can't open file '%s' for output\n", path);
+		DxfFail(ctx, NULL);
+	}
+	fprintf(*fp, "## Radiance geometry of block \"%s\"\n", block->name);
+	return *fp;
+}
+
+
+/* Write the polys and copies of the cyls of block, transformed by
+   matrix, to the files of owner. Geometry on layer 0 takes layer, and
+   goes to the layer 0 file if that is layer 0 as well. */
+static void WriteBlockGeometry(DxfContext *ctx, BlockDef *block,
+		Matrix4 matrix, char *layer, BlockDef *owner,
+		FILE **fixed, FILE **floating)
+{
+	Cyl3 *cyl, *nextcyl, *fixedcyls = NULL, *floatcyls = NULL;
+	long npolys = 0, nfloat = 0;
+
+	if(block->polybuf != NULL) {
+		npolys = block->polybuf->npolys;
+		if(layer == ctx->Layer0)
+			nfloat = PolyBufferCount(block->polybuf, ctx->Layer0);
+	}
+	/* open the files first, so that no copies are lost if that fails */
+	if(npolys > nfloat) (void)BlockFile(ctx, owner, fixed, owner->instfile);
+	if(nfloat > 0) (void)BlockFile(ctx, owner, floating, owner->instfile0);
+	for(cyl = block->cyls; cyl && (*fixed == NULL || *floating == NULL);
+			cyl = cyl->next) {
+		if(cyl->material != ctx->Layer0 || layer != ctx->Layer0) {
+			(void)BlockFile(ctx, owner, fixed, owner->instfile);
+		} else {
+			(void)BlockFile(ctx, owner, floating, owner->instfile0);
+		}
+	}
+	for(cyl = M4TransformCylsCopy(block->cyls, matrix); cyl;
+			cyl = nextcyl) {
+		nextcyl = cyl->next;
+		if(cyl->material != ctx->Layer0) {
+			cyl->next = fixedcyls;
+			fixedcyls = cyl;
+		} else if(layer != ctx->Layer0) {
+			cyl->material = layer;
+			cyl->next = fixedcyls;
+			fixedcyls = cyl;
+		} else {
+			cyl->next = floatcyls;
+			floatcyls = cyl;
+		}
+	}
+	/* WriteCyl() frees the copies */
+	if(npolys > nfloat) {
+		WritePolyBuffer(BlockFile(ctx, owner, fixed, owner->instfile),
+				ctx->id_index++, block->polybuf, matrix, ctx->Layer0, layer,
+				layer == ctx->Layer0 ? POLYS_FIXED : POLYS_ALL);
+	}
+	if(fixedcyls != NULL) {
+		WriteCyl(BlockFile(ctx, owner, fixed, owner->instfile), NULL,
+				ctx->id_index++, fixedcyls);
+	}
+	if(nfloat > 0) {
+		WritePolyBuffer(BlockFile(ctx, owner, floating, owner->instfile0),
+				ctx->id_index++, block->polybuf, matrix, ctx->Layer0, layer,
+				POLYS_FLOATING);
+	}
+	if(floatcyls != NULL) {
+		WriteCyl(BlockFile(ctx, owner, floating, owner->instfile0), NULL,
+				ctx->id_index++, floatcyls);
+	}
+}
+
+
+static int WriteBlock(DxfContext *ctx, BlockDef *block);
+
+/* Write the !xform references to the files of child into the files
+   of owner. Layer 0 of the child floats to layer, unless that is
+   layer 0 as well. */
+static void WriteReferences(DxfContext *ctx, BlockDef *child,
+		const char *args, char *layer, BlockDef *owner,
+		FILE **fixed, FILE **floating)
+{
+	if(child->instflags & INST_FIXED) {
+		fprintf(BlockFile(ctx, owner, fixed, owner->instfile),
+				"\n!xform%s %s\n", args, child->instfile);
+	}
+	if(child->instflags & INST_FLOAT) {
+		if(layer != ctx->Layer0) {
+			fprintf(BlockFile(ctx, owner, fixed, owner->instfile),
+					"\n!xform -m %s%s %s\n",
+					layer, args, child->instfile0);
+		} else {
+			fprintf(BlockFile(ctx, owner, floating, owner->instfile0),
+					"\n!xform%s %s\n", args, child->instfile0);
+		}
+	}
+}
+
+
+/* Write the inserts of block to the files of owner, transformed by
+   matrix. Each copy of a MINSERT array gets its own reference.
+   Inserts that can't be instanced are flattened. */
+static void WriteBlockInserts(DxfContext *ctx, BlockDef *block,
+		Matrix4 matrix, char *layer, BlockDef *owner,
+		FILE **fixed, FILE **floating)
+{
+	InsertDef *insert;
+	BlockDef *child;
+	Matrix4 composed;
+	char args[256], *childlayer;
+	int col, row;
+
+	for(insert = block->inserts; insert; insert = insert->next) {
+		child = insert->blockdef;
+		if(child->instflags & INST_BUSY) {
+			fprintf(stderr, "Recursive block reference detected.\n");
+			fprintf(stderr, "Skipping insert: %s - %s\n",
+					child->name, block->name);
+			continue;
+		}
+		childlayer = insert->layer != ctx->Layer0 ? insert->layer : layer;
+		for(row = 0; row < insert->rows; row++) {
+			for(col = 0; col < insert->cols; col++) {
+				GetInsertdefCellXForm(insert, col, row, composed);
+				M4MatMult(matrix, composed, composed);
+				if(XformArgs(composed, args) != 0) { /* flatten it */
+					child->instflags |= INST_BUSY;
+					WriteBlockGeometry(ctx, child, composed, childlayer,
+							owner, fixed, floating);
+					WriteBlockInserts(ctx, child, composed, childlayer,
+							owner, fixed, floating);
+					child->instflags &= ~INST_BUSY;
+					continue;
+				}
+				if(WriteBlock(ctx, child) != 0) continue;
+				WriteReferences(ctx, child, args, childlayer,
+						owner, fixed, floating);
+			}
+		}
+	}
+}
+
+
+/* Write the files of block, unless that was done already.
+   The primitives of a block count from 0, so that they don't
+   depend on when this happens.
+   Returns -1 if that wasn't possible. */
+static int WriteBlock(DxfContext *ctx, BlockDef *block)
+{
+	Matrix4 identity;
+	int saveid = ctx->id_index, rc;
+
+	if(block->instflags & INST_DONE) return 0;
+	if(BlockFileNames(ctx, block) != 0) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return -1;
+	}
+	if(ctx->Options.verbose > 1) {
+		fprintf(stderr, "    Writing block: %s\n", block->name);
+	}
+	block->instflags |= INST_BUSY;
+	ctx->id_index = 0;
+	M4SetIdentity(identity);
+	WriteBlockGeometry(ctx, block, identity, ctx->Layer0, block,
+			&block->instfp, &block->instfp0);
+	WriteBlockInserts(ctx, block, identity, ctx->Layer0, block,
+			&block->instfp, &block->instfp0);
+	ctx->id_index = saveid;
+	block->instflags = INST_DONE;
+	if(block->instfp != NULL) {
+		block->instflags |= INST_FIXED;
+		rc = fclose(block->instfp);
+		block->instfp = NULL;
+		if(rc != 0) {
+			fprintf(stderr, "Can't write file '%s'\n", block->instfile);
+			DxfFail(ctx, NULL);
+		}
+	}
+	if(block->instfp0 != NULL) {
+		block->instflags |= INST_FLOAT;
+		rc = fclose(block->instfp0);
+		block->instfp0 = NULL;
+		if(rc != 0) {
+			fprintf(stderr, "Can't write file '%s'\n", block->instfile0);
+			DxfFail(ctx, NULL);
+		}
+	}
+	return 0;
+}
+
+
+int InstanceBlock(DxfContext *ctx, InsertDef *insertdef)
+{
+	char args[256];
+
+	/* the copies of an array only differ in their translation */
+	GetInsertdefToWCS(ctx, insertdef, 0, 0);
+	if(XformArgs(insertdef->toworld, args) != 0) return -1;
+	return WriteBlock(ctx, insertdef->blockdef);
+}
+
+
+int InstanceInsert(DxfContext *ctx, InsertDef *insertdef)
+{
+	BlockDef *blockdef = insertdef->blockdef;
+	char args[256];
+	int col, row;
+
+	if(InstanceBlock(ctx, insertdef) != 0) return -1;
+
+	for(row = 0; row < insertdef->rows; row++) {
+		for(col = 0; col < insertdef->cols; col++) {
+			GetInsertdefToWCS(ctx, insertdef, col, row);
+			(void)XformArgs(insertdef->toworld, args);
+			if(blockdef->instflags & INST_FIXED) {
+				fprintf(ctx->outf, "\n!xform%s %s\n",
+						args, blockdef->instfile);
+			}
+			if(blockdef->instflags & INST_FLOAT) {
+				fprintf(ctx->outf, "\n!xform -m %s%s %s\n",
+						insertdef->layer, args, blockdef->instfile0);
+			}
+		}
+	}
+	return 0;
+}
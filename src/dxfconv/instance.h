@@ -0,0 +1,69 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+/* instance.h - write blocks once and insert them with !xform */
+#ifndef _INSTANCE_H
+#define _INSTANCE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _DXFCONTEXT_T
+#define _DXFCONTEXT_T
+typedef struct _DxfContext DxfContext;
+#endif
+
+/* The cached transforms of an insert, to its container and to
+   world coordinates (convert.c) */
+extern void GetInsertdefXForm(InsertDef *insertdef);
+extern void GetInsertdefCellXForm(InsertDef *insertdef, int col, int row,
+		Matrix4 matrix);
+extern void GetInsertdefToWCS(DxfContext *ctx, InsertDef *insertdef,
+		int col, int row);
+
+/* Write the contents of an insert, flattened (convert.c) */
+extern void TransformInsertContents(DxfContext *ctx, InsertDef *insertdef);
+
+/* Write an insert from the ENTITIES section as !xform references
+   to the files of its block, writing those first if necessary.
+   Returns -1 if the insert can't be instanced, and the caller
+   flattens it as usual. */
+extern int InstanceInsert(DxfContext *ctx, InsertDef *insertdef);
+
+/* Write the files of the block of an insert from the ENTITIES
+   section, if InstanceInsert() would refer to them, but nothing
+   else. Returns -1 if the insert can't be instanced. */
+extern int InstanceBlock(DxfContext *ctx, InsertDef *insertdef);
+
+#ifdef __cplusplus
+	}
+#endif
+#endif /* _INSTANCE_H */
@@ -0,0 +1,76 @@
+#!/bin/sh
+### jcheck.sh - check that -j doesn't change the output of dxf2rad.
+###
+### usage: jcheck.sh dxf2rad [file.dxf ...]
+###
+### Converts each file, and a generated drawing whose blocks have
+### names ending in ".<digits>", with and without "-j 4", also with
+### "+i", and compares all files written. Only the lines with the
+### date and the command line may differ.
+
+PROG=$1
+shift
+case $PROG in
+	/*) ;;
+	*) PROG=`pwd`/$PROG ;;
+esac
+TMP=${TMPDIR:-/tmp}/jcheck.$$
+trap 'rm -rf $TMP' 0 1 2 15
+mkdir $TMP $TMP/in || exit 1
+
+# enough inserts of BLK.0 to BLK.99 to be converted in several chunks
+awk 'BEGIN {
+	printf "  0\nSECTION\n  2\nBLOCKS\n"
+	for(b = 0; b < 100; b++) {
+		printf "  0\nBLOCK\n  8\n0\n  2\nBLK.%d\n 70\n0\n", b
+		printf " 10\n0.0\n 20\n0.0\n 30\n0.0\n"
+		printf "  0\n3DFACE\n  8\nB%d\n", b % 7
+		printf " 10\n0.0\n 20\n0.0\n 30\n0.0\n 11\n1.0\n 21\n0.0\n 31\n0.0\n"
+		printf " 12\n1.0\n 22\n%d.0\n 32\n0.0\n 13\n0.0\n 23\n1.0\n 33\n0.0\n",
+				b + 1
+		printf "  0\nENDBLK\n  8\n0\n"
+	}
+	printf "  0\nENDSEC\n  0\nSECTION\n  2\nENTITIES\n"
+	for(i = 0; i < 20000; i++) {
+		printf "  0\nINSERT\n  8\nL%d\n  2\nBLK.%d\n", i % 3, i % 100
+		printf " 10\n%d.0\n 20\n0.0\n 30\n0.0\n", i
+		printf "  0\n3DFACE\n  8\nF\n"
+		printf " 10\n%d.0\n 20\n0.0\n 30\n1.0\n 11\n%d.5\n 21\n0.0\n 31\n1.0\n", i, i
+		printf " 12\n%d.5\n 22\n1.0\n 32\n1.0\n 13\n%d.0\n 23\n1.0\n 33\n1.0\n", i, i
+	}
+	printf "  0\nENDSEC\n  0\nEOF\n"
+}' > $TMP/in/blkdot.dxf || exit 1
+
+status=0
+for f in $TMP/in/blkdot.dxf "$@"; do
+	case $f in
+		/*) ;;
+		*) f=`pwd`/$f ;;
+	esac
+	for opt in -i +i; do
+		rm -rf $TMP/s $TMP/j
+		mkdir $TMP/s $TMP/j
+		(cd $TMP/s; $PROG $opt "$f" out.rad) || status=1
+		(cd $TMP/j; $PROG $opt -j 4 "$f" out.rad) || status=1
+		for s in $TMP/s/*; do
+			b=`basename $s`
+			if [ ! -f $TMP/j/$b ]; then
+				echo "$f $opt: no $b with -j"
+				status=1
+				continue
+			fi
+			sed 2,3d $s > $TMP/s.cut
+			sed 2,3d $TMP/j/$b > $TMP/j.cut
+			if ! cmp -s $TMP/s.cut $TMP/j.cut; then
+				echo "$f $opt: $b differs with -j"
+				status=1
+			fi
+		done
+		if [ `ls $TMP/s | wc -l` -ne `ls $TMP/j | wc -l` ]; then
+			echo "$f $opt: -j writes other files"
+			status=1
+		fi
+	done
+done
+[ $status = 0 ] && echo "-j writes the same output"
+exit $status
@@ -0,0 +1,171 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+/***********************************************************************
+ * numtest.c -- Checks dxf_atof() and dxf_atoi() against the library
+ *      functions they replace. The results must be bit-identical.
+ *      Runs a set of edge cases and random numbers, and then every
+ *      line of the files given on the command line (eg. DXF files).
+ *
+ *      usage: numtest [file ...]
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dxfnum.h"
+
+static const char *cases[] = {
+	"", " ", "-", "+", ".", "-.", "e5", "0", "-0", "+0", "0.0", "-0.0",
+	"1", "-1", "1.", ".5", "-.5", "1e", "1e+", "1e-", "1e5", "1E5",
+	"1.5e-3", "  42", "\t-17.25", "12abc", "1.2.3", "1e5e5",
+	"0x10", "0X1p3", "-0x1.8p1", "inf", "-infinity", "nan", "NAN(123)",
+	"0.1", "0.2", "0.3", "0.7071067811865476", "0.70710678118654757",
+	"3.141592653589793", "3.14159265358979323846", "2.718281828459045",
+	"9007199254740991", "9007199254740992", "9007199254740993",
+	"1e22", "1e23", "1e-22", "1e-23", "123456789012345678901234567890",
+	"4.9406564584124654e-324", "2.2250738585072014e-308",
+	"1.7976931348623157e308", "1e309", "-1e309", "1e-400",
+	"0.000000000000000000000000000001", "100000000000000000000000",
+	"1.0000000000000000000000000001", "00000000000000000000000001.5",
+	"1.50000000000000000000000000000", "1e99999999999", "1e-99999999999",
+	"2147483647", "2147483648", "-2147483648", "-2147483649",
+	"99999999999999999999", "000000000000123", "+000000000", "-000012",
+	"123456789", "1234567890", "-1234567890", "12.7", "-12.7",
+	NULL
+};
+
+static long failures = 0;
+static long tested = 0;
+
+
+static void
+check(const char *s, size_t len)
+{
+	char buf[4096];
+	double d1, d2;
+	int i1, i2;
+
+	if(len >= sizeof(buf)) len = sizeof(buf) - 1;
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	d1 = atof(buf);
+	d2 = dxf_atof(s, len);
+	i1 = atoi(buf);
+	i2 = dxf_atoi(s, len);
+	tested++;
+	if(memcmp(&d1, &d2, sizeof(double)) != 0) {
+		failures++;
+		printf("atof(\"%s\"): %.17g, dxf_atof: %.17g\n", buf, d1, d2);
+	}
+	if(i1 != i2) {
+		failures++;
+		printf("atoi(\"%s\"): %d, dxf_atoi: %d\n", buf, i1, i2);
+	}
+}
+
+
+/* something that looks like a number in a DXF file */
+static void
+random_number(char *buf)
+{
+	char *cp = buf;
+	int i, n;
+
+	if(rand() % 3 == 0) *cp++ = '-';
+	n = rand() % 20;
+	for(i = 0; i < n; i++) *cp++ = (char)('0' + rand() % 10);
+	if(rand() % 4 != 0) {
+		*cp++ = '.';
+		n = rand() % 20;
+		for(i = 0; i < n; i++) *cp++ = (char)('0' + rand() % 10);
+	}
+	if(rand() % 5 == 0) {
+		cp += sprintf(cp, "e%d", rand() % 80 - 40);
+	}
+	*cp = '\0';
+}
+
+
+static void
+check_file(const char *name)
+{
+	char line[4096];
+	FILE *fp;
+	size_t len;
+
+	if((fp = fopen(name, "r")) == NULL) {
+		perror(name);
+		failures++;
+		return;
+	}
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		len = strlen(line);
+		while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
+			len--;
+		}
+		check(line, len);
+	}
+	fclose(fp);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	char buf[128];
+	double d;
+	long i;
+
+	for(i = 0; cases[i] != NULL; i++) {
+		check(cases[i], strlen(cases[i]));
+	}
+	/* the value must end where we say, not at the first non-digit */
+	check("12345", 3);
+	check("1.5e10", 4);
+	check("-0.25", 1);
+	srand(1);
+	for(i = 0; i < 1000000L; i++) {
+		random_number(buf);
+		check(buf, strlen(buf));
+	}
+	/* what printf() writes, as in files written by other programs */
+	for(i = 0; i < 1000000L; i++) {
+		d = ((double)rand() / RAND_MAX - 0.5) * 1e6;
+		sprintf(buf, (i & 1) ? "%.16g" : "%.6f", d);
+		check(buf, strlen(buf));
+	}
+	for(i = 1; i < argc; i++) {
+		check_file(argv[i]);
+	}
+	printf("%ld values tested, %ld failures\n", tested, failures);
+	return failures ? 1 : 0;
+}
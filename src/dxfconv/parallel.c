@@ -0,0 +1,473 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+/* parallel.c - convert the ENTITIES section in several processes.
+ * The section is cut into chunks in front of entities while it is
+ * read, and each chunk is converted by a child process into a
+ * temporary file.
+ * Each child works on its own copy of the DxfContext, which
+ * comes for free with fork(). The results are copied
+ * to the output in their original order, with the primitive ids
+ * renumbered to what a serial conversion would have produced.
+ * Big inserts are flattened the same way, each child writing the
+ * blocks in its part of the hierarchy.
+ */
+#if !defined(_WIN32) && !defined(NO_FORK)
+#define HAVE_FORK
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifdef HAVE_FORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "dxfconv.h"
+#include "instance.h"
+#include "parallel.h"
+#include "writerad.h"
+
+
+#ifdef HAVE_FORK
+
+typedef struct {
+	const char *start;  /* first group of the chunk */
+	const char *end;
+	int line;           /* line count in front of start */
+	InsertDef *insert;  /* or the insert to flatten */
+	long from, to;      /* and our part of its blocks */
+	FILE *out;          /* output with ids counting from 0 */
+	pid_t pid;
+} Chunk;
+
+/* Convert the entities from chunk->start to chunk->end into out,
+   starting with id firstid. Returns the next free id.
+   The reader state is left as it was. */
+static int
+ConvertChunk(DxfContext *ctx, Chunk *chunk, FILE *out, int firstid)
+{
+	DxfInput *saveinfp = ctx->infp, view;
+	FILE *saveoutf = ctx->outf;
+	Group_Type savegroup = ctx->Group;
+	int saveid = ctx->id_index;
+	int nextid;
+
+	DxfInitRange(&view, ctx->infp, chunk->start, chunk->end);
+	ctx->infp = &view;
+	ctx->outf = out;
+	ctx->id_index = firstid;
+	ctx->Group.line = chunk->line;
+	next_group(ctx->infp, &ctx->Group);
+	ReadEntities(ctx, kw_LAST); /* up to the end of the chunk */
+	nextid = ctx->id_index;
+
+	DxfCheckInput(ctx, &view);
+	ctx->infp = saveinfp;
+	ctx->outf = saveoutf;
+	ctx->Group = savegroup;
+	ctx->id_index = saveid;
+	return nextid;
+}
+
+
+/* Flatten the part of chunk->insert from chunk->from to chunk->to
+   into out, like ConvertChunk(). */
+static int
+ExpandChunk(DxfContext *ctx, Chunk *chunk, FILE *out, int firstid)
+{
+	FILE *saveoutf = ctx->outf;
+	int saveid = ctx->id_index;
+	int nextid;
+
+	ctx->outf = out;
+	ctx->id_index = firstid;
+	ctx->ExpandPos = 0;
+	ctx->ExpandFrom = chunk->from;
+	ctx->ExpandTo = chunk->to;
+	TransformInsertContents(ctx, chunk->insert);
+	nextid = ctx->id_index;
+
+	ctx->outf = saveoutf;
+	ctx->id_index = saveid;
+	ctx->ExpandPos = 0;
+	ctx->ExpandFrom = 0;
+	ctx->ExpandTo = LONG_MAX;
+	return nextid;
+}
+
+
+/* The child side: convert a chunk into chunk->out, which starts
+   with the number of ids used in a fixed width line. Returns 0, or
+   -1 if that failed, as a child must not return into our callers. */
+static int
+ConvertChunkChild(DxfContext *ctx, Chunk *chunk)
+{
+	jmp_buf failure, *outer = ctx->Failure;
+	int ids;
+
+	if(setjmp(failure) != 0) {
+		ctx->Failure = outer;
+		return -1;
+	}
+	ctx->Failure = &failure;
+	fprintf(chunk->out, "%11d\n", 0);
+	if(chunk->insert != NULL) ids = ExpandChunk(ctx, chunk, chunk->out, 0);
+	else ids = ConvertChunk(ctx, chunk, chunk->out, 0);
+	ctx->Failure = outer;
+	if(fseek(chunk->out, 0L, SEEK_SET) != 0) return -1;
+	fprintf(chunk->out, "%11d\n", ids);
+	if(fflush(chunk->out) != 0 || ferror(chunk->out)) return -1;
+	return 0;
+}
+
+
+/* Find the dots around the id in line, if it is the header of a
+   primitive: "<modifier> <type> <modifier>.<id>.<n>\n". The name
+   must repeat the modifier, so that other lines after an empty one,
+   like "!xform ... blk.2.rad", are left alone. */
+static char *
+FindIdDots(char *line, size_t len, char **dot2)
+{
+	char *type, *name, *dot1;
+
+	if(len < 2 || line[len-1] != '\n' || line[0] == '!') return NULL;
+	type = strchr(line, ' ');
+	if(type == NULL) return NULL;
+	name = strchr(type + 1, ' ');
+	if(name == NULL) return NULL;
+	name++;
+	line[len-1] = '\0';
+	*dot2 = strrchr(name, '.');
+	dot1 = NULL;
+	if(*dot2 != NULL) {
+		**dot2 = '\0';
+		dot1 = strrchr(name, '.');
+		**dot2 = '.';
+	}
+	line[len-1] = '\n';
+	if(dot1 == NULL || dot1 - name != type - line
+			|| strncmp(name, line, (size_t)(type - line)) != 0) {
+		return NULL;
+	}
+	return dot1;
+}
+
+
+/* Copy a converted chunk to ctx->outf, adding base to all ids.
+   Every primitive starts with an empty line, followed by
+   "<modifier> <type> <modifier>.<id>.<n>". Returns the number of ids
+   the chunk used, or -1. */
+static int
+MergeChunk(DxfContext *ctx, FILE *in, int base)
+{
+	char line[MAXLINE];
+	char *dot1, *dot2, *end;
+	size_t len;
+	int ids, id;
+	int linestart = 1, header = 0;
+
+	rewind(in);
+	if(fgets(line, sizeof(line), in) == NULL) return -1;
+	ids = atoi(line);
+	while(fgets(line, sizeof(line), in) != NULL) {
+		len = strlen(line);
+		dot1 = dot2 = NULL;
+		if(header && linestart) dot1 = FindIdDots(line, len, &dot2);
+		end = NULL;
+		if(dot1 != NULL) id = (int)strtol(dot1+1, &end, 10);
+		if(end != NULL && end == dot2) {
+			fprintf(ctx->outf, "%.*s%d%s", (int)(dot1+1 - line), line,
+					id + base, dot2);
+		} else {
+			fputs(line, ctx->outf);
+		}
+		header = linestart && line[0] == '\n';
+		linestart = len > 0 && line[len-1] == '\n';
+	}
+	if(ferror(in)) return -1;
+	return ids;
+}
+
+
+/* Start converting a chunk in a child process */
+static void
+StartChunk(DxfContext *ctx, Chunk *chunk)
+{
+	if(chunk->insert == NULL && ctx->Options.instances) {
+		/* the children must not write the same block files */
+		InstanceInserts(ctx, chunk->start, chunk->end, chunk->line);
+	}
+	chunk->out = tmpfile();
+	if(chunk->out == NULL) DxfFail(ctx, "Can't create temporary file");
+	(void)setvbuf(chunk->out, NULL, _IOFBF, WRITERAD_BUFSIZE);
+	fflush(NULL); /* nothing buffered may get written twice */
+	chunk->pid = fork();
+	if(chunk->pid == 0) {
+		ctx->Options.workers = 1; /* no more processes from here */
+		_exit(ConvertChunkChild(ctx, chunk) == 0 ? 0 : 1);
+	}
+	if(chunk->pid < 0 /* do it ourselves */
+			&& ConvertChunkChild(ctx, chunk) != 0) {
+		DxfFail(ctx, "Converting entities failed");
+	}
+}
+
+
+/* Wait for a chunk, and copy its results to ctx->outf */
+static void
+FinishChunk(DxfContext *ctx, Chunk *chunk)
+{
+	pid_t pid;
+	int status, ids;
+
+	if(chunk->pid > 0) {
+		pid = waitpid(chunk->pid, &status, 0);
+		chunk->pid = 0;
+		if(pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			DxfFail(ctx, "Converting entities failed");
+		}
+	}
+	ids = MergeChunk(ctx, chunk->out, ctx->id_index);
+	if(ids < 0) DxfFail(ctx, "Can't read temporary file");
+	ctx->id_index += ids;
+	fclose(chunk->out);
+	chunk->out = NULL;
+}
+
+
+/* After a failure: stop the children of the n chunks that are still
+   converting, and drop all results. */
+static void
+AbandonChunks(Chunk *chunks, int n)
+{
+	int i, status;
+
+	for(i = 0; i < n; i++) {
+		if(chunks[i].pid > 0) {
+			(void)kill(chunks[i].pid, SIGTERM);
+			(void)waitpid(chunks[i].pid, &status, 0);
+			chunks[i].pid = 0;
+		}
+		if(chunks[i].out != NULL) fclose(chunks[i].out);
+		chunks[i].out = NULL;
+	}
+}
+
+
+/* Convert the ENTITIES section as a pipeline: we read it and cut it
+   into chunks in front of entities, never inside of a POLYLINE or
+   an INSERT with attributes. Each chunk is converted by a child
+   while we read on, with up to workers children at a time, and the
+   results are merged in order as they become ready.
+   The chunks are captured from the input, in place if it is in
+   memory, so this works with pipes as well. Like ReadEntities(),
+   this leaves the ENDSEC group in ctx->Group. running has room for
+   workers chunks, which ParallelEntitiesSection() cleans up. */
+static void
+PipelineChunks(DxfContext *ctx, Chunk *running, int workers)
+{
+	DxfInput *in = ctx->infp;
+	Chunk last, *chunk;
+	const char *data;
+	size_t chunksize, here, end;
+	int first = 0, count = 0, parts = 0, line, hereline;
+
+	/* a few chunks per worker even out their differences */
+	chunksize = 4 * PARALLEL_MINCHUNK;
+	if(DxfInMemory(in)) {
+		chunksize = (size_t)(in->end - in->pos) / ((size_t)workers * 4);
+		if(chunksize < PARALLEL_MINCHUNK) chunksize = PARALLEL_MINCHUNK;
+	}
+
+	line = hereline = ctx->Group.line;
+	here = 0;
+	next_group(in, &ctx->Group);
+	while(!DxfEof(in)
+			&& (ctx->Group.code != 0 || ctx->Group.keyword != kw_ENDSEC)) {
+		if(ctx->Group.code == 0 && here >= chunksize
+				&& ctx->Group.keyword != kw_SEQEND
+				&& !group_is(&ctx->Group, "VERTEX")
+				&& !group_is(&ctx->Group, "ATTRIB")) {
+			data = DxfCaptured(in);
+			if(data == NULL) DxfFail(ctx, "Out of memory");
+			if(count == workers) {
+				FinishChunk(ctx, &running[first]);
+				first = (first + 1) % workers;
+				count--;
+			}
+			chunk = &running[(first + count) % workers];
+			memset(chunk, 0, sizeof(Chunk));
+			chunk->start = data;
+			chunk->end = data + here;
+			chunk->line = line;
+			StartChunk(ctx, chunk);
+			count++;
+			parts++;
+			DxfCaptureDrop(in, here);
+			line = hereline;
+		}
+		here = DxfCaptureLength(in);
+		hereline = ctx->Group.line;
+		next_group(in, &ctx->Group);
+	}
+	DxfCheckInput(ctx, in);
+	end = DxfEof(in) ? DxfCaptureLength(in) : here;
+	data = DxfCaptured(in);
+	if(data == NULL) DxfFail(ctx, "Out of memory");
+	memset(&last, 0, sizeof(Chunk));
+	last.start = data;
+	last.end = data + end;
+	last.line = line;
+
+	if(parts == 0) { /* not worth it */
+		ctx->id_index = ConvertChunk(ctx, &last, ctx->outf, ctx->id_index);
+	} else {
+		if(count == workers) {
+			FinishChunk(ctx, &running[first]);
+			first = (first + 1) % workers;
+			count--;
+		}
+		running[(first + count) % workers] = last;
+		StartChunk(ctx, &running[(first + count) % workers]);
+		count++;
+		parts++;
+		while(count > 0) {
+			FinishChunk(ctx, &running[first]);
+			first = (first + 1) % workers;
+			count--;
+		}
+		if(ctx->Options.verbose > 1) {
+			fprintf(stderr, "    Converted entities in %d parts\n", parts);
+		}
+	}
+}
+
+
+/* On failure the children are stopped before we pass it on */
+int
+ParallelEntitiesSection(DxfContext *ctx, int workers)
+{
+	DxfInput *in = ctx->infp;
+	jmp_buf failure, *outer = ctx->Failure;
+	Chunk *running;
+
+	if(workers < 2) return -1;
+	running = (Chunk*)calloc((size_t)workers, sizeof(Chunk));
+	if(running == NULL) return -1;
+	if(setjmp(failure) != 0) {
+		ctx->Failure = outer;
+		AbandonChunks(running, workers);
+		DxfCaptureStop(in);
+		free(running);
+		DxfFail(ctx, NULL);
+	}
+	ctx->Failure = &failure;
+	DxfCaptureStart(in);
+	PipelineChunks(ctx, running, workers);
+	ctx->Failure = outer;
+	DxfCaptureStop(in);
+	free(running);
+	return 0;
+}
+
+
+int
+ParallelInsert(DxfContext *ctx, InsertDef *insertdef)
+{
+	jmp_buf failure, *outer = ctx->Failure;
+	Chunk *chunks;
+	long total;
+	int workers = ctx->Options.workers, i;
+
+	if(workers < 2) return -1;
+	/* a dry run to see how much there is */
+	ctx->ExpandPos = 0;
+	ctx->ExpandFrom = ctx->ExpandTo = LONG_MAX;
+	TransformInsertContents(ctx, insertdef);
+	total = ctx->ExpandPos;
+	ctx->ExpandPos = 0;
+	ctx->ExpandFrom = 0;
+	ctx->ExpandTo = LONG_MAX;
+	if(total < PARALLEL_MININSERT) return -1;
+
+	chunks = (Chunk*)calloc((size_t)workers, sizeof(Chunk));
+	if(chunks == NULL) return -1;
+	if(setjmp(failure) != 0) {
+		ctx->Failure = outer;
+		AbandonChunks(chunks, workers);
+		free(chunks);
+		DxfFail(ctx, NULL);
+	}
+	ctx->Failure = &failure;
+	if(ctx->Options.verbose > 1) {
+		fprintf(stderr, "    Flattening %s in %d parts\n",
+				insertdef->blockdef->name, workers);
+	}
+	for(i = 0; i < workers; i++) {
+		chunks[i].insert = insertdef;
+		chunks[i].from = (long)((double)total * i / workers);
+		chunks[i].to = (long)((double)total * (i + 1) / workers);
+	}
+	chunks[0].from = 0; /* the first child reports problems */
+	chunks[workers-1].to = LONG_MAX;
+	for(i = 0; i < workers; i++) StartChunk(ctx, &chunks[i]);
+	for(i = 0; i < workers; i++) FinishChunk(ctx, &chunks[i]);
+	ctx->Failure = outer;
+	free(chunks);
+	return 0;
+}
+
+#else /* HAVE_FORK */
+
+int
+ParallelEntitiesSection(DxfContext *ctx, int workers)
+{
+	(void)ctx;
+	(void)workers;
+	return -1;
+}
+
+
+int
+ParallelInsert(DxfContext *ctx, InsertDef *insertdef)
+{
+	(void)ctx;
+	(void)insertdef;
+	return -1;
+}
+
+#endif /* HAVE_FORK */
@@ -0,0 +1,62 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/* parallel.h - convert the ENTITIES section and big inserts
+   in several processes */
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* chunks smaller than this are not worth a process */
+#define PARALLEL_MINCHUNK (256L*1024L)
+/* nor are inserts with fewer polys and cyls than this */
+#define PARALLEL_MININSERT 50000L
+
+#ifndef _DXFCONTEXT_T
+#define _DXFCONTEXT_T
+typedef struct _DxfContext DxfContext;
+#endif
+
+/* Convert the ENTITIES section with up to workers processes.
+   Returns -1 without reading anything if that isn't possible
+   (no fork()), and the caller converts as usual. */
+extern int ParallelEntitiesSection(DxfContext *ctx, int workers);
+
+/* Flatten a top level insert with up to Options.workers processes.
+   Returns -1 if that isn't possible or not worth it, and the caller
+   flattens it as usual. */
+extern int ParallelInsert(DxfContext *ctx, struct _InsertDef *insertdef);
+
+#ifdef __cplusplus
+	}
+#endif
+#endif /* _PARALLEL_H */
@@ -28,17 +28,20 @@ SOFTWARE.
 
 */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 
 #include "geomtypes.h"
 #include "geomdefs.h"
 #include "geomproto.h"
 #include "readdxf.h"
+#include "dxfnum.h"
 #include "convert.h"
+#include "dxfconv.h"
+#include "parallel.h"
 
 
-extern FILE *infp;
-
 #define IS_SAMEPT(p,q) (((p.x)==(q.x))&&((p.y)==(q.y))&&((p.z)==(q.z)))
 
 
@@ -55,79 +58,293 @@ Point3 operator *(double,Point3);
 #endif
 
 
-/* read in line, accept \n, \r\n, and \r  */
-char *
-fgetline(char *s, int n, FILE *fp) 
+/* C locale isspace(), independent of the sign of char */
+#define IS_SPACE(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
+/* Keyword lookup.
+   An open addressing hash table. The hash function was chosen so that
+   all of our keywords land in their first slot, so any value costs one
+   hash and at most one string comparison. The table is constant, so
+   several threads may read at once; a new keyword goes in the slot of
+   KW_HASH(name), or the next free one after it. */
+#define KW_HASHSIZE 64
+#define KW_HASH(s,len) \
+	(((unsigned char)(s)[0] + 6*(unsigned char)(s)[1] \
+	 + 2*(unsigned char)(s)[(len)-1] + 12*(len)) & (KW_HASHSIZE-1))
+
+static const struct {
+	const char *name;
+	KeywordType kw;
+} keywords[] = {
+	{SECTION, kw_SECTION}, {ENDSEC, kw_ENDSEC},
+	{HEADER, kw_HEADER}, {CLASSES, kw_CLASSES}, {TABLES, kw_TABLES},
+	{BLOCKS, kw_BLOCKS}, {ENTITIES, kw_ENTITIES}, {OBJECTS, kw_OBJECTS},
+	{TABLE, kw_TABLE}, {ENDTAB, kw_ENDTAB}, {VIEW, kw_VIEW}, {VPORT, kw_VPORT},
+	{LAYER, kw_LAYER},
+	{BLOCK, kw_BLOCK}, {ENDBLK, kw_ENDBLK}, {SEQEND, kw_SEQEND},
+	{CIRCLE, kw_CIRCLE}, {POINT, kw_POINT}, {FACE3D, kw_3DFACE},
+	{TRACE, kw_TRACE}, {SOLID, kw_SOLID}, {LINE, kw_LINE}, {ARC, kw_ARC},
+	{POLYLINE, kw_POLYLINE}, {LWPOLYLINE, kw_LWPOLYLINE}, {TEXT, kw_TEXT},
+	{INSERT, kw_INSERT}, {FILEEND, kw_EOF}
+};
+
+/* index+1 into keywords, 0 if empty */
+static const unsigned char kw_table[KW_HASHSIZE] = {
+	 0, 16,  0,  0,  0,  4, 20,  0,  5,  0, 26, 17,  0, 27, 18, 28,
+	 0,  0,  3,  0, 24,  8,  0, 23, 25,  0, 12,  0, 14, 19,  0,  7,
+	 9,  1,  0,  0,  0, 10,  0,  2,  0,  0, 11,  0,  0,  0,  0,  0,
+	 0, 21, 13,  0,  0,  0,  0, 15,  6,  0,  0,  0, 22,  0,  0,  0
+};
+
+static KeywordType
+classify(const char *s, size_t len)
+{
+	const char *name;
+	size_t h;
+
+	if(len < 2) return kw_NONE;
+	h = KW_HASH(s, len);
+	while(kw_table[h] != 0) {
+		name = keywords[kw_table[h]-1].name;
+		if(strncmp(name, s, len) == 0 && name[len] == '\0') {
+			return keywords[kw_table[h]-1].kw;
+		}
+		h = (h + 1) & (KW_HASHSIZE-1);
+	}
+	return kw_NONE;
+}
+
+
+/* Value types of binary groups, by group code */
+typedef enum {
+	bv_STRING, bv_DOUBLE, bv_INT16, bv_INT32, bv_INT64, bv_BOOL, bv_BINARY
+} BinValueType;
+
+static BinValueType
+binary_type(int code)
+{
+	if(code >= 10 && code <= 59) return bv_DOUBLE;
+	if(code >= 60 && code <= 79) return bv_INT16;
+	if(code >= 90 && code <= 99) return bv_INT32;
+	if(code >= 110 && code <= 149) return bv_DOUBLE;
+	if(code >= 160 && code <= 169) return bv_INT64;
+	if(code >= 170 && code <= 179) return bv_INT16;
+	if(code >= 210 && code <= 239) return bv_DOUBLE;
+	if(code >= 270 && code <= 289) return bv_INT16;
+	if(code >= 290 && code <= 299) return bv_BOOL;
+	if(code >= 310 && code <= 319) return bv_BINARY;
+	if(code >= 370 && code <= 389) return bv_INT16;
+	if(code >= 400 && code <= 409) return bv_INT16;
+	if(code >= 420 && code <= 429) return bv_INT32;
+	if(code >= 440 && code <= 459) return bv_INT32;
+	if(code >= 460 && code <= 469) return bv_DOUBLE;
+	if(code == 1004) return bv_BINARY;
+	if(code >= 1010 && code <= 1059) return bv_DOUBLE;
+	if(code >= 1060 && code <= 1070) return bv_INT16;
+	if(code == 1071) return bv_INT32;
+	return bv_STRING; /* 0-9, 100-109, 300-369, 390-399, 999, 1000-1009 ... */
+}
+
+/* little endian integers */
+static int
+binary_int16(const unsigned char *p)
+{
+	int v = p[0] | (p[1] << 8);
+
+	return v >= 0x8000 ? v - 0x10000 : v;
+}
+
+static double
+binary_uint32(const unsigned char *p)
+{
+	return (double)((unsigned long)p[0] | ((unsigned long)p[1] << 8)
+		| ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24));
+}
+
+static double
+binary_int32(const unsigned char *p)
+{
+	double v = binary_uint32(p);
+
+	return v >= 2147483648.0 ? v - 4294967296.0 : v;
+}
+
+/* little endian IEEE double */
+static double
+binary_double(const unsigned char *p)
 {
-	char  *cp = s;
-	int  c = EOF;
+	static const int one = 1;
+	unsigned char b[sizeof(double)];
+	double d;
+	size_t i;
+
+	if(*(const char*)&one) {
+		memcpy(&d, p, sizeof(double));
+	} else {
+		for(i = 0; i < sizeof(double); i++) b[i] = p[sizeof(double)-1-i];
+		memcpy(&d, b, sizeof(double));
+	}
+	return d;
+}
 
-	while (--n > 0 && (c = getc(fp)) != EOF) {
-		if (c == '\r' && (c = getc(fp)) != '\n') {
-			ungetc(c, fp);  /* must be Apple file */
-			c = '\n';
+/* Read a group from a binary DXF file.
+   Numbers end up in m->number, strings in m->value as usual.
+   m->line counts as if it was a text file. */
+static int
+next_binary_group(DxfInput *in, Group_Type *m)
+{
+	const unsigned char *p;
+	const char *cp;
+	size_t len;
+	int rc;
+
+	if(DxfGetBytes(in, (size_t)in->binary, &p) != 0) return -1;
+	if(in->binary == 2) {
+		m->code = binary_int16(p);
+	} else if(p[0] == 255) { /* extended data in release 12 */
+		if(DxfGetBytes(in, 2, &p) != 0) return -1;
+		m->code = binary_int16(p);
+	} else {
+		m->code = p[0];
+	}
+	m->keyword = kw_NONE;
+	m->line++;
+
+	m->numeric = 1;
+	m->value = "";
+	m->length = 0;
+	switch(binary_type(m->code)) {
+	case bv_DOUBLE:
+		if(DxfGetBytes(in, 8, &p) != 0) return -1;
+		m->number = binary_double(p);
+		break;
+	case bv_INT16:
+		if(DxfGetBytes(in, 2, &p) != 0) return -1;
+		m->number = binary_int16(p);
+		break;
+	case bv_INT32:
+		if(DxfGetBytes(in, 4, &p) != 0) return -1;
+		m->number = binary_int32(p);
+		break;
+	case bv_INT64:
+		if(DxfGetBytes(in, 8, &p) != 0) return -1;
+		m->number = binary_int32(p + 4) * 4294967296.0 + binary_uint32(p);
+		break;
+	case bv_BOOL:
+		if(DxfGetBytes(in, 1, &p) != 0) return -1;
+		m->number = p[0];
+		break;
+	case bv_BINARY: /* skipped, we have no use for it */
+		if(DxfGetBytes(in, 1, &p) != 0) return -1;
+		if(DxfGetBytes(in, p[0], &p) != 0) return -1;
+		m->numeric = 0;
+		break;
+	case bv_STRING:
+		m->numeric = 0;
+		rc = DxfGetString(in, MAXLINE-1, &cp, &len);
+		m->value = cp;
+		m->length = len;
+		if(DxfEof(in)) return -1;
+		if(rc == 0) {
+			fprintf(stderr,
+				"Warning: Max line length exceeded on data line %d - truncating.\n",
+					m->line);
+			while(rc == 0) { /* skip the rest of the string */
+				rc = DxfGetString(in, MAXLINE-1, &cp, &len);
+				if(DxfEof(in)) return -1;
+			}
 		}
-		if (c == '\n') {
-			*cp++ = c;
-			break;
+		if(m->code == 0 || m->code == 2) {
+			m->keyword = classify(m->value, m->length);
 		}
-		*cp++ = c;
+		break;
 	}
-	if (cp == s && c == EOF)
-		return(NULL);
-	
-	*cp = '\0';
-	return(s);
+	m->line++;
+	return 0;
 }
 
 
 int
-next_group(FILE *fp, Group_Type *m)
+next_group(DxfInput *in, Group_Type *m)
 {
-	static char buffer[MAXLINE];
-	char *cp;
-	size_t ccount, dcount, dumpcount;
-
-	cp = fgetline((char*)&buffer, MAXLINE, fp);
-	if(feof(fp)) return -1;
-	ccount = strlen(cp);
-	if(buffer[ccount-1] != '\n') {
+	const char *cp;
+	size_t len;
+	int rc;
+
+	if(in->binary) return next_binary_group(in, m);
+	rc = DxfGetLine(in, MAXLINE-1, &cp, &len);
+	if(DxfEof(in)) return -1;
+	if(rc == 0) {
 		fprintf(stderr,
-			"Error: Max line length exceeded on code line %d - exiting.\n",
+			"Error: Max line length exceeded on code line %d.\n",
 				m->line);
-		exit(-1);
+		in->bad = in->eof = 1; /* the readers stop there */
+		return -1;
 	}
-	m->code = atoi(cp);
+	m->code = dxf_atoi(cp, len);
+	m->keyword = kw_NONE;
+	m->numeric = 0;
 	m->line++;
-	
-	cp = fgetline((char*)&m->value, MAXLINE, fp);
-	if(feof(fp)) return -1;
-	dcount = strlen(cp);
-	/* fprintf(stderr, "newline: [%c]\n", m->value[dcount-1]); */
-	if(m->value[dcount-1] != '\n') {
+
+	rc = DxfGetLine(in, MAXLINE-1, &cp, &len);
+	m->value = cp;
+	m->length = len;
+	if(DxfEof(in)) return -1;
+	if(rc == 0) {
 		fprintf(stderr,
 			"Warning: Max line length exceeded on data line %d - truncating.\n",
 				m->line);
-		/*exit(-1);*/
-		dumpcount = dcount;
-		while(buffer[dumpcount-1] != '\n') {
-			cp = fgetline((char*)&buffer, MAXLINE, fp);
-			if(feof(fp)) return -1;
-			dumpcount = strlen(cp);
-			/*fprintf(stderr, "truncating %ld chars (%s).\n", dumpcount, cp);*/
+		while(rc == 0) { /* skip the rest of the line */
+			rc = DxfGetLine(in, MAXLINE-1, &cp, &len);
+			if(DxfEof(in)) return -1;
 		}
 	}
-	for(dcount--; dcount >= 0; dcount --) { /* remove spurious trailing stuff */
-		if(isspace(m->value[dcount])) {
-			m->value[dcount] = '\0';
-		}
-		else break;
+	while(m->length > 0 && IS_SPACE(m->value[m->length-1])) {
+		m->length--; /* remove spurious trailing stuff */
+	}
+	if(m->code == 0 || m->code == 2) {
+		m->keyword = classify(m->value, m->length);
 	}
 	m->line++;
 	return 0;
 }
 
 
+/* Compare the value of a group to a string */
+int
+group_is(Group_Type *m, const char *s)
+{
+	return strncmp(m->value, s, m->length) == 0 && s[m->length] == '\0';
+}
+
+
+double
+group_atof(Group_Type *m)
+{
+	if(m->numeric) return m->number;
+	return dxf_atof(m->value, m->length);
+}
+
+
+int
+group_atoi(Group_Type *m)
+{
+	if(m->numeric) return (int)m->number;
+	return dxf_atoi(m->value, m->length);
+}
+
+
+/* Copy the value to a string of the given size, truncating if needed */
+void
+group_strcpy(char *dst, Group_Type *m, size_t size)
+{
+	size_t len = m->length < size ? m->length : size - 1;
+
+	memcpy(dst, m->value, len);
+	dst[len] = '\0';
+}
+
+
 /*  Transpose certain characters to create an acceptable primitive id.
  */
 void RegulateName(char *name)
@@ -142,79 +359,100 @@ void RegulateName(char *name)
 	}
 }
 
+/* Return the layer name for the value of a code 8 group.
+   Prefixing and regulating is only done once for each raw name,
+   as most drawings have many entities on few layers. */
+static char *InternLayer(DxfContext *ctx, Group_Type *m)
+{
+	char name[MAXSTRING];
+	char *layer, *raw;
+
+	layer = (char*)NameTableGetN(&ctx->RawLayerTable, m->value, m->length);
+	if(layer != NULL) return layer;
+
+	LayerName(ctx, m->value, m->length, name);
+	layer = GetLayerDef(ctx, name);
+	if(layer == NULL) return NULL;
+
+	raw = (char*)malloc(m->length + 1);
+	if(raw == NULL) return layer;
+	memcpy(raw, m->value, m->length);
+	raw[m->length] = '\0';
+	if(NameTableAdd(&ctx->RawLayerTable, raw, layer) != 0) free(raw);
+	return layer;
+}
+
+/* These all expect the DxfContext in ctx */
 #define READ_THICKNESS(X)  case 39: \
-	X.Thickness = Options.ignorethickness ? 0.0 : atof(Group.value); break
+	X.Thickness = ctx->Options.ignorethickness ? 0.0 \
+		: group_atof(&ctx->Group); break
 #define READ_WIDTH(X)  case 40: \
-	X.Width = Options.ignorepolywidth ? 0.0 : atof(Group.value); break
-#define READ_FLAGS(X)      case 70:  X.Flags = atoi(Group.value); break
-#define READ_ROTATION(C,X) case C:   X = atof(Group.value); X *= DEG2RAD; break
-#define READ_DOUBLE(C,X)   case C:   X = atof(Group.value); break
-#define READ_INT(C,X)      case C:   X = atoi(Group.value); break
+	X.Width = ctx->Options.ignorepolywidth ? 0.0 \
+		: group_atof(&ctx->Group); break
+#define READ_FLAGS(X)      case 70:  X.Flags = group_atoi(&ctx->Group); break
+#define READ_ROTATION(C,X) case C:   X = group_atof(&ctx->Group); \
+	X *= DEG2RAD; break
+#define READ_DOUBLE(C,X)   case C:   X = group_atof(&ctx->Group); break
+#define READ_INT(C,X)      case C:   X = group_atoi(&ctx->Group); break
 
 #define READ_TEXT(X,C)\
 	case C:\
-		strncpy(X, Group.value,sizeof(X));\
-		X[sizeof(X)-1] = '\0';\
+		group_strcpy(X, &ctx->Group, sizeof(X));\
 		break
 
 #define READ_NAME(X)\
 	case 2:\
-		strncpy(X.Name, Group.value,sizeof(X.Name));\
-		X.Name[sizeof(X.Name)-1] = '\0';\
+		group_strcpy(X.Name, &ctx->Group, sizeof(X.Name));\
 		break
 
 #define READ_COORDINATE(X,C1,C2,C3)\
-	case C1:   X.x = atof(Group.value); break;\
-	case C2:   X.y = atof(Group.value); break;\
-	case C3:   X.z = atof(Group.value); break
+	case C1:   X.x = group_atof(&ctx->Group); break;\
+	case C2:   X.y = group_atof(&ctx->Group); break;\
+	case C3:   X.z = group_atof(&ctx->Group); break
 
+/* An entity on a hidden layer is skipped as soon as we know that */
 #define READ_ENTITY_OPTIONAL(X)\
 	case 8:\
-		if(Options.prefixlen) strncpy(X.Layer,Options.prefix,sizeof(X.Layer));\
-		else X.Layer[0] = '\0';\
-		strncat(X.Layer, Group.value, MAXSTRING - Options.prefixlen - 1);\
-		X.Layer[sizeof(X.Layer)-1] = '\0';\
-		RegulateName(X.Layer);\
+		X.Layer = InternLayer(ctx, &ctx->Group);\
+		if(SkipHidden(ctx, X.Layer)) continue;\
 		break;\
+	READ_ENTITY_COMMON(X)
+
+/* Vertices and block headers belong to something else */
+#define READ_PART_OPTIONAL(X)\
+	case 8:\
+		X.Layer = InternLayer(ctx, &ctx->Group);\
+		break;\
+	READ_ENTITY_COMMON(X)
+
+#define READ_ENTITY_COMMON(X)\
 	case 5:\
-		strncpy(X.Handle, Group.value,sizeof(X.Handle));\
-		X.Handle[sizeof(X.Handle)-1] = '\0';\
+		group_strcpy(X.Handle, &ctx->Group, sizeof(X.Handle));\
 		break;\
-	case 62:  X.Colour = atoi(Group.value); break
+	case 62:  X.Colour = group_atoi(&ctx->Group); break
 
 #define READ_ENTITY_NORMAL(X)\
-	case 210: X.x = atof(Group.value); break;\
-	case 220: X.y = atof(Group.value); break;\
-	case 230: X.z = atof(Group.value); break
-
-
-Group_Type    Group;                   /* A group : Code and value  */
-
-Text_Type     Text;                    /* A line of text  */
-View_Type     View;                    /* A view  */
-Vertex_Type   Vertex;                  /* A vertex  */
-Line_Type     Line;                    /* A line  */
-Arc_Type      Arc;                     /* An arc  */
-Circle_Type   Circle;                  /* A circle/cylinder  */
-Point_Type    Point;                   /* A point (sphere)  */
-Face3D_Type   Face3D;                  /* A 3D face  */
-Trace_Type    Trace;                   /* A Trace or 2D-Solid  */
-PolyLine_Type PolyLine;                /* A polygon/polyface mesh  */
-Block_Type    Block;                   /* A block  */
-Insert_Type   Insert;                  /* An insert  */
-
-/* we dynamically allocate memory for polyline vertex data,
-   grow it when needed, but never shrink or release it */
-typedef int xface[4];
-size_t mesh_size = 0;
-Point3        *Mesh = NULL;           /* vertices  */
-double        *Bulges = NULL;         /* bulge per vertex   */
-size_t faces_size = 0;
-xface	      *Faces = NULL;          /* faces (3 or 4 vertices each)  */
-unsigned int           *VCount = NULL;         /* vertice count per face  */
-xface         Fc;
-size_t normals_size = 0;
-Point3	      *Normals = NULL;        /* vertice normals  */
+	case 210: X.x = group_atof(&ctx->Group); break;\
+	case 220: X.y = group_atof(&ctx->Group); break;\
+	case 230: X.z = group_atof(&ctx->Group); break
+
+
+/* If layer is not exported, skip the rest of the current entity
+   without looking at its groups, and mark it as hidden for the
+   caller. Layer 0 in a block takes the layer of the insert, so
+   those entities are decided by their inserts. */
+static int
+SkipHidden(DxfContext *ctx, const char *layer)
+{
+	if(layer == NULL || !LayerHidden(ctx, layer)) return 0;
+	if(ctx->CurrentBlockDef != NULL && layer == ctx->Layer0) return 0;
+	ctx->Hidden = 1;
+	do {
+		next_group(ctx->infp, &ctx->Group);
+	} while (!DxfEof(ctx->infp) && ctx->Group.code != 0);
+	return 1;
+}
+
 
 /* ------------------------------------------------------------------------ */
 
@@ -240,636 +478,713 @@ int InExcludeList(char *Name) {
 
 
 /* ------------------------------------------------------------------------ */
-void IgnoreSection()	/* Ignore everything  */
+
+/* The groups the skipping loops below wait for, by their values */
+static const char *const SectionEnd[] = {ENDSEC, SECTION, NULL};
+static const char *const HeaderStop[] = {"$PDSIZE", ENDSEC, SECTION, NULL};
+static const char *const TableStop[] = {TABLE, ENDSEC, SECTION, NULL};
+static const char *const ViewStop[] = {
+	VIEW, TABLE, ENDTAB, ENDSEC, SECTION, NULL};
+static const char *const LayerStop[] = {
+	LAYER, TABLE, ENDTAB, ENDSEC, SECTION, NULL};
+static const char *const BlockStop[] = {
+	ENDBLK, BLOCK, ENDSEC, SECTION, NULL};
+static const char *const InsertStop[] = {
+	INSERT, ENDBLK, ENDSEC, FILEEND, NULL};
+
+/* Skip ahead to the next group with one of values, without reading
+   the ones in between. The loops that read them still check what they
+   find, so this only saves time. */
+static void
+SkipTo(DxfContext *ctx, const char *const *values)
+{
+	long lines = 0;
+
+	(void)DxfSkipTo(ctx->infp, values, &lines);
+	ctx->Group.line += (int)lines;
+}
+
+
+void IgnoreSection(DxfContext *ctx)	/* Ignore everything  */
 {
-	while (!feof(infp) && (Group.code != 0
-		|| (   (strcmp(Group.value,ENDSEC)  != 0)
-			&& (strcmp(Group.value,SECTION) != 0)))) {
-		next_group(infp, &Group);
+	while (!DxfEof(ctx->infp) && (ctx->Group.code != 0
+		|| (   ctx->Group.keyword != kw_ENDSEC
+			&& ctx->Group.keyword != kw_SECTION))) {
+		SkipTo(ctx, SectionEnd);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 /* ------------------------------------------------------------------------ */
 
-void HeaderSection()	/* Ignore everything except $PDSIZE  */
+void HeaderSection(DxfContext *ctx)	/* Ignore everything except $PDSIZE  */
 {
-	while (!feof(infp) && (Group.code != 0
-		|| (   (strcmp(Group.value,ENDSEC)  != 0)
-			&& (strcmp(Group.value,SECTION) != 0)))) {
-		if(Group.code == 9 && Group.value[1] == 'P') {
-			if(strcmp(Group.value, "$PDSIZE") == 0) {
-				next_group(infp, &Group);
-				if(Group.code == 40) Acadvars.pdsize = atof(Group.value);
+	while (!DxfEof(ctx->infp) && (ctx->Group.code != 0
+		|| (   ctx->Group.keyword != kw_ENDSEC
+			&& ctx->Group.keyword != kw_SECTION))) {
+		if(ctx->Group.code == 9 && ctx->Group.length > 1
+				&& ctx->Group.value[1] == 'P') {
+			if(group_is(&ctx->Group, "$PDSIZE")) {
+				next_group(ctx->infp, &ctx->Group);
+				if(ctx->Group.code == 40) {
+					ctx->Acadvars.pdsize = group_atof(&ctx->Group);
+				}
 			}
 		}
-		next_group(infp, &Group);
+		SkipTo(ctx, HeaderStop);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 /* ------------------------------------------------------------------------ */
 
-void findTable()
+void findTable(DxfContext *ctx)
 {
-	while (!feof(infp) && (Group.code != 0
-		|| (   (strcmp(Group.value, TABLE)  != 0)
-			&& (strcmp(Group.value, ENDSEC) != 0)
-			&& (strcmp(Group.value, SECTION)!= 0)))) {
-		next_group(infp, &Group);
+	while (!DxfEof(ctx->infp) && (ctx->Group.code != 0
+		|| (   ctx->Group.keyword != kw_TABLE
+			&& ctx->Group.keyword != kw_ENDSEC
+			&& ctx->Group.keyword != kw_SECTION))) {
+		SkipTo(ctx, TableStop);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
-void findVport()
+void findVport(DxfContext *ctx)
 {
-	while (!feof(infp) && (Group.code != 0
-		|| (   (strcmp(Group.value, VPORT)   != 0)
-			&& (strcmp(Group.value, TABLE)  != 0)
-			&& (strcmp(Group.value, ENDTAB) != 0)
-			&& (strcmp(Group.value, ENDSEC) != 0)
-			&& (strcmp(Group.value, SECTION)!= 0)))) {
-		next_group(infp, &Group);
+	while (!DxfEof(ctx->infp) && (ctx->Group.code != 0
+		|| (   ctx->Group.keyword != kw_VPORT
+			&& ctx->Group.keyword != kw_TABLE
+			&& ctx->Group.keyword != kw_ENDTAB
+			&& ctx->Group.keyword != kw_ENDSEC
+			&& ctx->Group.keyword != kw_SECTION))) {
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
-void readVport()
+void readVport(DxfContext *ctx)
 {
 	double viewaspect = 0.0;
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_NAME(View); /* "*Active" */
-			READ_COORDINATE(View.Center,12,22,32);
-			READ_COORDINATE(View.Direction,16,26,36);
-			READ_COORDINATE(View.Target,17,27,37);
-			READ_DOUBLE(40, View.Height);
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_NAME(ctx->View); /* "*Active" */
+			READ_COORDINATE(ctx->View.Center,12,22,32);
+			READ_COORDINATE(ctx->View.Direction,16,26,36);
+			READ_COORDINATE(ctx->View.Target,17,27,37);
+			READ_DOUBLE(40, ctx->View.Height);
 			READ_DOUBLE(41, viewaspect);
-			READ_DOUBLE(42, View.Lens);
-			READ_DOUBLE(43, View.Fclip);
-			READ_DOUBLE(44, View.Bclip);
-			READ_ROTATION(51, View.Twist);
-			READ_INT(71, View.Mode);
+			READ_DOUBLE(42, ctx->View.Lens);
+			READ_DOUBLE(43, ctx->View.Fclip);
+			READ_DOUBLE(44, ctx->View.Bclip);
+			READ_ROTATION(51, ctx->View.Twist);
+			READ_INT(71, ctx->View.Mode);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
-	View.Width = View.Height * viewaspect;
-	View.Center.z = 0.0;
-	ConvertView(View);
+	ctx->View.Width = ctx->View.Height * viewaspect;
+	ctx->View.Center.z = 0.0;
+	ConvertView(ctx, ctx->View);
 }
 
-void findView()
+void findView(DxfContext *ctx)
 {
-	while (!feof(infp) && (Group.code != 0
-		|| (   (strcmp(Group.value, VIEW)   != 0)
-			&& (strcmp(Group.value, TABLE)  != 0)
-			&& (strcmp(Group.value, ENDTAB) != 0)
-			&& (strcmp(Group.value, ENDSEC) != 0)
-			&& (strcmp(Group.value, SECTION)!= 0)))) {
-		next_group(infp, &Group);
+	while (!DxfEof(ctx->infp) && (ctx->Group.code != 0
+		|| (   ctx->Group.keyword != kw_VIEW
+			&& ctx->Group.keyword != kw_TABLE
+			&& ctx->Group.keyword != kw_ENDTAB
+			&& ctx->Group.keyword != kw_ENDSEC
+			&& ctx->Group.keyword != kw_SECTION))) {
+		SkipTo(ctx, ViewStop);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
-void readView()
+void readView(DxfContext *ctx)
 {
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_NAME(View);
-			READ_COORDINATE(View.Center,10,20,30);
-			READ_COORDINATE(View.Direction,11,21,31);
-			READ_COORDINATE(View.Target,12,22,32);
-			READ_DOUBLE(40, View.Height);
-			READ_DOUBLE(41, View.Width);
-			READ_DOUBLE(42, View.Lens);
-			READ_DOUBLE(43, View.Fclip);
-			READ_DOUBLE(44, View.Bclip);
-			READ_ROTATION(50, View.Twist);
-			READ_INT(71, View.Mode);
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_NAME(ctx->View);
+			READ_COORDINATE(ctx->View.Center,10,20,30);
+			READ_COORDINATE(ctx->View.Direction,11,21,31);
+			READ_COORDINATE(ctx->View.Target,12,22,32);
+			READ_DOUBLE(40, ctx->View.Height);
+			READ_DOUBLE(41, ctx->View.Width);
+			READ_DOUBLE(42, ctx->View.Lens);
+			READ_DOUBLE(43, ctx->View.Fclip);
+			READ_DOUBLE(44, ctx->View.Bclip);
+			READ_ROTATION(50, ctx->View.Twist);
+			READ_INT(71, ctx->View.Mode);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
+	}
+	ctx->View.Center.z = 0.0;
+	ConvertView(ctx, ctx->View);
+}
+
+void findLayer(DxfContext *ctx)
+{
+	while (!DxfEof(ctx->infp) && (ctx->Group.code != 0
+		|| (   ctx->Group.keyword != kw_LAYER
+			&& ctx->Group.keyword != kw_TABLE
+			&& ctx->Group.keyword != kw_ENDTAB
+			&& ctx->Group.keyword != kw_ENDSEC
+			&& ctx->Group.keyword != kw_SECTION))) {
+		SkipTo(ctx, LayerStop);
+		next_group(ctx->infp, &ctx->Group);
+	}
+}
+
+/* Frozen (flag 1) and off (negative colour) layers are hidden */
+void readLayer(DxfContext *ctx)
+{
+	char name[MAXSTRING];
+	int flags = 0, colour = 0;
+
+	name[0] = '\0';
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_TEXT(name, 2);
+			READ_INT(70, flags);
+			READ_INT(62, colour);
+		}
+		next_group(ctx->infp, &ctx->Group);
+	}
+	if(name[0] == '\0' || ((flags & 1) == 0 && colour >= 0)) return;
+	if(ctx->Options.verbose > 1) {
+		fprintf(stderr, "    Not exporting %s layer: %s\n",
+				(flags & 1) ? "frozen" : "off", name);
+	}
+	if(AddLayerFilter(ctx, &ctx->HiddenLayers, name, strlen(name)) != 0) {
+		DxfFail(ctx, "Out of memory");
 	}
-	View.Center.z = 0.0;
-	ConvertView(View);
 }
 
 #define T_NONE 0
 #define T_VPORT 1
 #define T_VIEW 2
+#define T_LAYER 3
 
-void TablesSection()
+void TablesSection(DxfContext *ctx)
 {
 	int tablesEnd = 0;
 	int tableSection = 0;
 	int entryRead = 0;
 
-	next_group(infp, &Group);
-	while(!feof(infp) && tablesEnd == 0) {
-		findTable();
-		if(strcmp(Group.value,ENDSEC)  == 0) {
+	next_group(ctx->infp, &ctx->Group);
+	while(!DxfEof(ctx->infp) && tablesEnd == 0) {
+		findTable(ctx);
+		switch(ctx->Group.keyword) {
+		case kw_ENDSEC:
+		case kw_SECTION:
 			tablesEnd = 1;
-		} else if(strcmp(Group.value,SECTION) == 0) {
-			tablesEnd = 1;
-		} else if(strcmp(Group.value,TABLE)  == 0) {
-			next_group(infp, &Group);
-			if(Group.code == 2) {
-				if(Options.verbose > 1) {
-					fprintf(stderr, "    Reading table: %s\n", Group.value);
+			break;
+		case kw_TABLE:
+			next_group(ctx->infp, &ctx->Group);
+			if(ctx->Group.code == 2) {
+				if(ctx->Options.verbose > 1) {
+					fprintf(stderr, "    Reading table: %.*s\n",
+							(int)ctx->Group.length, ctx->Group.value);
 				}
-				if(strcmp(Group.value,VIEW) == 0) {
+				if(ctx->Group.keyword == kw_VIEW) {
 					tableSection = T_VIEW;
+				} else if(ctx->Group.keyword == kw_LAYER
+						&& ctx->Options.skipfrozen) {
+					tableSection = T_LAYER;
 				/* Unfortunately, we can't determine the "current" viewport */
-				/*} else if(strcmp(Group.value,VPORT) == 0) {
+				/*} else if(ctx->Group.keyword == kw_VPORT) {
 					tableSection = T_VPORT;*/
 				}
 				if (tableSection) {
-					while(!feof(infp) && tablesEnd == 0) {
+					while(!DxfEof(ctx->infp) && tablesEnd == 0) {
 						entryRead = 0;
 						/*
 						if(tableSection == T_VPORT) {
-							findVport();
-							if(strcmp(Group.value,VPORT)  == 0) {
-								readVport();
+							findVport(ctx);
+							if(ctx->Group.keyword == kw_VPORT) {
+								readVport(ctx);
 								entryRead = 1;
 							}
 						}
 						*/
 						if(tableSection == T_VIEW) {
-							findView();
-							if(strcmp(Group.value,VIEW)  == 0) {
-								readView();
+							findView(ctx);
+							if(ctx->Group.keyword == kw_VIEW) {
+								readView(ctx);
 								entryRead = 1;
 							}
 						}
-						if(entryRead) {
-							;
-						} else if(strcmp(Group.value,ENDTAB)  == 0) {
-							break;
-						} else if(strcmp(Group.value,TABLE)  == 0) {
-							break;
-						} else if(strcmp(Group.value,ENDSEC)  == 0) {
-							tablesEnd = 1;
+						if(tableSection == T_LAYER) {
+							findLayer(ctx);
+							if(ctx->Group.keyword == kw_LAYER) {
+								readLayer(ctx);
+								entryRead = 1;
+							}
+						}
+						if(entryRead) continue;
+						switch(ctx->Group.keyword) {
+						case kw_ENDTAB:
+						case kw_TABLE:
 							break;
-						} else if(strcmp(Group.value,SECTION) == 0) {
+						case kw_ENDSEC:
+						case kw_SECTION:
 							tablesEnd = 1;
 							break;
-						} else { /* huh ??  */
-							next_group(infp, &Group);
-							break;
+						default: /* huh ??  */
+							next_group(ctx->infp, &ctx->Group);
 						}
+						break;
 					}
 				}
 				tableSection = T_NONE;
 			}
-		} else { /* huh ?  */
-			next_group(infp, &Group);
 			break;
+		default: /* huh ?  */
+			next_group(ctx->infp, &ctx->Group);
+			tablesEnd = 1;
 		}
 	}
 	/* Read rest  */
-	while (!feof(infp) && (Group.code != 0
-		|| (   (strcmp(Group.value, ENDSEC)  != 0)
-			&& (strcmp(Group.value, SECTION) != 0)))) {
-		next_group(infp, &Group);
-	}
+	IgnoreSection(ctx);
 }
 
 
 /* ------------------------------------------------------------------------ */
 
 
-void ReadText()
+void ReadText(DxfContext *ctx)
 {
-	Text.Colour = -1;
-
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Text);
-			READ_TEXT(Text.Text,1);
-			/* READ_FLAGS(Text); */
-			READ_COORDINATE(Text.Location,10,20,30);
+	ctx->Text.Colour = -1;
+
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->Text);
+			READ_TEXT(ctx->Text.Text,1);
+			/* READ_FLAGS(ctx->Text); */
+			READ_COORDINATE(ctx->Text.Location,10,20,30);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}		
 }
 
-void ReadLine()
+void ReadLine(DxfContext *ctx)
 {
-	Line.Colour = -1;
-	Line.Thickness = 0;
-	Line.Normal = ZUnit;
+	ctx->Line.Colour = -1;
+	ctx->Line.Thickness = 0;
+	ctx->Line.Normal = ZUnit;
 	
-	next_group(infp, &Group); /* skip group 0 */
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Line);
-			READ_THICKNESS(Line);
-			READ_COORDINATE(Line.Start,10,20,30);
-			READ_COORDINATE(Line.End,11,21,31);
-			READ_ENTITY_NORMAL(Line.Normal);
+	next_group(ctx->infp, &ctx->Group); /* skip group 0 */
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->Line);
+			READ_THICKNESS(ctx->Line);
+			READ_COORDINATE(ctx->Line.Start,10,20,30);
+			READ_COORDINATE(ctx->Line.End,11,21,31);
+			READ_ENTITY_NORMAL(ctx->Line.Normal);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 
-void ReadArc()
+void ReadArc(DxfContext *ctx)
 {
-	Arc.Colour = -1;
-	Arc.Thickness = 0;
-	Arc.Normal = ZUnit;
+	ctx->Arc.Colour = -1;
+	ctx->Arc.Thickness = 0;
+	ctx->Arc.Normal = ZUnit;
 	
-	next_group(infp, &Group); /* skip group 0 */
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Arc);
-			READ_COORDINATE(Arc.Center,10,20,30);
-			READ_ENTITY_NORMAL(Arc.Normal);
-			READ_THICKNESS(Arc);
-			READ_DOUBLE(40, Arc.Radius);
-			READ_ROTATION(50, Arc.Startangle);
-			READ_ROTATION(51, Arc.Endangle);
+	next_group(ctx->infp, &ctx->Group); /* skip group 0 */
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->Arc);
+			READ_COORDINATE(ctx->Arc.Center,10,20,30);
+			READ_ENTITY_NORMAL(ctx->Arc.Normal);
+			READ_THICKNESS(ctx->Arc);
+			READ_DOUBLE(40, ctx->Arc.Radius);
+			READ_ROTATION(50, ctx->Arc.Startangle);
+			READ_ROTATION(51, ctx->Arc.Endangle);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 
-void ReadCircle()
+void ReadCircle(DxfContext *ctx)
 {
-	Circle.Colour = -1;
-	Circle.Thickness = 0;
-	Circle.Normal = ZUnit;
+	ctx->Circle.Colour = -1;
+	ctx->Circle.Thickness = 0;
+	ctx->Circle.Normal = ZUnit;
 	
-	next_group(infp, &Group); /* skip group 0 */
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Circle);
-			READ_THICKNESS(Circle);
-			READ_DOUBLE(40, Circle.Radius);
-			READ_COORDINATE(Circle.Center,10,20,30);
-			READ_ENTITY_NORMAL(Circle.Normal);
+	next_group(ctx->infp, &ctx->Group); /* skip group 0 */
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->Circle);
+			READ_THICKNESS(ctx->Circle);
+			READ_DOUBLE(40, ctx->Circle.Radius);
+			READ_COORDINATE(ctx->Circle.Center,10,20,30);
+			READ_ENTITY_NORMAL(ctx->Circle.Normal);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 
-void ReadPoint()
+void ReadPoint(DxfContext *ctx)
 {
-	Point.Colour = -1;
-	Point.Thickness = 0.0;
+	ctx->Point.Colour = -1;
+	ctx->Point.Thickness = 0.0;
 	
-	next_group(infp, &Group); /* skip group 0 */
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Point);
-			READ_THICKNESS(Point);
-			READ_COORDINATE(Point.Center,10,20,30);
+	next_group(ctx->infp, &ctx->Group); /* skip group 0 */
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->Point);
+			READ_THICKNESS(ctx->Point);
+			READ_COORDINATE(ctx->Point.Center,10,20,30);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 
-void Read3DFace()
+void Read3DFace(DxfContext *ctx)
 {
-	Face3D.Colour = -1;
+	ctx->Face3D.Colour = -1;
 	
-	next_group(infp, &Group); /* skip group 0 */
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Face3D);
-			READ_COORDINATE(Face3D.p[0],10,20,30);
-			READ_COORDINATE(Face3D.p[1],11,21,31);
-			READ_COORDINATE(Face3D.p[2],12,22,32);
-			READ_COORDINATE(Face3D.p[3],13,23,33);
+	next_group(ctx->infp, &ctx->Group); /* skip group 0 */
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->Face3D);
+			READ_COORDINATE(ctx->Face3D.p[0],10,20,30);
+			READ_COORDINATE(ctx->Face3D.p[1],11,21,31);
+			READ_COORDINATE(ctx->Face3D.p[2],12,22,32);
+			READ_COORDINATE(ctx->Face3D.p[3],13,23,33);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 
-void ReadTrace()
+void ReadTrace(DxfContext *ctx)
 {
-	Trace.Colour = -1;
-	Trace.Thickness = 0.0;
-	Trace.Normal =  ZUnit;
+	ctx->Trace.Colour = -1;
+	ctx->Trace.Thickness = 0.0;
+	ctx->Trace.Normal =  ZUnit;
 	
-	next_group(infp, &Group); /* skip group 0 */
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Trace);
-			READ_COORDINATE(Trace.p[0],10,20,30);
-			READ_COORDINATE(Trace.p[1],11,21,31);
-			READ_COORDINATE(Trace.p[3],12,22,32);
-			READ_COORDINATE(Trace.p[2],13,23,33);
-			READ_ENTITY_NORMAL(Trace.Normal);
-			READ_THICKNESS(Trace);
+	next_group(ctx->infp, &ctx->Group); /* skip group 0 */
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->Trace);
+			READ_COORDINATE(ctx->Trace.p[0],10,20,30);
+			READ_COORDINATE(ctx->Trace.p[1],11,21,31);
+			READ_COORDINATE(ctx->Trace.p[3],12,22,32);
+			READ_COORDINATE(ctx->Trace.p[2],13,23,33);
+			READ_ENTITY_NORMAL(ctx->Trace.Normal);
+			READ_THICKNESS(ctx->Trace);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 /* ------------------------------------------------------------------------ */
 
-void ReadVertex() /* PolyLine vertices only  */
+void ReadVertex(DxfContext *ctx) /* PolyLine vertices only  */
 {
 	int i;
 	
-	Vertex.Colour   = -1;
-	Vertex.Flags    = 0;
-	Vertex.VCount   = 0;
-	Vertex.Bulge    = 0.0;
-	Vertex.Location = ZeroVector;
-	for(i=0;i<4;i++) Vertex.Face[i] = 0;
+	ctx->Vertex.Colour   = -1;
+	ctx->Vertex.Flags    = 0;
+	ctx->Vertex.VCount   = 0;
+	ctx->Vertex.Bulge    = 0.0;
+	ctx->Vertex.Location = ZeroVector;
+	for(i=0;i<4;i++) ctx->Vertex.Face[i] = 0;
 	
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Vertex);
-			READ_DOUBLE(42, Vertex.Bulge);
-			READ_FLAGS(Vertex);
-		case 71: Vertex.Face[0] = atoi(Group.value); Vertex.VCount++; break;
-		case 72: Vertex.Face[1] = atoi(Group.value); Vertex.VCount++; break;
-		case 73: Vertex.Face[2] = atoi(Group.value); Vertex.VCount++; break;
-		case 74: Vertex.Face[3] = atoi(Group.value); Vertex.VCount++; break;
-			READ_COORDINATE(Vertex.Location,10,20,30);
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_PART_OPTIONAL(ctx->Vertex);
+			READ_DOUBLE(42, ctx->Vertex.Bulge);
+			READ_FLAGS(ctx->Vertex);
+		case 71: case 72: case 73: case 74:
+			ctx->Vertex.Face[ctx->Group.code - 71] = group_atoi(&ctx->Group);
+			ctx->Vertex.VCount++;
+			break;
+			READ_COORDINATE(ctx->Vertex.Location,10,20,30);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
 /* Read in a polyline. If the polyline represents a 3D shape then read in  */
 /* the following vertices.  */
 
-void ReadLWPolyLine() {
+void ReadLWPolyLine(DxfContext *ctx) {
 	int use_vertex = 1;
+	unsigned int n;
 	
-	PolyLine.Colour = -1;
-	PolyLine.Width = 0.0;
-	PolyLine.Thickness = 0.0;
-	PolyLine.Elevation = 0.0;
-	PolyLine.Normal =  ZUnit;
-	PolyLine.Flags = 0;
-	PolyLine.Type = et_PLINE; /* default: simple pline */
-	PolyLine.M_Count = 0;
-	PolyLine.N_Count = 0;
-	PolyLine.V_Count = 0;
-	PolyLine.F_Count = 0;
-
-	if(Mesh == NULL) {
-		mesh_size = CHUNKSIZE;
-		Mesh = malloc(sizeof(Point3) * CHUNKSIZE);
-		Bulges = malloc(sizeof(double) * CHUNKSIZE);
-	} else {
-		mesh_size = sizeof(Mesh) / sizeof(Point3);
+	ctx->PolyLine.Colour = -1;
+	ctx->PolyLine.Width = 0.0;
+	ctx->PolyLine.Thickness = 0.0;
+	ctx->PolyLine.Elevation = 0.0;
+	ctx->PolyLine.Normal =  ZUnit;
+	ctx->PolyLine.Flags = 0;
+	ctx->PolyLine.Type = et_PLINE; /* default: simple pline */
+	ctx->PolyLine.M_Count = 0;
+	ctx->PolyLine.N_Count = 0;
+	ctx->PolyLine.V_Count = 0;
+	ctx->PolyLine.F_Count = 0;
+
+	if(ctx->Mesh == NULL) {
+		ctx->mesh_size = CHUNKSIZE;
+		ctx->Mesh = malloc(sizeof(Point3) * CHUNKSIZE);
+		ctx->Bulges = malloc(sizeof(double) * CHUNKSIZE);
 	}
 
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(PolyLine);
-			READ_ENTITY_NORMAL(PolyLine.Normal);
-			READ_DOUBLE(38, PolyLine.Elevation);
-			READ_THICKNESS(PolyLine);
-			/*READ_DOUBLE(40, PolyLine.Width);*/
-			READ_WIDTH(PolyLine);
-			READ_FLAGS(PolyLine);
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->PolyLine);
+			READ_ENTITY_NORMAL(ctx->PolyLine.Normal);
+			READ_DOUBLE(38, ctx->PolyLine.Elevation);
+			READ_THICKNESS(ctx->PolyLine);
+			/*READ_DOUBLE(40, ctx->PolyLine.Width);*/
+			READ_WIDTH(ctx->PolyLine);
+			READ_FLAGS(ctx->PolyLine);
 		case 10: /* count starts with 1: preincrement */
-			if(PolyLine.V_Count + 2 > mesh_size) {
+			if(ctx->PolyLine.V_Count + 2 > ctx->mesh_size) {
 				Point3 *new_mesh;
 				double *new_bulges;
-				mesh_size += CHUNKSIZE;
-				new_mesh = realloc(Mesh, sizeof(Point3) * mesh_size);
-				new_bulges = realloc(Bulges, sizeof(double) * mesh_size);
+				ctx->mesh_size += CHUNKSIZE;
+				new_mesh = realloc(ctx->Mesh, sizeof(Point3) * ctx->mesh_size);
+				new_bulges = realloc(ctx->Bulges, sizeof(double) * ctx->mesh_size);
 				if(new_mesh == NULL || new_bulges == NULL) {
-					fprintf(stderr, "Error: Out of memory.\n");
-					exit(1);
+					DxfFail(ctx, "Out of memory");
 				}
-				Mesh = new_mesh;
-				Bulges = new_bulges;
+				ctx->Mesh = new_mesh;
+				ctx->Bulges = new_bulges;
 			}
-			Mesh[++PolyLine.V_Count].x = atof(Group.value);
+			ctx->Mesh[++ctx->PolyLine.V_Count].x = group_atof(&ctx->Group);
 			/* initialize the rest of the vertex to something */
-			Mesh[PolyLine.V_Count].y = 0.0;
-			Mesh[PolyLine.V_Count].z = PolyLine.Elevation;
-			Bulges[PolyLine.V_Count] = 0.0;
+			ctx->Mesh[ctx->PolyLine.V_Count].y = 0.0;
+			ctx->Mesh[ctx->PolyLine.V_Count].z = ctx->PolyLine.Elevation;
+			ctx->Bulges[ctx->PolyLine.V_Count] = 0.0;
 			use_vertex = 1;
 			break;
 		case 20:
-			if(PolyLine.V_Count == 0) {
+			if(ctx->PolyLine.V_Count == 0) {
 				fprintf(stderr,
 					"Group 20 before first group 10 in LWPOLYLINE."
 					" Skipping group on line %d.\n",
-					Group.line);
+					ctx->Group.line);
 				continue;
 			}
-			Mesh[PolyLine.V_Count].y = atof(Group.value);
-			if(PolyLine.V_Count > 1
-				&& (fabs(Mesh[PolyLine.V_Count].x - (Mesh[PolyLine.V_Count-1]).x)
+			ctx->Mesh[ctx->PolyLine.V_Count].y = group_atof(&ctx->Group);
+			n = ctx->PolyLine.V_Count;
+			if(n > 1
+				&& (fabs(ctx->Mesh[n].x - (ctx->Mesh[n-1]).x)
 					< EPSILON /* one axis diff is enough */
-					&& fabs(Mesh[PolyLine.V_Count].y - (Mesh[PolyLine.V_Count-1]).y)
+					&& fabs(ctx->Mesh[n].y - (ctx->Mesh[n-1]).y)
 						< EPSILON)) {
 				/* two virtually identical points, ignore the last one */
-				PolyLine.V_Count--;
+				ctx->PolyLine.V_Count--;
 				use_vertex = 0;
 			}
 			break;
 		case 42:
-			if(PolyLine.V_Count == 0) {
+			if(ctx->PolyLine.V_Count == 0) {
 				fprintf(stderr,
 					"Group 42 before first group 10 in LWPOLYLINE."
 					" Skipping group on line %d.\n",
-					Group.line);
+					ctx->Group.line);
 				continue;
 			}
-			if(use_vertex) Bulges[PolyLine.V_Count] = atof(Group.value);
+			if(use_vertex) ctx->Bulges[ctx->PolyLine.V_Count] = group_atof(&ctx->Group);
 			break;
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
-	if(PolyLine.Width > 0.0) PolyLine.Type = et_WPLINE;
-	else if(PolyLine.Flags & 1) PolyLine.Type = et_POLYGON;
-	else if(PolyLine.Thickness == 0.0) PolyLine.Type = et_NONE;
+	if(ctx->PolyLine.Width > 0.0) ctx->PolyLine.Type = et_WPLINE;
+	else if(ctx->PolyLine.Flags & 1) ctx->PolyLine.Type = et_POLYGON;
+	else if(ctx->PolyLine.Thickness == 0.0) ctx->PolyLine.Type = et_NONE;
 	/* 1.1 - if it is open, unwide, and flat, don't convert it */
-	if(PolyLine.V_Count) PolyLine.V_Count++;
+	if(ctx->PolyLine.V_Count) ctx->PolyLine.V_Count++;
 }
 
 
 /* Read in a polyline. If the polyline represents a 3D shape then read in  */
 /* the following vertices.  */
 
-void ReadPolyLine() {
+void ReadPolyLine(DxfContext *ctx) {
 	unsigned int i,VerticesFollow;
 	unsigned int Face_Count=0;
 	unsigned int Vertex_Count = 1; /* Vertices are indexed from 1  */ 
 #ifdef WITH_SMOOTHING	
 	unsigned int M,N,M_wrap,N_wrap,j,k;
 	Point3 p,p1,p2,p3,nold;
+	xface Fc;
 #endif
 	
-	PolyLine.Colour = -1;
-	PolyLine.Width = 0.0;
-	PolyLine.Thickness = 0.0;
-	PolyLine.Normal =  ZUnit;
-	PolyLine.Flags = 0;
-	PolyLine.Type = et_PLINE; /* default: simple pline */
-	PolyLine.M_Count = 0;
-	PolyLine.N_Count = 0;
-	PolyLine.V_Count = 0;
-	PolyLine.F_Count = 0;
+	ctx->PolyLine.Colour = -1;
+	ctx->PolyLine.Width = 0.0;
+	ctx->PolyLine.Thickness = 0.0;
+	ctx->PolyLine.Normal =  ZUnit;
+	ctx->PolyLine.Flags = 0;
+	ctx->PolyLine.Type = et_PLINE; /* default: simple pline */
+	ctx->PolyLine.M_Count = 0;
+	ctx->PolyLine.N_Count = 0;
+	ctx->PolyLine.V_Count = 0;
+	ctx->PolyLine.F_Count = 0;
 	VerticesFollow = 0;
 
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(PolyLine);
-			READ_ENTITY_NORMAL(PolyLine.Normal);
-			READ_THICKNESS(PolyLine);
-			/*READ_DOUBLE(40, PolyLine.Width);*/
-			READ_WIDTH(PolyLine);
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->PolyLine);
+			READ_ENTITY_NORMAL(ctx->PolyLine.Normal);
+			READ_THICKNESS(ctx->PolyLine);
+			/*READ_DOUBLE(40, ctx->PolyLine.Width);*/
+			READ_WIDTH(ctx->PolyLine);
 			READ_INT(66, VerticesFollow);
-			READ_FLAGS(PolyLine);
-			READ_INT(71, PolyLine.M_Count);
-			READ_INT(72, PolyLine.N_Count);
+			READ_FLAGS(ctx->PolyLine);
+			READ_INT(71, ctx->PolyLine.M_Count);
+			READ_INT(72, ctx->PolyLine.N_Count);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
+	/* the vertices are skipped as unknown entities */
+	if(ctx->Hidden) return;
 	
-	if(Mesh == NULL) {
-		mesh_size = CHUNKSIZE;
-		Mesh = malloc(sizeof(Point3) * mesh_size);
-		Bulges = malloc(sizeof(double) * mesh_size);
+	if(ctx->Mesh == NULL) {
+		ctx->mesh_size = CHUNKSIZE;
+		ctx->Mesh = malloc(sizeof(Point3) * ctx->mesh_size);
+		ctx->Bulges = malloc(sizeof(double) * ctx->mesh_size);
 	}
-	if(Faces == NULL) {
-		faces_size = CHUNKSIZE;
-		Faces = malloc(sizeof(xface) * faces_size);
-		VCount = malloc(sizeof(int) * faces_size);
+	if(ctx->Faces == NULL) {
+		ctx->faces_size = CHUNKSIZE;
+		ctx->Faces = malloc(sizeof(xface) * ctx->faces_size);
+		ctx->VCount = malloc(sizeof(int) * ctx->faces_size);
 	}
-	if(Mesh == NULL || Bulges == NULL || Faces == NULL || VCount == NULL) {
-		fprintf(stderr, "Error: Out of memory\n");
-		exit(1);
+	if(ctx->Mesh == NULL || ctx->Bulges == NULL
+			|| ctx->Faces == NULL || ctx->VCount == NULL) {
+		DxfFail(ctx, "Out of memory");
 	}
 #ifdef WITH_SMOOTHING
-	if(Normals == NULL) {
-		normals_size = CHUNK_SIZE;
-		Normals = malloc(sizeof(Point3) * mesh_size);
+	if(ctx->Normals == NULL) {
+		ctx->normals_size = CHUNK_SIZE;
+		ctx->Normals = malloc(sizeof(Point3) * ctx->mesh_size);
 	}
-	if(Normals == NULL) {
-		fprintf(stderr, "Error: Out of memory\n");
-		exit(1);
+	if(ctx->Normals == NULL) {
+		DxfFail(ctx, "Out of memory");
 	}
 #endif
 
-	if(PolyLine.Flags & 8) PolyLine.Type = et_NONE; /* 3d poly */
-	else if(PolyLine.Flags & 16) PolyLine.Type = et_PMESH;
-	else if(PolyLine.Flags & 64) PolyLine.Type = et_PFACE;
-	else if(PolyLine.Width > 0.0) PolyLine.Type = et_WPLINE;
-	else if(PolyLine.Flags & 1)  PolyLine.Type = et_POLYGON;
-	/* else if (PolyLine.Thickness == 0.0) PolyLine.Type = et_NONE; */
+	if(ctx->PolyLine.Flags & 8) ctx->PolyLine.Type = et_NONE; /* 3d poly */
+	else if(ctx->PolyLine.Flags & 16) ctx->PolyLine.Type = et_PMESH;
+	else if(ctx->PolyLine.Flags & 64) ctx->PolyLine.Type = et_PFACE;
+	else if(ctx->PolyLine.Width > 0.0) ctx->PolyLine.Type = et_WPLINE;
+	else if(ctx->PolyLine.Flags & 1)  ctx->PolyLine.Type = et_POLYGON;
+	/* else if (ctx->PolyLine.Thickness == 0.0) ctx->PolyLine.Type = et_NONE; */
 	/* 1.1 - if it is open, unwide, and flat, don't convert it */
 
-	Mesh[0] = ZeroVector;
+	ctx->Mesh[0] = ZeroVector;
 #ifdef WITH_SMOOTHING	
-	M=PolyLine.M_Count;
-	N=PolyLine.N_Count;
-	if (PolyLine.Flags & 1)  M_wrap = 1; else M_wrap = 0;
-	if (PolyLine.Flags & 32) N_wrap = 1; else N_wrap = 0;
+	M=ctx->PolyLine.M_Count;
+	N=ctx->PolyLine.N_Count;
+	if (ctx->PolyLine.Flags & 1)  M_wrap = 1; else M_wrap = 0;
+	if (ctx->PolyLine.Flags & 32) N_wrap = 1; else N_wrap = 0;
 #endif
 	
 	/* Read Vertices and faces, and calculate normals  */
 	if (VerticesFollow) {
-		while (!feof(infp) && strcmp(Group.value,SEQEND) != 0) {
-			ReadVertex();
+		while (!DxfEof(ctx->infp) && ctx->Group.keyword != kw_SEQEND) {
+			ReadVertex(ctx);
 			
 			/* vertices  */
-			if (Vertex.Flags & 128 && !(Vertex.Flags & 64)) {
+			if (ctx->Vertex.Flags & 128 && !(ctx->Vertex.Flags & 64)) {
 				/* Polyface mesh face  */
 				/* Make sure our arrays are still big enough */
-				if(Face_Count >= faces_size) {
+				if(Face_Count >= ctx->faces_size) {
 					void *newfaces, *newvcount;
-					faces_size += CHUNKSIZE;
-					newfaces = realloc(Faces, sizeof(xface) * faces_size);
-					newvcount = realloc(VCount, sizeof(int) * faces_size);
+					ctx->faces_size += CHUNKSIZE;
+					newfaces = realloc(ctx->Faces, sizeof(xface) * ctx->faces_size);
+					newvcount = realloc(ctx->VCount, sizeof(int) * ctx->faces_size);
 					if(newfaces == NULL || newvcount == NULL) {
-						fprintf(stderr, "Error: Out of memory\n");
-						exit(1);
+						DxfFail(ctx, "Out of memory");
 					}
-					Faces = newfaces;
-					VCount = newvcount;
+					ctx->Faces = newfaces;
+					ctx->VCount = newvcount;
 				}
 #ifdef WITH_SMOOTHING
-				if(Face_Count >= normals_size) {
+				if(Face_Count >= ctx->normals_size) {
 					void *newnormals;
-					normals_size += CHUNKSIZE;
-					newnormals = realloc(Normals, sizeof(Point3) * normals_size);
+					ctx->normals_size += CHUNKSIZE;
+					newnormals = realloc(ctx->Normals, sizeof(Point3) * ctx->normals_size);
 					if(newnormals == NULL) {
-						fprintf(stderr, "Error: Out of memory\n");
-						exit(1);
+						DxfFail(ctx, "Out of memory");
 					}
-					Normals = newnormals
+					ctx->Normals = newnormals
 				}
 #endif
 				/* copy vertex indices and number */
-				for (i=0;i<Vertex.VCount;i++) {
-					Faces[Face_Count][i] = Vertex.Face[i];
-					VCount[Face_Count]   = Vertex.VCount;
+				for (i=0;i<ctx->Vertex.VCount;i++) {
+					ctx->Faces[Face_Count][i] = ctx->Vertex.Face[i];
+					ctx->VCount[Face_Count]   = ctx->Vertex.VCount;
 				}
 #ifdef WITH_SMOOTHING	
-				if(Options.smooth) { /* Calculate normal  */
-					for (i=0;i<Vertex.VCount;i++) {
+				if(ctx->Options.smooth) { /* Calculate normal  */
+					for (i=0;i<ctx->Vertex.VCount;i++) {
 						j = i-1;
-						if (j==-1) j=Vertex.VCount-1;
-						nold = Normals[abs(Faces[Face_Count][i])];
-						p   = Mesh[abs(Faces[Face_Count][i])];
-						p1  = Mesh[abs(Faces[Face_Count][j])];
-						p2  = Mesh[abs(Faces[Face_Count][(i+1)%Vertex.VCount])];
+						if (j==-1) j=ctx->Vertex.VCount-1;
+						nold = ctx->Normals[abs(ctx->Faces[Face_Count][i])];
+						p   = ctx->Mesh[abs(ctx->Faces[Face_Count][i])];
+						p1  = ctx->Mesh[abs(ctx->Faces[Face_Count][j])];
+						p2  = ctx->Mesh[abs(ctx->Faces[Face_Count][(i+1)%ctx->Vertex.VCount])];
 						p3  = Unit((p1-p)*(p-p2));
-						Normals[abs(Faces[Face_Count][i])] = Unit(p3+nold);
+						ctx->Normals[abs(ctx->Faces[Face_Count][i])] = Unit(p3+nold);
 					}
 				}
 #endif
 				Face_Count++;
-			} else if (!(Vertex.Flags & 16)) {
+			} else if (!(ctx->Vertex.Flags & 16)) {
 				/* vertex point  */
-				if(PolyLine.Type == et_PFACE
-					|| PolyLine.Type == et_PMESH
+				if(ctx->PolyLine.Type == et_PFACE
+					|| ctx->PolyLine.Type == et_PMESH
 					|| Vertex_Count == 1 /* fist one */
 						/* only use a pline or polygon vertex if it is different
 						from the previous one */
 					|| (Vertex_Count > 1
-						&& (fabs(Mesh[Vertex_Count].x - (Mesh[Vertex_Count-1]).x)
+						&& (fabs(ctx->Mesh[Vertex_Count].x - (ctx->Mesh[Vertex_Count-1]).x)
 							> EPSILON /* one axis diff is enough */
-							|| fabs(Mesh[Vertex_Count].y - (Mesh[Vertex_Count-1]).y)
+							|| fabs(ctx->Mesh[Vertex_Count].y - (ctx->Mesh[Vertex_Count-1]).y)
 								> EPSILON)
 					)) {
 					/* Make sure our arrays are still big enough */
-					if(Vertex_Count >= mesh_size) {
+					if(Vertex_Count >= ctx->mesh_size) {
 						void *newmesh, *newbulges;
-						mesh_size += CHUNKSIZE;
-						newmesh = realloc(Mesh, sizeof(Point3) * mesh_size);
-						newbulges = realloc(Bulges, sizeof(double) * mesh_size);
+						ctx->mesh_size += CHUNKSIZE;
+						newmesh = realloc(ctx->Mesh, sizeof(Point3) * ctx->mesh_size);
+						newbulges = realloc(ctx->Bulges, sizeof(double) * ctx->mesh_size);
 						if(newmesh == NULL || newbulges == NULL) {
-							fprintf(stderr, "Error: Out of memory\n");
-							exit(1);
+							DxfFail(ctx, "Out of memory");
 						}
-						Mesh = newmesh;
-						Bulges = newbulges;
+						ctx->Mesh = newmesh;
+						ctx->Bulges = newbulges;
 					}
 #ifdef WITH_SMOOTHING	
-					if(Vertex_Count >= normals_size) {
+					if(Vertex_Count >= ctx->normals_size) {
 						void *newnormals;
-						normals_size += CHUNKSIZE;
-						newnormals = realloc(Normals, sizeof(Point3) * normals_size);
+						ctx->normals_size += CHUNKSIZE;
+						newnormals = realloc(ctx->Normals, sizeof(Point3) * ctx->normals_size);
 						if(newnormals == NULL) {
-							fprintf(stderr, "Error: Out of memory\n");
-							exit(1);
+							DxfFail(ctx, "Out of memory");
 						}
-						Normals = newnormals;
+						ctx->Normals = newnormals;
 					}
-					Normals[Vertex_Count] = ZeroVector;
+					ctx->Normals[Vertex_Count] = ZeroVector;
 #endif
-					Mesh[Vertex_Count]    = Vertex.Location;
-					Bulges[Vertex_Count]  = Vertex.Bulge;
+					ctx->Mesh[Vertex_Count]    = ctx->Vertex.Location;
+					ctx->Bulges[Vertex_Count]  = ctx->Vertex.Bulge;
 					Vertex_Count++;
 				}
 			}
@@ -878,7 +1193,7 @@ void ReadPolyLine() {
 	
 	/* Calculate normals for polygon mesh  */
 #ifdef WITH_SMOOTHING	
-	if (Options.smooth && PolyLine.Flags & 16) {
+	if (ctx->Options.smooth && ctx->PolyLine.Flags & 16) {
 		for (i=1;i<N+N_wrap;i++) {
 			for (j=1;j<M+M_wrap;j++) {
 				Fc[0] = (j%M)*N+(i%N)+1;
@@ -889,227 +1204,422 @@ void ReadPolyLine() {
 				/* Account for meshes that don't wrap  */
 				if (!((!N_wrap && i==N) || (!M_wrap && j==M))) {
 					
-					p    = Mesh[Fc[1]];
-					p1   = Mesh[Fc[0]];
-					p2   = Mesh[Fc[2]];
+					p    = ctx->Mesh[Fc[1]];
+					p1   = ctx->Mesh[Fc[0]];
+					p2   = ctx->Mesh[Fc[2]];
 					/* Avoid degeneracy  */
-					if IS_SAMEPT(p,p1) p1 = Mesh[Fc[3]];
-					else if IS_SAMEPT(p,p2) p2 = Mesh[Fc[3]];
+					if IS_SAMEPT(p,p1) p1 = ctx->Mesh[Fc[3]];
+					else if IS_SAMEPT(p,p2) p2 = ctx->Mesh[Fc[3]];
 					p3 = Unit((p2-p)*(p-p1));
 					
 					/* Assume all quads are planar since we  */
 					/* don't know how they are triangulated.  */
 					for (k=0;k<4;k++) {
-						nold = Normals[Fc[k]];
-						Normals[Fc[k]] = Unit(p3+nold);
+						nold = ctx->Normals[Fc[k]];
+						ctx->Normals[Fc[k]] = Unit(p3+nold);
 					}
 				}
 			}
 		}
 	}
 #endif
-	PolyLine.V_Count = Vertex_Count;
-	PolyLine.F_Count = Face_Count;
+	ctx->PolyLine.V_Count = Vertex_Count;
+	ctx->PolyLine.F_Count = Face_Count;
 }
 
-void ReadInsert()
+void ReadInsert(DxfContext *ctx)
 {
-	Insert.Attributes = 0;
-	Insert.Rotation = 0;
-	Insert.ColumnCount = 1;
-	Insert.RowCount = 1;
-	Insert.ColumnSpacing = 0;
-	Insert.RowSpacing = 0;
-	Insert.Scale.x = 1.0;
-	Insert.Scale.y = 1.0;
-	Insert.Scale.z = 1.0;
-	Insert.Normal  = ZUnit;
+	ctx->Insert.Attributes = 0;
+	ctx->Insert.Rotation = 0;
+	ctx->Insert.ColumnCount = 1;
+	ctx->Insert.RowCount = 1;
+	ctx->Insert.ColumnSpacing = 0;
+	ctx->Insert.RowSpacing = 0;
+	ctx->Insert.Scale.x = 1.0;
+	ctx->Insert.Scale.y = 1.0;
+	ctx->Insert.Scale.z = 1.0;
+	ctx->Insert.Normal  = ZUnit;
 	
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Insert);
-			READ_INT(66, Insert.Attributes);
-			READ_NAME(Insert);
-			READ_ROTATION(50, Insert.Rotation);
-			READ_INT(70, Insert.ColumnCount);
-			READ_INT(71, Insert.RowCount);
-			READ_DOUBLE(44, Insert.ColumnSpacing);
-			READ_DOUBLE(45, Insert.RowSpacing);
-			READ_COORDINATE(Insert.Insertion,10,20,30);
-			READ_COORDINATE(Insert.Scale,41,42,43);
-			READ_COORDINATE(Insert.Normal,210,220,230);
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_ENTITY_OPTIONAL(ctx->Insert);
+			READ_INT(66, ctx->Insert.Attributes);
+			READ_NAME(ctx->Insert);
+			READ_ROTATION(50, ctx->Insert.Rotation);
+			READ_INT(70, ctx->Insert.ColumnCount);
+			READ_INT(71, ctx->Insert.RowCount);
+			READ_DOUBLE(44, ctx->Insert.ColumnSpacing);
+			READ_DOUBLE(45, ctx->Insert.RowSpacing);
+			READ_COORDINATE(ctx->Insert.Insertion,10,20,30);
+			READ_COORDINATE(ctx->Insert.Scale,41,42,43);
+			READ_COORDINATE(ctx->Insert.Normal,210,220,230);
 		}
-		next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group);
 	}
 
 	/* Attribute entities  */
-	if (Insert.Attributes == 1) {
-		while (!feof(infp) && Group.code != 0
-			&& strcmp(Group.value,SEQEND) != 0) {
-			next_group(infp, &Group);
+	if (ctx->Insert.Attributes == 1) {
+		while (!DxfEof(ctx->infp) && ctx->Group.code != 0
+			&& ctx->Group.keyword != kw_SEQEND) {
+			next_group(ctx->infp, &ctx->Group);
 		}
-		next_group(infp, &Group); /* move over SEQEND data */
-		while (!feof(infp) && Group.code != 0) {
-			next_group(infp, &Group);
+		next_group(ctx->infp, &ctx->Group); /* move over SEQEND data */
+		while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+			next_group(ctx->infp, &ctx->Group);
 		}
 	}
 }
 
 
-void findBlock()
+void findBlock(DxfContext *ctx)
 {
-	while (!feof(infp) && (Group.code != 0
-		|| (   (strcmp(Group.value, BLOCK)  != 0)
-			&& (strcmp(Group.value, ENDSEC) != 0)
-			&& (strcmp(Group.value, SECTION)!= 0)))) {
-		next_group(infp, &Group);
+	while (!DxfEof(ctx->infp) && (ctx->Group.code != 0
+		|| (   ctx->Group.keyword != kw_BLOCK
+			&& ctx->Group.keyword != kw_ENDSEC
+			&& ctx->Group.keyword != kw_SECTION))) {
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
-void findEndblk()
+void findEndblk(DxfContext *ctx)
 {
-	while (!feof(infp) && (Group.code != 0
-		|| (   (strcmp(Group.value, ENDBLK)   != 0)
-			&& (strcmp(Group.value, BLOCK)  != 0)
-			&& (strcmp(Group.value, ENDSEC) != 0)
-			&& (strcmp(Group.value, SECTION)!= 0)))) {
-		next_group(infp, &Group);
+	while (!DxfEof(ctx->infp) && (ctx->Group.code != 0
+		|| (   ctx->Group.keyword != kw_ENDBLK
+			&& ctx->Group.keyword != kw_BLOCK
+			&& ctx->Group.keyword != kw_ENDSEC
+			&& ctx->Group.keyword != kw_SECTION))) {
+		SkipTo(ctx, BlockStop);
+		next_group(ctx->infp, &ctx->Group);
 	}
 }
 
-void readBlock()
+/* Read the block header. Block.Body is left pointing at the first
+   entity, if the input is in memory. */
+void readBlock(DxfContext *ctx)
 {
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		switch (Group.code) {
-			READ_ENTITY_OPTIONAL(Block);
-			READ_NAME(Block);
-			READ_FLAGS(Block);
-			READ_COORDINATE(Block.Base,41,42,43);
+	ctx->Block.Body = ctx->infp->pos;
+	ctx->Block.BodyLine = ctx->Group.line;
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		switch (ctx->Group.code) {
+			READ_PART_OPTIONAL(ctx->Block);
+			READ_NAME(ctx->Block);
+			READ_FLAGS(ctx->Block);
+			READ_COORDINATE(ctx->Block.Base,41,42,43);
 		}
-		next_group(infp, &Group);
+		ctx->Block.Body = ctx->infp->pos;
+		ctx->Block.BodyLine = ctx->Group.line;
+		next_group(ctx->infp, &ctx->Group);
 	}		
 }
 
-void readEndblk()
+void readEndblk(DxfContext *ctx)
 {
-	next_group(infp, &Group);
-	while (!feof(infp) && Group.code != 0) {
-		next_group(infp, &Group);
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp) && ctx->Group.code != 0) {
+		next_group(ctx->infp, &ctx->Group);
 	}		
 }
 
-void ReadBlocks() {
+void ReadBlocks(DxfContext *ctx) {
 	int BlocksEnd = FALSE;
 	
-	while(!feof(infp) && BlocksEnd == 0) {
-		findBlock();
-		if(strcmp(Group.value,ENDSEC)  == 0) {
-			BlocksEnd = 1;
-		} else if(strcmp(Group.value,SECTION) == 0) {
+	while(!DxfEof(ctx->infp) && BlocksEnd == 0) {
+		findBlock(ctx);
+		switch(ctx->Group.keyword) {
+		case kw_ENDSEC:
+		case kw_SECTION:
 			BlocksEnd = 1;
-		} else if(strcmp(Group.value,BLOCK)  == 0) {
-			/*next_group(infp, &Group);*/
-			readBlock();
+			break;
+		case kw_BLOCK:
+			/*next_group(ctx->infp, &ctx->Group);*/
+			readBlock(ctx);
 			/* current group must be 0 now */
-			if (!InExcludeList(Block.Name)) {
-				ConvertBlockStart(Block);
-				ReadEntities(ENDBLK);
-				ConvertBlockEnd(Block);
+			if (InExcludeList(ctx->Block.Name)
+					|| (DxfInMemory(ctx->infp)
+						&& ConvertBlockDefer(ctx, ctx->Block) == 0)) {
+				findEndblk(ctx);
 			} else {
-				findEndblk();
+				ConvertBlockStart(ctx, ctx->Block);
+				ReadEntities(ctx, kw_ENDBLK);
+				ConvertBlockEnd(ctx, ctx->Block);
 			}
-			readEndblk();
-		} else if(strcmp(Group.value,ENDBLK) == 0) {
-			readEndblk();
-		} else  BlocksEnd = TRUE; /* something strange happened... */
+			readEndblk(ctx);
+			break;
+		case kw_ENDBLK:
+			readEndblk(ctx);
+			break;
+		default:
+			BlocksEnd = TRUE; /* something strange happened... */
+		}
 	}
 }
 
-void BlocksSection() {
-	next_group(infp, &Group); /* first block */
-	ReadBlocks();
+/* Read the entities of a block that was put off by ReadBlocks(),
+   when it is first inserted. That happens in the middle of reading
+   something else, whose state is kept. */
+void ReadBlockDef(DxfContext *ctx, BlockDef *blockdef)
+{
+	DxfInput *infp = ctx->infp, view;
+	Group_Type group = ctx->Group;
+	BlockDef *current = ctx->CurrentBlockDef;
+	int hidden = ctx->Hidden;
+
+	if(blockdef->source == NULL) return;
+	DxfInitRange(&view, infp, blockdef->source, blockdef->sourceend);
+	ctx->infp = &view;
+	blockdef->source = NULL; /* it might insert itself */
+	if(ctx->Options.verbose > 1) {
+		fprintf(stderr, "    Reading block definition: %s\n", blockdef->name);
+	}
+	ctx->CurrentBlockDef = blockdef;
+	ctx->Group.line = blockdef->sourceline;
+	next_group(ctx->infp, &ctx->Group);
+	ReadEntities(ctx, kw_ENDBLK);
+	BlockFinish(ctx, blockdef);
+	DxfCheckInput(ctx, &view);
+
+	ctx->infp = infp;
+	ctx->Group = group;
+	ctx->CurrentBlockDef = current;
+	ctx->Hidden = hidden;
+}
+
+void BlocksSection(DxfContext *ctx) {
+	next_group(ctx->infp, &ctx->Group); /* first block */
+	ReadBlocks(ctx);
 }
 
 /* ------------------------------------------------------------------------ */
 
-void ReadEntities(char* Terminate)
+void ReadEntities(DxfContext *ctx, KeywordType Terminate)
 {
 	
-	while (!feof(infp)) {		
-		if (strcmp(Group.value,Terminate) == 0) {
+	while (!DxfEof(ctx->infp)) {		
+		if (ctx->Group.code == 0 && ctx->Group.keyword == Terminate) {
 			break;
-		} else if (strcmp(Group.value,TEXT) == 0) {
-			ReadText();
-			if(Options.etypes[et_TEXT] > 0) {
-				ConvertTextEntity(Text);
+		}
+		ctx->Hidden = 0;
+		switch (ctx->Group.code == 0 ? ctx->Group.keyword : kw_NONE) {
+		case kw_TEXT:
+			ReadText(ctx);
+			if(!ctx->Hidden && ctx->Options.etypes[et_TEXT] > 0) {
+				ConvertTextEntity(ctx, ctx->Text);
 			}
-		} else if (strcmp(Group.value,ARC) == 0) {
-			ReadArc();
-			if((Options.etypes[et_ARC] > 0)
-					&& (Options.ignorethickness || Arc.Thickness)) {
-				ConvertArcEntity(Arc);
+			break;
+		case kw_ARC:
+			ReadArc(ctx);
+			if(!ctx->Hidden && (ctx->Options.etypes[et_ARC] > 0)
+					&& (ctx->Options.ignorethickness || ctx->Arc.Thickness)) {
+				ConvertArcEntity(ctx, ctx->Arc);
 			}
-		} else if (strcmp(Group.value,LINE) == 0) {
-			ReadLine();
-			if((Options.etypes[et_LINE] > 0)
-					&& (Options.ignorethickness || Line.Thickness)) {
-				ConvertLineEntity(Line);
+			break;
+		case kw_LINE:
+			ReadLine(ctx);
+			if(!ctx->Hidden && (ctx->Options.etypes[et_LINE] > 0)
+					&& (ctx->Options.ignorethickness || ctx->Line.Thickness)) {
+				ConvertLineEntity(ctx, ctx->Line);
 			}
-		} else if (strcmp(Group.value,CIRCLE) == 0) {
-			ReadCircle();
-			if(Options.etypes[et_CIRCLE] > 0) {
-				ConvertCircleEntity(Circle);
+			break;
+		case kw_CIRCLE:
+			ReadCircle(ctx);
+			if(!ctx->Hidden && ctx->Options.etypes[et_CIRCLE] > 0) {
+				ConvertCircleEntity(ctx, ctx->Circle);
 			}
-		} else if (strcmp(Group.value,POINT) == 0) {
-			ReadPoint();
-			if(Options.etypes[et_POINT] > 0) {
-				ConvertPointEntity(Point);
+			break;
+		case kw_POINT:
+			ReadPoint(ctx);
+			if(!ctx->Hidden && ctx->Options.etypes[et_POINT] > 0) {
+				ConvertPointEntity(ctx, ctx->Point);
 			}
-		} else if (strcmp(Group.value,FACE3D) == 0) {
-			Read3DFace();
-			if(Options.etypes[et_3DFACE] > 0) {
-				Convert3DFaceEntity(Face3D);
+			break;
+		case kw_3DFACE:
+			Read3DFace(ctx);
+			if(!ctx->Hidden && ctx->Options.etypes[et_3DFACE] > 0) {
+				Convert3DFaceEntity(ctx, ctx->Face3D);
 			}
-		} else if (strcmp(Group.value,TRACE) == 0) {
-			ReadTrace();
-			if(Options.etypes[et_TRACE] > 0) {
-				ConvertTraceEntity(Trace);
+			break;
+		case kw_TRACE:
+			ReadTrace(ctx);
+			if(!ctx->Hidden && ctx->Options.etypes[et_TRACE] > 0) {
+				ConvertTraceEntity(ctx, ctx->Trace);
 			}
-		} else if (strcmp(Group.value,SOLID) == 0) {
-			ReadTrace();
-			if(Options.etypes[et_SOLID] > 0) {
-				ConvertTraceEntity(Trace);
+			break;
+		case kw_SOLID:
+			ReadTrace(ctx);
+			if(!ctx->Hidden && ctx->Options.etypes[et_SOLID] > 0) {
+				ConvertTraceEntity(ctx, ctx->Trace);
 			}
-		} else if (strcmp(Group.value,POLYLINE) == 0) {
-			ReadPolyLine();
-			if(Options.etypes[PolyLine.Type] > 0) {
-				if(PolyLine.Type == et_PMESH
-					|| PolyLine.Type == et_PFACE) {
-					ConvertMesh(PolyLine,Mesh,Normals,Faces,VCount);
+			break;
+		case kw_POLYLINE:
+			ReadPolyLine(ctx);
+			if(!ctx->Hidden && ctx->Options.etypes[ctx->PolyLine.Type] > 0) {
+				if(ctx->PolyLine.Type == et_PMESH
+					|| ctx->PolyLine.Type == et_PFACE) {
+					ConvertMesh(ctx, ctx->PolyLine, ctx->Mesh, ctx->Normals,
+							ctx->Faces, ctx->VCount);
 				} else {
-					ConvertPline(PolyLine,Mesh,Bulges);
+					ConvertPline(ctx, ctx->PolyLine,ctx->Mesh,ctx->Bulges);
 				}
 			}
-		} else if (strcmp(Group.value,LWPOLYLINE) == 0) {
-			ReadLWPolyLine();
-			if(Options.etypes[PolyLine.Type] > 0) {
-				ConvertPline(PolyLine,Mesh,Bulges);
+			break;
+		case kw_LWPOLYLINE:
+			ReadLWPolyLine(ctx);
+			if(!ctx->Hidden && ctx->Options.etypes[ctx->PolyLine.Type] > 0) {
+				ConvertPline(ctx, ctx->PolyLine,ctx->Mesh,ctx->Bulges);
+			}
+			break;
+		case kw_INSERT:
+			ReadInsert(ctx);
+			if(!ctx->Hidden && !InExcludeList(ctx->Insert.Name)) {
+				ConvertInsertEntity(ctx, ctx->Insert);
+			}
+			break;
+		default: /* something we don't know, skip to the next entity */
+			do {
+				next_group(ctx->infp, &ctx->Group);
+			} while (!DxfEof(ctx->infp) && ctx->Group.code != 0);
+		}
+	}
+}
+
+/* Count a reference to block, and note it for a look at its
+   own inserts the first time. */
+static void AddReference(BlockDef *block, BlockDef **stack, size_t *depth)
+{
+	if(block->refs++ == 0) stack[(*depth)++] = block;
+}
+
+/* Count the references in the entities from start up to end, which
+   are those of owner, or the top level ones. They are read the same
+   way as when converting them, so that the same inserts count.
+   Returns non-zero if a line was too long. */
+static int ScanInserts(DxfContext *ctx, DxfInput *in,
+		const char *start, const char *end, int line, BlockDef *owner,
+		BlockDef **stack, size_t *depth)
+{
+	DxfInput view;
+	BlockDef *block;
+
+	DxfInitRange(&view, in, start, end);
+	ctx->infp = &view;
+	ctx->CurrentBlockDef = owner;
+	ctx->Group.line = line;
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp)) {
+		if (ctx->Group.code == 0 && (ctx->Group.keyword == kw_ENDBLK
+				|| ctx->Group.keyword == kw_ENDSEC
+				|| ctx->Group.keyword == kw_EOF)) {
+			break;
+		}
+		if (ctx->Group.code == 0 && ctx->Group.keyword == kw_INSERT) {
+			ctx->Hidden = 0;
+			ReadInsert(ctx);
+			if (!ctx->Hidden && !InExcludeList(ctx->Insert.Name)) {
+				block = GetBlockDef(ctx, ctx->Insert.Name);
+				if (block != NULL) AddReference(block, stack, depth);
+			}
+			continue;
+		}
+		SkipTo(ctx, InsertStop);
+		next_group(ctx->infp, &ctx->Group);
+	}
+	return DxfBad(&view);
+}
+
+/* For -m: before the entities in ctx->infp are converted, count the
+   references to each block that will be. These are the exported
+   inserts among the entities, and those in the blocks inserted from
+   there. The blocks are freed after the last one, see BlockRelease().
+   The input is read twice, so it must be in memory. */
+void CountBlockReferences(DxfContext *ctx)
+{
+	DxfInput *infp = ctx->infp;
+	Group_Type group = ctx->Group;
+	BlockDef **stack, *block, *current = ctx->CurrentBlockDef;
+	InsertDef *insert;
+	size_t depth = 0;
+	unsigned long count = 0;
+	int bad;
+
+	if(!DxfInMemory(infp)) {
+		if(ctx->Options.verbose > 0) {
+			fprintf(stderr, "  Can't read the input twice, keeping blocks\n");
+		}
+		return;
+	}
+	stack = (BlockDef**)malloc((NameTableCount(&ctx->BlockTable) + 1)
+			* sizeof(BlockDef*));
+	if(stack == NULL) DxfFail(ctx, "Out of memory");
+	bad = ScanInserts(ctx, infp, infp->pos, infp->end, ctx->Group.line,
+			NULL, stack, &depth);
+	while(depth > 0) {
+		block = stack[--depth];
+		count++;
+		if(block->source != NULL) {
+			bad |= ScanInserts(ctx, infp, block->source, block->sourceend,
+					block->sourceline, block, stack, &depth);
+		} else {
+			for(insert = block->inserts; insert; insert = insert->next) {
+				AddReference(insert->blockdef, stack, &depth);
 			}
-		} else if (strcmp(Group.value,INSERT) == 0) {
-			ReadInsert();
-			if(!InExcludeList(Insert.Name)) {
-				ConvertInsertEntity(Insert);
+		}
+	}
+	if(ctx->Options.verbose > 1) {
+		fprintf(stderr, "    %lu of %lu blocks are inserted\n", count,
+				(unsigned long)NameTableCount(&ctx->BlockTable));
+	}
+	free(stack);
+
+	ctx->infp = infp;
+	ctx->Group = group;
+	ctx->CurrentBlockDef = current;
+	ctx->Hidden = 0;
+	if(bad) DxfFail(ctx, NULL);
+}
+
+/* For +i with -j: write the block files for the top level inserts
+   among the entities from start up to end, before a child converts
+   them. Children can only refer to block files that exist, and the
+   chunks come here in order, so the files are written in the same
+   order as by a serial conversion. */
+void InstanceInserts(DxfContext *ctx, const char *start, const char *end,
+		int line)
+{
+	DxfInput *infp = ctx->infp, view;
+	Group_Type group = ctx->Group;
+	int hidden = ctx->Hidden;
+
+	DxfInitRange(&view, infp, start, end);
+	ctx->infp = &view;
+	ctx->Group.line = line;
+	next_group(ctx->infp, &ctx->Group);
+	while (!DxfEof(ctx->infp)) {
+		if (ctx->Group.code == 0 && ctx->Group.keyword == kw_INSERT) {
+			ctx->Hidden = 0;
+			ReadInsert(ctx);
+			if (!ctx->Hidden && !InExcludeList(ctx->Insert.Name)) {
+				InstanceInsertEntity(ctx, ctx->Insert);
 			}
-		} else next_group(infp, &Group);
+			continue;
+		}
+		SkipTo(ctx, InsertStop);
+		next_group(ctx->infp, &ctx->Group);
 	}
+	DxfCheckInput(ctx, &view);
+
+	ctx->infp = infp;
+	ctx->Group = group;
+	ctx->Hidden = hidden;
 }
 
-void EntitiesSection()
+void EntitiesSection(DxfContext *ctx)
 {
-	next_group(infp, &Group); /* first entity */
-	ReadEntities(ENDSEC);
+	if(ctx->Options.freeblocks) CountBlockReferences(ctx);
+	if(ParallelEntitiesSection(ctx, ctx->Options.workers) == 0) return;
+	next_group(ctx->infp, &ctx->Group); /* first entity */
+	ReadEntities(ctx, kw_ENDSEC);
 }
 
 
@@ -45,6 +45,7 @@ extern "C" {
 #endif
 
 #include "geomtypes.h" /* for Point3 */
+#include "dxfin.h"
 
 #ifndef FALSE
 #define FALSE 0
@@ -84,6 +85,7 @@ extern "C" {
 #define OBJECTS    "OBJECTS"
 #define VIEW       "VIEW"
 #define VPORT      "VPORT"
+#define LAYER      "LAYER"
 #define ENDTAB     "ENDTAB"
 #define ENDBLK     "ENDBLK"
 #define SEQEND     "SEQEND"
@@ -120,6 +122,20 @@ typedef enum {
 } EntityType;
 
 
+/* The values of code 0 and code 2 groups we know about */
+typedef enum {
+		kw_NONE, /* anything else */
+		kw_SECTION, kw_ENDSEC,
+		kw_HEADER, kw_CLASSES, kw_TABLES, kw_BLOCKS, kw_ENTITIES, kw_OBJECTS,
+		kw_TABLE, kw_ENDTAB, kw_VIEW, kw_VPORT, kw_LAYER,
+		kw_BLOCK, kw_ENDBLK, kw_SEQEND,
+		kw_CIRCLE, kw_POINT, kw_3DFACE, kw_TRACE, kw_SOLID, kw_LINE, kw_ARC,
+		kw_POLYLINE, kw_LWPOLYLINE, kw_TEXT, kw_INSERT,
+		kw_EOF,
+		kw_LAST
+} KeywordType;
+
+
 typedef enum {
 	none, bylayer, bycolor
 } ExportMode;
@@ -130,12 +146,16 @@ enum EndMode   {Open,Closed};
 typedef struct {
   int   line;
   int   code;
-  char  value[MAXLINE];
+  const char *value;  /* points into the input, not 0-terminated! */
+  size_t length;
+  KeywordType keyword; /* classified for codes 0 and 2, else kw_NONE */
+  int   numeric;  /* binary numbers are in number, value is empty then */
+  double number;
 } Group_Type;
 
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   char  Text[MAXSTRING];
@@ -157,7 +177,7 @@ typedef struct {
 } View_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   int   Flags;
@@ -168,7 +188,7 @@ typedef struct {
 } Vertex_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   Point3 Normal;
@@ -178,7 +198,7 @@ typedef struct {
 } Line_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   Point3 Normal;
@@ -190,7 +210,7 @@ typedef struct {
 } Arc_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   Point3 Normal;
@@ -200,7 +220,7 @@ typedef struct {
 } Circle_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   Point3 Center;
@@ -208,14 +228,14 @@ typedef struct {
 } Point_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   Point3 p[4];
 } Face3D_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   Point3 p[4];
@@ -224,7 +244,7 @@ typedef struct {
 } Trace_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   int   Flags;
@@ -240,7 +260,7 @@ typedef struct {
 } PolyLine_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   int   Attributes;
@@ -256,43 +276,51 @@ typedef struct {
 } Insert_Type;
 
 typedef struct {
-  char  Layer[MAXSTRING];
+  char  *Layer;  /* interned, from the layer table */
   char  Handle[MAXSTRING];
   int   Colour;
   char  Name[MAXSTRING];
   int   Flags;
   Point3 Base;
+  const char *Body; /* input in memory: where the entities start */
+  int   BodyLine;
 } Block_Type;
 
 
-extern Group_Type    Group;
-extern View_Type     View;
-extern Vertex_Type   Vertex;
-extern Line_Type     Line;
-extern Arc_Type      Arc;
-extern Circle_Type   Circle;
-extern Point_Type    Point;
-extern Face3D_Type   Face3D;
-extern Trace_Type    Trace;
-extern PolyLine_Type PolyLine;
-extern Block_Type    Block;
-extern Insert_Type   Insert;
-
-void IgnoreSection();
-void HeaderSection();
-void TablesSection();
-void BlocksSection();
-void EntitiesSection();
-
-void ReadText();
-void ReadBlocks();
-void ReadVertex();
-void ReadCircle();
-void Read3DFace();
-void ReadPolyLine();
-void ReadInsert();
-void ReadEntities(char* Terminate);
-int next_group(FILE *fp, Group_Type *m);
+/* polyface mesh face, vertex indices */
+typedef int xface[4];
+
+/* all state of a conversion, see dxfconv.h */
+#ifndef _DXFCONTEXT_T
+#define _DXFCONTEXT_T
+typedef struct _DxfContext DxfContext;
+#endif
+struct _BlockDef;
+
+void IgnoreSection(DxfContext *ctx);
+void HeaderSection(DxfContext *ctx);
+void TablesSection(DxfContext *ctx);
+void BlocksSection(DxfContext *ctx);
+void EntitiesSection(DxfContext *ctx);
+void CountBlockReferences(DxfContext *ctx);
+void InstanceInserts(DxfContext *ctx, const char *start, const char *end,
+		int line);
+
+void ReadText(DxfContext *ctx);
+void ReadBlocks(DxfContext *ctx);
+void ReadBlockDef(DxfContext *ctx, struct _BlockDef *blockdef);
+void ReadVertex(DxfContext *ctx);
+void ReadCircle(DxfContext *ctx);
+void Read3DFace(DxfContext *ctx);
+void ReadPolyLine(DxfContext *ctx);
+void ReadInsert(DxfContext *ctx);
+void ReadEntities(DxfContext *ctx, KeywordType Terminate);
+void RegulateName(char *name);
+int next_group(DxfInput *in, Group_Type *m);
+int group_is(Group_Type *m, const char *s);
+double group_atof(Group_Type *m);
+int group_atoi(Group_Type *m);
+void group_strcpy(char *dst, Group_Type *m, size_t size);
 
 #ifdef __cplusplus
 	}
@@ -27,52 +27,266 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-#include "dlltypes.h"
-#include "dllproto.h"
 #include "geomtypes.h"
 
 #include "tables.h"
+#include "geomproto.h"
+#include "dxfconv.h"
 
 
-static DLL_LIST BlockTable;
-static DLL_LIST LayerTable;
+#define NAMETABLE_MINSLOTS 64
 
-BlockDef *CurrentBlockDef = NULL;
-char *Layer0 = NULL;
+/* FNV-1a */
+static unsigned long NameHash(const char *name, size_t len)
+{
+	unsigned long h = 2166136261UL;
+
+	while(len-- > 0) {
+		h ^= (unsigned char)*name++;
+		h = (h * 16777619UL) & 0xffffffffUL;
+	}
+	return h;
+}
+
+
+/* (Re)build the slots for all entries, with at least nslots of them */
+static int NameTableRehash(NameTable *table, size_t nslots)
+{
+	size_t *slots, i, h;
+
+	slots = (size_t*)calloc(nslots, sizeof(size_t));
+	if(slots == NULL) return -1;
+	for(i = 0; i < table->count; i++) {
+		h = table->entries[i].hash & (nslots-1);
+		while(slots[h] != 0) h = (h + 1) & (nslots-1);
+		slots[h] = i + 1;
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->nslots = nslots;
+	return 0;
+}
+
+
+int NameTableInit(NameTable *table)
+{
+	table->entries = NULL;
+	table->count = table->size = 0;
+	table->slots = NULL;
+	table->nslots = 0;
+	return NameTableRehash(table, NAMETABLE_MINSLOTS);
+}
 
-int InitTables(void)
+
+void NameTableFree(NameTable *table)
 {
-	DllSetup *BlockTableSetup;
-	DllSetup *LayerTableSetup;
+	free(table->entries);
+	free(table->slots);
+	table->entries = NULL;
+	table->slots = NULL;
+	table->count = table->size = table->nslots = 0;
+}
+
+
+/* Return the slot for the len bytes at name, which is empty if
+   they aren't there */
+static size_t NameTableFind(NameTable *table, const char *name, size_t len,
+		unsigned long hash)
+{
+	size_t h = hash & (table->nslots-1);
+	NameEntry *entry;
+
+	while(table->slots[h] != 0) {
+		entry = &table->entries[table->slots[h]-1];
+		if(entry->hash == hash && strncmp(entry->name, name, len) == 0
+				&& entry->name[len] == '\0') {
+			break;
+		}
+		h = (h + 1) & (table->nslots-1);
+	}
+	return h;
+}
+
+
+void *NameTableGet(NameTable *table, const char *name)
+{
+	return NameTableGetN(table, name, strlen(name));
+}
+
+
+/* Look up a name that isn't 0-terminated */
+void *NameTableGetN(NameTable *table, const char *name, size_t len)
+{
+	size_t h;
+
+	if(table->slots == NULL) return NULL;
+	h = NameTableFind(table, name, len, NameHash(name, len));
+	if(table->slots[h] == 0) return NULL;
+	return table->entries[table->slots[h]-1].data;
+}
+
 
-	BlockTableSetup = (DllSetup*)DllSetupList((int(*)(void*,void*))strcmp,
-			NULL, NULL, NULL); /* we'll never deallocate any of this */
-	if (!BlockTableSetup) {
-        fprintf(stderr, "Can't allocate block table setup\n.");
+/* Add name, or replace its data if it is there already.
+   Returns 0, or -1 if out of memory. */
+int NameTableAdd(NameTable *table, const char *name, void *data)
+{
+	size_t len = strlen(name);
+	unsigned long hash = NameHash(name, len);
+	NameEntry *entries;
+	size_t h, size;
+
+	if(table->slots == NULL) return -1;
+	h = NameTableFind(table, name, len, hash);
+	if(table->slots[h] != 0) {
+		table->entries[table->slots[h]-1].data = data;
+		return 0;
+	}
+	if(table->count == table->size) {
+		size = table->size ? table->size * 2 : NAMETABLE_MINSLOTS / 2;
+		entries = (NameEntry*)realloc(table->entries,
+				size * sizeof(NameEntry));
+		if(entries == NULL) return -1;
+		table->entries = entries;
+		table->size = size;
+	}
+	table->entries[table->count].name = name;
+	table->entries[table->count].data = data;
+	table->entries[table->count].hash = hash;
+	table->count++;
+	/* keep it at most half full */
+	if(table->count * 2 > table->nslots) {
+		if(NameTableRehash(table, table->nslots * 2) != 0) {
+			table->count--;
+			return -1;
+		}
+	} else {
+		table->slots[h] = table->count;
+	}
+	return 0;
+}
+
+
+static int CompareNameEntries(const void *a, const void *b)
+{
+	return strcmp(((const NameEntry*)a)->name, ((const NameEntry*)b)->name);
+}
+
+
+/* Sort the entries by name, for output in a predictable order.
+   New entries are appended at the end again. */
+void NameTableSort(NameTable *table)
+{
+	if(table->count < 2) return;
+	qsort(table->entries, table->count, sizeof(NameEntry),
+			CompareNameEntries);
+	(void)NameTableRehash(table, table->nslots);
+}
+
+
+int InitTables(DxfContext *ctx)
+{
+	if (NameTableInit(&ctx->BlockTable) != 0) {
+		fprintf(stderr, "Can't allocate block table\n.");
+		return -1;
+	}
+	if (NameTableInit(&ctx->LayerTable) != 0
+			|| NameTableInit(&ctx->RawLayerTable) != 0
+			|| NameTableInit(&ctx->BlockFiles) != 0
+			|| NameTableInit(&ctx->ShownLayers) != 0
+			|| NameTableInit(&ctx->HiddenLayers) != 0) {
+		fprintf(stderr, "Can't allocate layer table\n.");
 		return -1;
 	}
-    if ((BlockTable = DllNewList(BlockTableSetup)) == NULL) {
-        fprintf(stderr, "Can't allocate block table\n.");
-        return -1;
-    }
-	LayerTableSetup = (DllSetup*)DllSetupList((int(*)(void*,void*))strcmp,
-			NULL, NULL, NULL); /* we'll never deallocate any of this */
-	if (!LayerTableSetup) {
-        fprintf(stderr, "Can't allocate layer table setup\n.");
+	ctx->Layer0 = AddLayerDef(ctx, "l_0");
+	if(AddLayerList(ctx, &ctx->ShownLayers, ctx->Options.layers) != 0
+			|| AddLayerList(ctx, &ctx->HiddenLayers,
+				ctx->Options.xlayers) != 0) {
+		fprintf(stderr, "Can't allocate layer list\n.");
 		return -1;
 	}
-    if ((LayerTable = DllNewList(LayerTableSetup)) == NULL) {
-        fprintf(stderr, "Can't allocate layer table\n.");
-        return -1;
-    }
-	Layer0 = AddLayerDef("l_0");
 	return 0;
 }
 
-char *AddLayerDef(char *layer)
+
+static void FreeBlockGeometry(BlockDef *block)
+{
+	SimpleText *text, *nexttext;
+
+	/* the polys and cyls all live in the arenas */
+	PolyBufferFree(block->polybuf);
+	GeomArenaFree(&block->pending);
+	GeomArenaFree(&block->arena);
+	for(text = block->texts; text; text = nexttext) {
+		nexttext = text->next;
+		text->next = NULL;
+		SimpleTextFree(text);
+	}
+	block->polys = NULL;
+	block->polybuf = NULL;
+	block->cyls = NULL;
+	block->texts = NULL;
+	block->size = 0;
+}
+
+
+static void FreeBlock(BlockDef *block)
+{
+	InsertDef *insert, *nextinsert;
+
+	for(insert = block->inserts; insert; insert = nextinsert) {
+		nextinsert = insert->next;
+		free(insert);
+	}
+	FreeBlockGeometry(block);
+	/* still open if writing them failed */
+	if(block->instfp != NULL) fclose(block->instfp);
+	if(block->instfp0 != NULL) fclose(block->instfp0);
+	free(block->instfile);
+	free(block->instfile0);
+	free(block->name);
+	free(block);
+}
+
+
+/* The block names are freed with the blocks, and the layer
+   names are both key and data. The raw layer names point to
+   layer names, and the block file names belong to the blocks.
+   The shown and hidden layer names are their own copies. */
+void FreeTables(DxfContext *ctx)
+{
+	size_t i;
+
+	for(i = 0; i < NameTableCount(&ctx->BlockTable); i++) {
+		FreeBlock((BlockDef*)NameTableEntry(&ctx->BlockTable, i)->data);
+	}
+	NameTableFree(&ctx->BlockTable);
+	for(i = 0; i < NameTableCount(&ctx->LayerTable); i++) {
+		free(NameTableEntry(&ctx->LayerTable, i)->data);
+	}
+	NameTableFree(&ctx->LayerTable);
+	for(i = 0; i < NameTableCount(&ctx->RawLayerTable); i++) {
+		free((char*)NameTableEntry(&ctx->RawLayerTable, i)->name);
+	}
+	NameTableFree(&ctx->RawLayerTable);
+	for(i = 0; i < NameTableCount(&ctx->ShownLayers); i++) {
+		free(NameTableEntry(&ctx->ShownLayers, i)->data);
+	}
+	NameTableFree(&ctx->ShownLayers);
+	for(i = 0; i < NameTableCount(&ctx->HiddenLayers); i++) {
+		free(NameTableEntry(&ctx->HiddenLayers, i)->data);
+	}
+	NameTableFree(&ctx->HiddenLayers);
+	NameTableFree(&ctx->BlockFiles);
+	ctx->CurrentBlockDef = NULL;
+	ctx->Layer0 = NULL;
+}
+
+
+char *AddLayerDef(DxfContext *ctx, char *layer)
 {
 	char *newlayer = NULL;
 	size_t len;
@@ -84,23 +298,92 @@ char *AddLayerDef(char *layer)
 	if(newlayer == NULL) return NULL;
 
 	strncpy(newlayer, layer, len+1);
-	DllInsert(LayerTable, newlayer, newlayer);
+	if(NameTableAdd(&ctx->LayerTable, newlayer, newlayer) != 0) {
+		free(newlayer);
+		return NULL;
+	}
 	return newlayer;
 }
 
 
-char *GetLayerDef(char *layer)
+char *GetLayerDef(DxfContext *ctx, char *layer)
 {	
-	char *data = NULL;
+	char *data;
 
-	(void)DllSearch(LayerTable, layer, (void**)&data);
+	data = (char*)NameTableGet(&ctx->LayerTable, layer);
 	if(data == NULL) {
-		data = AddLayerDef(layer);
+		data = AddLayerDef(ctx, layer);
 	}
 	return data;
 }
 
 
+/* The layer name for len bytes of a raw layer name, as used for the
+   modifiers: prefixed and regulated. name must hold MAXSTRING bytes. */
+void LayerName(DxfContext *ctx, const char *raw, size_t len, char *name)
+{
+	size_t prefixlen = ctx->Options.prefixlen;
+
+	if(prefixlen) memcpy(name, ctx->Options.prefix, prefixlen);
+	if(len > MAXSTRING - 1 - prefixlen) len = MAXSTRING - 1 - prefixlen;
+	memcpy(name + prefixlen, raw, len);
+	name[prefixlen + len] = '\0';
+	RegulateName(name);
+}
+
+
+/* Add a raw layer name to the shown or hidden layers */
+int AddLayerFilter(DxfContext *ctx, NameTable *table,
+		const char *raw, size_t len)
+{
+	char name[MAXSTRING];
+	char *newname;
+
+	LayerName(ctx, raw, len, name);
+	if(NameTableGet(table, name) != NULL) return 0;
+	newname = (char*)malloc(strlen(name)+1);
+	if(newname == NULL) return -1;
+	strcpy(newname, name);
+	if(NameTableAdd(table, newname, newname) != 0) {
+		free(newname);
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Add the raw layer names of a comma separated list */
+int AddLayerList(DxfContext *ctx, NameTable *table, const char *list)
+{
+	const char *end;
+
+	if(list == NULL) return 0;
+	while(*list != '\0') {
+		end = strchr(list, ',');
+		if(end == NULL) end = list + strlen(list);
+		if(end > list && AddLayerFilter(ctx, table, list,
+					(size_t)(end - list)) != 0) {
+			return -1;
+		}
+		list = *end ? end + 1 : end;
+	}
+	return 0;
+}
+
+
+/* Entities on this layer are not exported. Without an include
+   list, only the hidden layers are checked. */
+int LayerHidden(DxfContext *ctx, const char *layer)
+{
+	if(NameTableCount(&ctx->HiddenLayers) > 0
+			&& NameTableGet(&ctx->HiddenLayers, layer) != NULL) {
+		return 1;
+	}
+	return NameTableCount(&ctx->ShownLayers) > 0
+			&& NameTableGet(&ctx->ShownLayers, layer) == NULL;
+}
+
+
 BlockDef *BlockAlloc(char *name)
 {
 	char *newname = NULL;
@@ -122,39 +405,52 @@ BlockDef *BlockAlloc(char *name)
 	blockdef->name = newname;
 	blockdef->inserts = NULL;
 	blockdef->polys = NULL;
+	blockdef->polybuf = NULL;
 	blockdef->texts = NULL;
 	blockdef->cyls = NULL;
+	blockdef->size = 0;
+	blockdef->instfile = NULL;
+	blockdef->instfile0 = NULL;
+	blockdef->instfp = NULL;
+	blockdef->instfp0 = NULL;
+	blockdef->instflags = 0;
+	blockdef->source = NULL;
+	blockdef->sourceend = NULL;
+	blockdef->sourceline = 0;
+	blockdef->refs = 0;
+	blockdef->bytes = 0;
+	GeomArenaInit(&blockdef->arena, BLOCK_ARENA_CHUNK);
+	GeomArenaInit(&blockdef->pending, BLOCK_ARENA_CHUNK);
 
 	return blockdef;
 }
 
 
-void AddBlockDef(BlockDef *block)
+void AddBlockDef(DxfContext *ctx, BlockDef *block)
 {
-	DllInsert(BlockTable, block->name, block);
+	(void)NameTableAdd(&ctx->BlockTable, block->name, block);
 }
 
 
-BlockDef *GetBlockDef(char *name)
+BlockDef *GetBlockDef(DxfContext *ctx, char *name)
 {	
-	BlockDef *block = NULL;
-
-	(void)DllSearch(BlockTable, name, (void**)&block);
-	return block;
+	return (BlockDef*)NameTableGet(&ctx->BlockTable, name);
 }
 
-InsertDef *InsertAlloc(char *name)
+InsertDef *InsertAlloc(DxfContext *ctx, char *name)
 {
 	InsertDef *insertdef = NULL;
 	BlockDef *blockdef = NULL;
 
-	blockdef = GetBlockDef(name);
+	blockdef = GetBlockDef(ctx, name);
 	if(blockdef == NULL) {
 		/* the block may be defined lower down in the file */
 		blockdef = BlockAlloc(name);
-		AddBlockDef(blockdef);
+		if(blockdef == NULL) return NULL;
+		AddBlockDef(ctx, blockdef);
 	}
-	if(blockdef == NULL) return NULL;
+	/* the first insert reads a block that was put off */
+	if(blockdef->source != NULL) ReadBlockDef(ctx, blockdef);
 
 	insertdef = (InsertDef *)malloc(sizeof(InsertDef));
 	if(insertdef == NULL) return NULL;
@@ -164,6 +460,9 @@ InsertDef *InsertAlloc(char *name)
 	insertdef->blockdef = blockdef;
 	insertdef->next = NULL;
 	insertdef->container = NULL;
+	insertdef->cols = insertdef->rows = 1;
+	insertdef->colspacing = insertdef->rowspacing = 0.0;
+	insertdef->hasxform = 0;
 
 	return insertdef;
 }
@@ -186,37 +485,126 @@ int BlockAddInsert(BlockDef *block, InsertDef *insert)
 }
 
 
+/* The polys and cyls are copied into the arenas of the block, in
+   their order, and the originals are freed. */
 int BlockAddPoly(BlockDef *block, Poly3 *poly)
 {
-	Poly3 *cur_id = poly;
+	Poly3 *cur_id, *copy, *first = NULL, *last = NULL;
 	
 	if(block == NULL) {
 		return -1;
 	}
-	while(cur_id->next != NULL) {
-		cur_id = cur_id->next;
+	for(cur_id = poly; cur_id != NULL; cur_id = cur_id->next) {
+		copy = Poly3Copy(&block->pending, cur_id, NULL);
+		if(copy == NULL) break;
+		if(last == NULL) first = copy;
+		else last->next = copy;
+		last = copy;
 	}
-	cur_id->next = block->polys;
-	block->polys = poly;
+	Poly3FreeList(poly);
+	if(last == NULL) return -1;
+	last->next = block->polys;
+	block->polys = first;
 
-	return 0;
+	return cur_id == NULL ? 0 : -1;
 }
 
 
 int BlockAddCyl(BlockDef *block, Cyl3 *cyl)
 {
-	Cyl3 *cur_id = cyl;
+	Cyl3 *cur_id, *copy, *first = NULL, *last = NULL;
 	
 	if(block == NULL) {
 		return -1;
 	}
-	while(cur_id->next != NULL) {
-		cur_id = cur_id->next;
+	for(cur_id = cyl; cur_id != NULL; cur_id = cur_id->next) {
+		copy = Cyl3Copy(&block->arena, cur_id, NULL);
+		if(copy == NULL) break;
+		if(last == NULL) first = copy;
+		else last->next = copy;
+		last = copy;
 	}
-	cur_id->next = block->cyls;
-	block->cyls = cyl;
+	Cyl3FreeList(cyl);
+	if(last == NULL) return -1;
+	last->next = block->cyls;
+	block->cyls = first;
 
-	return 0;
+	return cur_id == NULL ? 0 : -1;
+}
+
+
+/* The geometry of a block is collected newest first. Put it into
+   the order it is written out in, once the definition is complete,
+   and count it. The polys are packed into the buffer that inserts
+   are written from, after those of an earlier definition. */
+void BlockFinish(DxfContext *ctx, BlockDef *block)
+{
+	Poly3 *poly, *nextpoly, *polys = NULL;
+	Cyl3 *cyl, *nextcyl, *cyls = NULL;
+	SimpleText *text;
+	InsertDef *insert;
+	PolyBuffer *polybuf;
+	unsigned long bytes = block->arena.size;
+
+	for(poly = block->polys; poly; poly = nextpoly) {
+		nextpoly = poly->next;
+		poly->next = polys;
+		polys = poly;
+	}
+	if(polys != NULL) {
+		polybuf = PolyBufferAppend(block->polybuf, polys);
+		if(polybuf == NULL) {
+			DxfFail(ctx, "Out of memory");
+		}
+		block->polybuf = polybuf;
+	}
+	block->polys = NULL;
+	GeomArenaFree(&block->pending);
+	block->size = 0;
+	if(block->polybuf != NULL) {
+		block->size = block->polybuf->npolys;
+		bytes += block->polybuf->size;
+	}
+	for(cyl = block->cyls; cyl; cyl = nextcyl) {
+		nextcyl = cyl->next;
+		cyl->next = cyls;
+		cyls = cyl;
+		block->size++;
+	}
+	block->cyls = cyls;
+	for(text = block->texts; text; text = text->next) {
+		bytes += sizeof(SimpleText) + (text->s ? strlen(text->s) + 1 : 0);
+	}
+	for(insert = block->inserts; insert; insert = insert->next) {
+		bytes += sizeof(InsertDef);
+	}
+
+	/* a block defined twice is finished twice */
+	ctx->BlockBytes += bytes - block->bytes;
+	ctx->BlockTotal += bytes - block->bytes;
+	if(ctx->BlockBytes > ctx->BlockPeak) ctx->BlockPeak = ctx->BlockBytes;
+	block->bytes = bytes;
+}
+
+
+/* Drop a reference to block, once an insert of it is converted.
+   Without any left, its geometry is freed, and with it the
+   references to the blocks it inserts. Blocks that weren't counted
+   by CountBlockReferences() are kept. */
+void BlockRelease(DxfContext *ctx, BlockDef *block)
+{
+	InsertDef *insert, *nextinsert;
+
+	if(block->refs <= 0 || --block->refs > 0) return;
+	for(insert = block->inserts; insert; insert = nextinsert) {
+		nextinsert = insert->next;
+		BlockRelease(ctx, insert->blockdef);
+		free(insert);
+	}
+	block->inserts = NULL;
+	FreeBlockGeometry(block);
+	ctx->BlockBytes -= block->bytes;
+	block->bytes = 0;
 }
 
 
@@ -33,10 +33,15 @@ SOFTWARE.
     extern "C" {
 #endif
 
+#include <stdio.h>
+
 #include "geomtypes.h"
 
 #define MAXSTRING 256
 
+/* largest chunk of the arena holding the geometry of a block */
+#define BLOCK_ARENA_CHUNK (64L*1024L)
+
 typedef struct _BlockDef *BlockDefPtr;
 typedef struct _InsertDef *InsertDefPtr;
 
@@ -50,34 +55,94 @@ typedef struct _InsertDef{
 	double xscale;
 	double yscale;
 	double zscale;
+	int cols;          /* MINSERT array, 1 x 1 for a plain insert */
+	int rows;
+	double colspacing;
+	double rowspacing;
 	InsertDefPtr next;
 	InsertDefPtr container;
+	Matrix4 xform;    /* block to container, valid if hasxform */
+	Vector3 coloffset;/* array spacing in the container, ditto */
+	Vector3 rowoffset;
+	Matrix4 toworld;  /* block to WCS with output scale, set per traversal */
+	int hasxform;
 } InsertDef;
 
 
 typedef struct _BlockDef{
 	Point3 basept;
 	InsertDefPtr inserts;
-	Poly3 *polys;
-	Cyl3  *cyls;
+	Poly3 *polys;     /* read, in pending until BlockFinish() */
+	PolyBuffer *polybuf; /* the polys, packed by BlockFinish() */
+	Cyl3  *cyls;      /* copies in arena */
 	SimpleText *texts;
 	char *name;
+	long size;        /* number of polys and cyls, from BlockFinish() */
+	char *instfile;   /* instancing: file for the fixed layers */
+	char *instfile0;  /* and for layer 0 */
+	FILE *instfp;     /* open while they are written */
+	FILE *instfp0;
+	int instflags;
+	const char *source; /* entities not read yet, in the input in memory */
+	const char *sourceend;
+	int sourceline;
+	long refs;        /* -m: references still to be converted */
+	unsigned long bytes; /* memory of the geometry, from BlockFinish() */
+	GeomArena arena;
+	GeomArena pending;
 } BlockDef;
 
-extern BlockDef *CurrentBlockDef;
-extern char *Layer0;
+/* A hash table of names, which keeps the order of insertion.
+   The names are not copied, they must live as long as the table. */
+typedef struct {
+	const char *name;
+	void *data;
+	unsigned long hash;
+} NameEntry;
+
+typedef struct {
+	NameEntry *entries;  /* in order of insertion, or sorted */
+	size_t count;
+	size_t size;         /* allocated entries */
+	size_t *slots;       /* index+1 into entries, 0 if empty */
+	size_t nslots;       /* a power of 2 */
+} NameTable;
+
+#define NameTableCount(t) ((t)->count)
+#define NameTableEntry(t,i) (&(t)->entries[i])
+
+extern int NameTableInit(NameTable *table);
+extern void NameTableFree(NameTable *table);
+extern void *NameTableGet(NameTable *table, const char *name);
+extern void *NameTableGetN(NameTable *table, const char *name, size_t len);
+extern int NameTableAdd(NameTable *table, const char *name, void *data);
+extern void NameTableSort(NameTable *table);
+
+#ifndef _DXFCONTEXT_T
+#define _DXFCONTEXT_T
+typedef struct _DxfContext DxfContext;
+#endif
 
-extern int InitTables(void);
-extern char *AddLayerDef(char *layer);
-extern char *GetLayerDef(char *layer);
-extern void AddBlockDef(BlockDef *block);
-extern BlockDef *GetBlockDef(char *name);
+extern int InitTables(DxfContext *ctx);
+extern void FreeTables(DxfContext *ctx);
+extern char *AddLayerDef(DxfContext *ctx, char *layer);
+extern char *GetLayerDef(DxfContext *ctx, char *layer);
+extern void LayerName(DxfContext *ctx, const char *raw, size_t len,
+		char *name);
+extern int AddLayerFilter(DxfContext *ctx, NameTable *table,
+		const char *raw, size_t len);
+extern int AddLayerList(DxfContext *ctx, NameTable *table, const char *list);
+extern int LayerHidden(DxfContext *ctx, const char *layer);
+extern void AddBlockDef(DxfContext *ctx, BlockDef *block);
+extern BlockDef *GetBlockDef(DxfContext *ctx, char *name);
 extern BlockDef *BlockAlloc(char *name);
-extern InsertDef *InsertAlloc(char *name);
+extern InsertDef *InsertAlloc(DxfContext *ctx, char *name);
 extern int BlockAddInsert(BlockDef *block, InsertDef *insert);
 extern int BlockAddPoly(BlockDef *block, Poly3 *poly);
 extern int BlockAddCyl(BlockDef *block, Cyl3 *cyl);
 extern int BlockAddText(BlockDef *block, SimpleText *text);
+extern void BlockFinish(DxfContext *ctx, BlockDef *block);
+extern void BlockRelease(DxfContext *ctx, BlockDef *block);
 
 
 #ifdef __cplusplus
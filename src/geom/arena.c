@@ -0,0 +1,145 @@
+/*
+This file is part of
+
+* dxf2rad - convert from DXF to Radiance scene files.
+* Radout  - Export geometry from Autocad to Radiance scene files.
+
+
+The MIT License (MIT)
+
+Copyright (c) 1999-2016 Georg Mischler
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*  arena.c
+ *  A bump allocator for geometry.
+ *  Memory is handed out from large chunks, and only given back all
+ *  at once. Chunks start small and double in size up to the limit
+ *  given, so an arena that is used little doesn't cost much.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "geomtypes.h"
+#include "geomdefs.h"
+#include "geomproto.h"
+
+
+#define ARENA_MINCHUNK 1024
+
+typedef union {
+    double d;
+    long l;
+    void *p;
+} ArenaAlign;
+
+#define ARENA_ROUND(n) \
+    (((n) + sizeof(ArenaAlign) - 1) / sizeof(ArenaAlign) * sizeof(ArenaAlign))
+
+struct _GeomChunk {
+    struct _GeomChunk *next;
+    size_t size;        /* usable bytes after the header */
+};
+
+#define CHUNK_HEAD ARENA_ROUND(sizeof(struct _GeomChunk))
+#define CHUNK_DATA(c) ((char *)(c) + CHUNK_HEAD)
+
+
+extern void
+GeomArenaInit(GeomArena *arena, size_t maxchunk)
+{
+    arena->chunks = NULL;
+    arena->next = arena->end = NULL;
+    arena->maxchunk = maxchunk > ARENA_MINCHUNK ? maxchunk : ARENA_MINCHUNK;
+    arena->size = 0;
+}
+
+
+extern void *
+GeomArenaAlloc(GeomArena *arena, size_t size)
+{
+    struct _GeomChunk *chunk;
+    size_t csize;
+    char *p;
+
+    size = size > 0 ? ARENA_ROUND(size) : sizeof(ArenaAlign);
+    if (arena->next == NULL || (size_t)(arena->end - arena->next) < size) {
+        if (arena->chunks == NULL)
+            csize = ARENA_MINCHUNK;
+        else if (arena->chunks->size < arena->maxchunk / 2)
+            csize = arena->chunks->size * 2;
+        else
+            csize = arena->maxchunk;
+        if (csize < size)
+            csize = size;
+        chunk = (struct _GeomChunk *)malloc(CHUNK_HEAD + csize);
+        if (chunk == NULL) {
+            fprintf(stderr, "GeomArenaAlloc: can't alloc chunk\n");
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        chunk->size = csize;
+        arena->chunks = chunk;
+        arena->size += csize;
+        arena->next = CHUNK_DATA(chunk);
+        arena->end = arena->next + csize;
+    }
+    p = arena->next;
+    arena->next += size;
+    return p;
+}
+
+
+/* Forget everything allocated, but keep the newest chunk for reuse. */
+extern void
+GeomArenaReset(GeomArena *arena)
+{
+    struct _GeomChunk *chunk, *next;
+
+    if (arena->chunks == NULL)
+        return;
+    for (chunk = arena->chunks->next; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    chunk = arena->chunks;
+    chunk->next = NULL;
+    arena->size = chunk->size;
+    arena->next = CHUNK_DATA(chunk);
+    arena->end = arena->next + chunk->size;
+}
+
+
+extern void
+GeomArenaFree(GeomArena *arena)
+{
+    struct _GeomChunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    arena->chunks = NULL;
+    arena->next = arena->end = NULL;
+    arena->size = 0;
+}
+
+/*** end arena.c ***/
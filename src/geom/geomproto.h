@@ -100,13 +100,26 @@ extern void M4Scale (Matrix4 m, double sx, double sy, double sz);
 extern void M4Translate (Matrix4 m, double tx, double ty, double tz);
 /* misc.c */
 extern char *StrDup (char *str);
+/* arena.c */
+extern void GeomArenaInit (GeomArena *arena, size_t maxchunk);
+extern void *GeomArenaAlloc (GeomArena *arena, size_t size);
+extern void GeomArenaReset (GeomArena *arena);
+extern void GeomArenaFree (GeomArena *arena);
 /* poly.c */
 extern SimpleText *SimpleTextAlloc (char *s, SimpleText *next);
 extern void SimpleTextFree (SimpleText *text);
+extern Cyl3 *Cyl3ArenaAlloc (GeomArena *arena, Cyl3 *next);
 extern Cyl3 *Cyl3Alloc (Cyl3 *next);
+extern Cyl3 *Cyl3Copy (GeomArena *arena, Cyl3 *cyl, Cyl3 *next);
 extern void Cyl3Free (Cyl3 **cyl);
 extern void Cyl3FreeList (Cyl3 *cyls);
+extern Poly3 *Poly3ArenaAlloc (GeomArena *arena, int nverts, int closed,
+		Poly3 *next);
 extern Poly3 *Poly3Alloc (int nverts, int closed, Poly3 *next);
+extern Poly3 *Poly3Copy (GeomArena *arena, Poly3 *poly, Poly3 *next);
+extern PolyBuffer *PolyBufferAppend (PolyBuffer *buf, Poly3 *polys);
+extern long PolyBufferCount (PolyBuffer *buf, char *material);
+extern void PolyBufferFree (PolyBuffer *buf);
 extern void Poly3Free (Poly3 **poly);
 extern void Poly3FreeList (Poly3 *polys);
 extern Poly3 *Poly3GetLast (Poly3 *polys);
@@ -11,6 +11,7 @@
     extern "C" {
 #endif
 
+#include <stddef.h>
 #include <sys/types.h>
 
 /*********************/
@@ -37,15 +38,45 @@ typedef struct _Box3D {    /* 3d box */
 } Box3;
 
 
+/* Bump allocator for many small, short lived pieces of geometry.
+   Nothing in it is freed alone, only all of it at once. */
+typedef struct _GeomArena {
+    struct _GeomChunk *chunks;  /* newest first */
+    char *next, *end;           /* free space in the newest chunk */
+    size_t maxchunk;            /* largest chunk to allocate */
+    size_t size;                /* bytes in all chunks */
+} GeomArena;
+
+
 typedef struct _Poly3D {
     unsigned short closed, nverts;
-    Point3 *verts;
+    Point3 *verts;      /* inline after the header, if allocated here */
     Vector3 *normals;   /* normal at each vertex */
     Vector3 normal;     /* normal for polygon */
     struct _Poly3D *next;
 	char *material; /* not required for radout, but still useful */
+	GeomArena *arena; /* allocated in, NULL if on the heap */
 } Poly3;
 
+/* where Poly3Alloc() puts the vertices, right after the header */
+#define POLY3_VERTS(p) ((Point3 *)((p) + 1))
+
+
+/* A list of polys packed into arrays, to be transformed and written
+   many times. Poly i has the vertices from offsets[i] up to
+   offsets[i+1], and the material materials[matids[i]].
+   All of it is one allocation. */
+typedef struct _PolyBuffer {
+    long npolys, nverts;
+    double *xs, *ys, *zs;       /* nverts each */
+    long *offsets;              /* npolys + 1 */
+    unsigned char *closed;
+    int *matids;
+    char **materials;           /* point into the layer table */
+    int nmaterials;
+    size_t size;                /* bytes allocated */
+} PolyBuffer;
+
 
 typedef struct _Plane3D {
     Vector3 dir;
@@ -59,6 +90,7 @@ typedef struct _Cyl3D {
     double length, srad, erad;          /* start & end radii */
     struct _Cyl3D *next;
 	char *material; /* not required for radout, but still useful */
+	GeomArena *arena; /* allocated in, NULL if on the heap */
 } Cyl3;
 
 
@@ -48,56 +48,89 @@ SOFTWARE.
 #include "geomproto.h"
 
 
+/* Allocate a poly with room for nverts vertices from arena,
+   or from the heap if arena is NULL. */
 extern Poly3*
-Poly3Alloc(int nverts, int closed, Poly3 *next)
+Poly3ArenaAlloc(GeomArena *arena, int nverts, int closed, Poly3 *next)
 {
     Poly3 *poly;
+    size_t size;
 
     if (nverts < 0) {
         fprintf(stderr,"Poly3Alloc: nverts negative");
         return NULL;
     }
-    if ((poly = (Poly3 *)malloc(sizeof(Poly3))) == NULL) { /* local heap */
+    size = sizeof(Poly3) + nverts * sizeof(Point3);
+    if (arena != NULL)
+        poly = (Poly3 *)GeomArenaAlloc(arena, size);
+    else
+        poly = (Poly3 *)malloc(size); /* local heap */
+    if (poly == NULL) {
         fprintf(stderr, "Poly3Alloc: can't alloc poly");
         return NULL;
     }
     if (nverts > 0) {
-        if (!(poly->verts = (Point3 *)calloc(nverts, sizeof(Point3)))) { /* local heap */
-            fprintf(stderr, "Poly3Alloc: can't alloc poly vertices");
-            free(poly); /* local heap */
-            return NULL;
-        }
+        poly->verts = POLY3_VERTS(poly);
+        memset(poly->verts, 0, nverts * sizeof(Point3));
     } else
         poly->verts = NULL;
+    poly->normals = NULL;
     poly->nverts = (unsigned short)nverts;
     poly->closed = (unsigned short)closed;
     poly->next = next;
 	poly->material = NULL; /* this will point to an external reference, don't free! */
+    poly->arena = arena;
     return poly;
 }
 
 
+extern Poly3*
+Poly3Alloc(int nverts, int closed, Poly3 *next)
+{
+    return Poly3ArenaAlloc(NULL, nverts, closed, next);
+}
+
+
+/* Copy poly into arena, without the vertex normals. */
+extern Poly3*
+Poly3Copy(GeomArena *arena, Poly3 *poly, Poly3 *next)
+{
+    Poly3 *np;
+
+    if ((np = Poly3ArenaAlloc(arena, (int)poly->nverts, (int)poly->closed,
+            next)) == NULL)
+        return NULL;
+    if (poly->nverts > 0)
+        memcpy(np->verts, poly->verts, poly->nverts * sizeof(Point3));
+    np->normal = poly->normal;
+	np->material = poly->material; /* points into table */
+    return np;
+}
+
+
+/* Polys in an arena are only freed with it. */
 extern void
 Poly3Free(Poly3 **poly) 
 {
     if (*poly == NULL)
         return;
-    if ((*poly)->verts)
-        free((*poly)->verts); /* local heap */
-    free(*poly); /* local heap */
+    if ((*poly)->arena == NULL) {
+        if ((*poly)->verts && (*poly)->verts != POLY3_VERTS(*poly))
+            free((*poly)->verts); /* local heap */
+        free(*poly); /* local heap */
+    }
     *poly = NULL;
 }
 
 
 extern void Poly3FreeList(Poly3 *polys) 
 {
-    if (polys == NULL)
-        return;
-    if (polys->verts)
-        free(polys->verts); /* local heap */
-    if (polys->next)
-        Poly3FreeList(polys->next);
-    free(polys); /* local heap */
+    Poly3 *next;
+
+    for ( ; polys != NULL; polys = next) {
+        next = polys->next;
+        Poly3Free(&polys);
+    }
 }
 
 
@@ -140,6 +173,141 @@ extern void Poly3PrintList(FILE *fp, Poly3 *polys)
     }
 }
 
+static int
+FindMaterial(char **materials, int nmaterials, char *material)
+{
+    int i;
+
+    for (i = 0; i < nmaterials; i++)
+        if (materials[i] == material)
+            return i;
+    return -1;
+}
+
+
+/* Pack the contents of buf, if any, followed by the polys into a new
+   buffer, and free buf. The materials of buf keep their ids.
+   Returns NULL and leaves buf alone if out of memory. */
+extern PolyBuffer *
+PolyBufferAppend(PolyBuffer *buf, Poly3 *polys)
+{
+    PolyBuffer *nb;
+    Poly3 *poly;
+    char **materials, **more;
+    long npolys = 0, nverts = 0, i, k;
+    int nmaterials = 0, msize, m, last = -1;
+    size_t head, size;
+
+    msize = (buf != NULL ? buf->nmaterials : 0) + 8;
+    if ((materials = (char **)malloc(msize * sizeof(char *))) == NULL) {
+        fprintf(stderr, "PolyBufferAppend: can't alloc materials\n");
+        return NULL;
+    }
+    if (buf != NULL) {
+        npolys = buf->npolys;
+        nverts = buf->nverts;
+        nmaterials = buf->nmaterials;
+        memcpy(materials, buf->materials, nmaterials * sizeof(char *));
+    }
+    for (poly = polys; poly; poly = poly->next) {
+        npolys++;
+        nverts += poly->nverts;
+        if (FindMaterial(materials, nmaterials, poly->material) >= 0)
+            continue;
+        if (nmaterials == msize) {
+            more = (char **)realloc(materials, 2 * msize * sizeof(char *));
+            if (more == NULL) {
+                fprintf(stderr, "PolyBufferAppend: can't alloc materials\n");
+                free(materials);
+                return NULL;
+            }
+            materials = more;
+            msize *= 2;
+        }
+        materials[nmaterials++] = poly->material;
+    }
+
+    /* the arrays follow the header, most strictly aligned first */
+    head = (sizeof(PolyBuffer) + sizeof(double) - 1)
+            / sizeof(double) * sizeof(double);
+    size = head + 3 * nverts * sizeof(double)
+            + nmaterials * sizeof(char *)
+            + (npolys + 1) * sizeof(long)
+            + npolys * sizeof(int)
+            + npolys;
+    if ((nb = (PolyBuffer *)malloc(size)) == NULL) {
+        fprintf(stderr, "PolyBufferAppend: can't alloc buffer\n");
+        free(materials);
+        return NULL;
+    }
+    nb->npolys = npolys;
+    nb->nverts = nverts;
+    nb->nmaterials = nmaterials;
+    nb->size = size;
+    nb->xs = (double *)((char *)nb + head);
+    nb->ys = nb->xs + nverts;
+    nb->zs = nb->ys + nverts;
+    nb->materials = (char **)(nb->zs + nverts);
+    nb->offsets = (long *)(nb->materials + nmaterials);
+    nb->matids = (int *)(nb->offsets + npolys + 1);
+    nb->closed = (unsigned char *)(nb->matids + npolys);
+    memcpy(nb->materials, materials, nmaterials * sizeof(char *));
+    free(materials);
+
+    i = k = 0;
+    if (buf != NULL) {
+        memcpy(nb->xs, buf->xs, buf->nverts * sizeof(double));
+        memcpy(nb->ys, buf->ys, buf->nverts * sizeof(double));
+        memcpy(nb->zs, buf->zs, buf->nverts * sizeof(double));
+        memcpy(nb->offsets, buf->offsets, buf->npolys * sizeof(long));
+        memcpy(nb->matids, buf->matids, buf->npolys * sizeof(int));
+        memcpy(nb->closed, buf->closed, buf->npolys);
+        i = buf->npolys;
+        k = buf->nverts;
+    }
+    for (poly = polys; poly; poly = poly->next, i++) {
+        nb->offsets[i] = k;
+        nb->closed[i] = (unsigned char)poly->closed;
+        if (last < 0 || nb->materials[last] != poly->material)
+            last = FindMaterial(nb->materials, nmaterials, poly->material);
+        nb->matids[i] = last;
+        for (m = 0; m < (int)poly->nverts; m++, k++) {
+            nb->xs[k] = poly->verts[m].x;
+            nb->ys[k] = poly->verts[m].y;
+            nb->zs[k] = poly->verts[m].z;
+        }
+    }
+    nb->offsets[i] = k;
+    PolyBufferFree(buf);
+    return nb;
+}
+
+
+/* Count the polys in buf on material. */
+extern long
+PolyBufferCount(PolyBuffer *buf, char *material)
+{
+    long i, n = 0;
+    int m;
+
+    if (buf == NULL)
+        return 0;
+    if ((m = FindMaterial(buf->materials, buf->nmaterials, material)) < 0)
+        return 0;
+    for (i = 0; i < buf->npolys; i++)
+        if (buf->matids[i] == m)
+            n++;
+    return n;
+}
+
+
+extern void
+PolyBufferFree(PolyBuffer *buf)
+{
+    free(buf); /* local heap */
+}
+
+
 /* Divide a face along the shortest diagonal. Return two new polygons.
 */
 extern Poly3 *FaceSubDivide(Poly3 *poly)
@@ -154,8 +322,8 @@ extern Poly3 *FaceSubDivide(Poly3 *poly)
     dist2 = V3DistanceBetween2Points(poly->verts+1, poly->verts+3);
     if ((dist1 == 0.0) || (dist2 == 0.0))
         return NULL;
-    if (((np2 = Poly3Alloc(3, 1, NULL)) == NULL) ||
-            ((np1 = Poly3Alloc(3, 1, np2)) == NULL))
+    if (((np2 = Poly3ArenaAlloc(poly->arena, 3, 1, NULL)) == NULL) ||
+            ((np1 = Poly3ArenaAlloc(poly->arena, 3, 1, np2)) == NULL))
         return NULL;
 	np1->material = poly->material; /* points into table */
     np1->verts[0] = poly->verts[0];
@@ -181,7 +349,8 @@ extern Poly3 *CopyPolyUp(Poly3 *poly, double dist)
     unsigned short i;
     Poly3 *np;
 
-    if ((np = Poly3Alloc((int)poly->nverts, (int)poly->closed, NULL)) == NULL) {
+    if ((np = Poly3ArenaAlloc(poly->arena, (int)poly->nverts,
+            (int)poly->closed, NULL)) == NULL) {
         fprintf(stderr, "CopyPolyUp: can't alloc poly");
         return NULL;
     }
@@ -218,7 +387,7 @@ extern Poly3 *WidePlist(Poly3 *poly, double hwdth)
         n = 2 * (poly->nverts + 1);
     else
         n = 2 * poly->nverts;
-    if ((np = Poly3Alloc(n, 1, NULL)) == NULL) {
+    if ((np = Poly3ArenaAlloc(poly->arena, n, 1, NULL)) == NULL) {
         fprintf(stderr, "WidePlist: can't alloc poly");
         return NULL;
     }
@@ -279,7 +448,7 @@ extern Poly3 *CreateSideWalls(Poly3 *poly, double thick)
     ads_printf( "CreateSideWalls(%p, %f)\n", poly, thick);
 #endif
     for (i = 0, j = 1; j < poly->nverts; i++, j++) {
-        if ((np = Poly3Alloc(4, 1, firstp)) == NULL) {
+        if ((np = Poly3ArenaAlloc(poly->arena, 4, 1, firstp)) == NULL) {
             fprintf(stderr, "CreateSideWalls: can't alloc poly");
             return NULL;
         }
@@ -293,7 +462,7 @@ extern Poly3 *CreateSideWalls(Poly3 *poly, double thick)
         firstp = np;
     }
     if (poly->closed) {
-        if ((np = Poly3Alloc(4, 1, firstp)) == NULL) {
+        if ((np = Poly3ArenaAlloc(poly->arena, 4, 1, firstp)) == NULL) {
             fprintf(stderr, "CreateSideWalls: can't alloc poly");
             return NULL;
         }
@@ -311,11 +480,14 @@ extern Poly3 *CreateSideWalls(Poly3 *poly, double thick)
 
 
 extern Cyl3 *
-Cyl3Alloc(Cyl3 *next)
+Cyl3ArenaAlloc(GeomArena *arena, Cyl3 *next)
 {
 	Cyl3 *cyl;
 
-	cyl = (Cyl3*)malloc(sizeof(Cyl3));
+	if (arena != NULL)
+		cyl = (Cyl3*)GeomArenaAlloc(arena, sizeof(Cyl3));
+	else
+		cyl = (Cyl3*)malloc(sizeof(Cyl3));
     if (cyl == NULL) {
         fprintf(stderr, "Cyl3Alloc: can't alloc cylinder\n");
         return NULL;
@@ -324,23 +496,49 @@ Cyl3Alloc(Cyl3 *next)
 	cyl->next = next;
 	cyl->material = NULL;
 	cyl->length = cyl->srad = cyl->erad = 0.0;
+	cyl->arena = arena;
 	return cyl;
 }
 
+extern Cyl3 *
+Cyl3Alloc(Cyl3 *next)
+{
+	return Cyl3ArenaAlloc(NULL, next);
+}
+
+extern Cyl3 *
+Cyl3Copy(GeomArena *arena, Cyl3 *cyl, Cyl3 *next)
+{
+	Cyl3 *newcyl;
+
+	if((newcyl = Cyl3ArenaAlloc(arena, next)) == NULL) return NULL;
+	newcyl->material = cyl->material;
+	newcyl->svert = cyl->svert;
+	newcyl->evert = cyl->evert;
+	newcyl->normal = cyl->normal;
+	newcyl->srad = cyl->srad;
+	newcyl->erad = cyl->erad;
+	newcyl->length = cyl->length;
+	return newcyl;
+}
+
 extern void
 Cyl3Free(Cyl3 **cyl)
 {
 	if(*cyl == NULL) return;
-	free(*cyl);
+	if((*cyl)->arena == NULL) free(*cyl);
 	*cyl = NULL;
 }
 
 extern void
 Cyl3FreeList(Cyl3 *cyls)
 {
-	if(cyls == NULL) return;
-	if(cyls->next) Cyl3FreeList(cyls->next);
-	free(cyls);
+	Cyl3 *next;
+
+	for( ; cyls != NULL; cyls = next) {
+		next = cyls->next;
+		Cyl3Free(&cyls);
+	}
 }
 
 
@@ -64,12 +64,8 @@ int PolyCheckCoincident(Poly3 *poly)
     if (i == (int)poly->nverts)
         return 1;
 
-    /* found some, make an array and copy verts only as needed */
-	verts = (Point3*)malloc(poly->nverts * sizeof(Point3));
-    if (verts == NULL) { /* local heap */
-        fprintf(stderr, "PolyCheckCoincident: can't malloc");
-        return 0;
-    }
+    /* found some, move the verts down in place as needed */
+    verts = poly->verts;
     j = 0;
     verts[j] = poly->verts[0];
     for (i=1; i < (int)poly->nverts; i++) {
@@ -80,16 +76,7 @@ int PolyCheckCoincident(Poly3 *poly)
     if ((verts[0].x == verts[j-1].x) && (verts[0].y == verts[j-1].y) &&
             (verts[0].z == verts[j-1].z))
         j--;
-    free((char*)poly->verts); /* local heap */
     if ((j < 3) && poly->closed) {
-        poly->verts = NULL;
-        poly->nverts = 0;
-        free(verts); /* local heap */
-        return 0;
-    }
-	poly->verts = (Point3*)realloc(verts, j * sizeof(Point3));
-    if (poly->verts == NULL) { /* local heap */
-        fprintf(stderr, "PolyCheckCoincident: can't realloc");
         poly->nverts = 0;
         return 0;
     }
@@ -110,13 +97,8 @@ int PolyCheckColinear(Poly3 *poly)
     if (poly->nverts < 3)        /* must have at least 3 points */
         return 0;
     /* check for coincidence and colinearity */
-    /* found some, make an array and copy verts only as needed */
-	verts = (Point3*)malloc(poly->nverts * sizeof(Point3));
-    if (verts == NULL) {
-        fprintf(stderr, "PolyCheckColinear: can't alloc points: %d\n",
-                poly->nverts);
-        return 0;
-    }
+    /* the verts kept are moved down in place, never past i */
+    verts = poly->verts;
     for (i = 0, j = 1, k = 2; k < (int)poly->nverts; ) {
         /* check coincidence first */
         if ((poly->verts[i].x == poly->verts[j].x) &&
@@ -181,21 +163,12 @@ int PolyCheckColinear(Poly3 *poly)
         poly->closed = 1;
     }
 
-    free((char*)poly->verts); /* local heap */
     if ((nverts < 3) && poly->closed){
-        poly->verts = NULL;
         poly->nverts = 0;
-        free(verts); /* local heap */
 #ifdef DEBUG1
         fprintf(stderr, "PolyCheckColinear: too few points remain: %d", nverts);
 #endif
         return 0;         /* all must be different */
-    }
-	poly->verts = (Point3*)realloc(verts, nverts*sizeof(Point3));
-    if (poly->verts == NULL) {
-        fprintf(stderr, "PolyCheckColinear: can't realloc");
-        poly->nverts = 0;
-        return 0;
     }
     poly->nverts = (unsigned short)nverts;
     return 1;
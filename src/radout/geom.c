@@ -138,8 +138,7 @@ Poly3 *TraceToPoly(ADSResBuf *edata)
     (void)RBGetPoint3(&poly->verts[3], edata, 12);
     (void)RBGetPoint3(&poly->verts[2], edata, 13);
     if (!PolyCheckColinear(poly) || (PolyGetArea(poly) <= 0.0)) {
-        free(poly->verts);
-        free(poly);
+        Poly3Free(&poly);
         return NULL;
     }
     (void)RBGetDouble(&thick, edata, 39);
@@ -406,8 +405,7 @@ Poly3 *PlineToPoly(ADSResBuf *edata, int typ)
     }
     if (len <= 0) {
         ads_relrb(rb);
-        free(poly->verts);
-        free(poly);
+        Poly3Free(&poly);
         return NULL;
     }
     poly->nverts = len;
@@ -532,8 +530,7 @@ Poly3 *LWPolyToPoly(ADSResBuf *edata, int typ)
 		currb = RBGetPoint3(&p1, currb->rbnext, 10);
     }
     if (len <= 0) {
-        free(poly->verts);
-        free(poly);
+        Poly3Free(&poly);
         return NULL;
     }
     poly->nverts = len;
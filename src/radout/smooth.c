@@ -287,7 +287,7 @@ Smooth InitSmooth()
 static void SmoothFreePoly(Poly3 *poly)
 
 {
-    if (poly->verts != NULL)
+    if (poly->verts != NULL && poly->verts != POLY3_VERTS(poly))
         free(poly->verts);
     if (poly->normals != NULL)
         free(poly->normals);
@@ -43,7 +43,7 @@ RSC=rc.exe
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MT /W3 /GX /O2 /D "WIN32" /D "NDEBUG" /D "_WINDOWS" /YX /FD /c
-# ADD CPP /nologo /MT /W3 /GX /O2 /I "..\src\radout" /I "..\src\adslib" /I "..\srd\dll" /I "..\srd\geom" /I "$(ic2004dir)" /D "NDEBUG" /D "_WINDOWS" /D "WIN32" /D "IC2004" /D "SDS_MEMORY" /YX /FD /c
+# ADD CPP /nologo /MT /W3 /GX /O2 /I "..\src\radout" /I "..\src\adslib" /I "..\srd\dll" /I "..\srd\geom" /I "..\src\dxfconv" /I "$(ic2004dir)" /D "NDEBUG" /D "_WINDOWS" /D "WIN32" /D "IC2004" /D "SDS_MEMORY" /YX /FD /c
 # ADD BASE MTL /nologo /D "NDEBUG" /mktyplib203 /o "NUL" /win32
 # ADD MTL /nologo /D "NDEBUG" /mktyplib203 /o "NUL" /win32
 # ADD BASE RSC /l 0x409 /d "NDEBUG"
@@ -69,7 +69,7 @@ LINK32=link.exe
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MTd /W3 /Gm /GX /Zi /Od /D "WIN32" /D "_DEBUG" /D "_WINDOWS" /YX /FD /c
-# ADD CPP /nologo /MDd /W3 /Gm /GX /Zi /Od /I "..\src\radout" /I "..\srd\AdsLib" /I "..\srd\dll" /I "..\srd\geom" /I "$(ic2004dir)" /D "_DEBUG" /D "WIN32" /D "_WINDOWS" /D "IC2004" /FR /YX /FD /c
+# ADD CPP /nologo /MDd /W3 /Gm /GX /Zi /Od /I "..\src\radout" /I "..\srd\AdsLib" /I "..\srd\dll" /I "..\srd\geom" /I "..\src\dxfconv" /I "$(ic2004dir)" /D "_DEBUG" /D "WIN32" /D "_WINDOWS" /D "IC2004" /FR /YX /FD /c
 # ADD BASE MTL /nologo /D "_DEBUG" /mktyplib203 /o "NUL" /win32
 # ADD MTL /nologo /D "_DEBUG" /mktyplib203 /o "NUL" /win32
 # ADD BASE RSC /l 0x409 /d "_DEBUG"
@@ -205,6 +205,10 @@ SOURCE=..\src\dll\dlltypes.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\src\geom\arena.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\geom\bulge.c
 # End Source File
 # Begin Source File
@@ -253,6 +257,10 @@ SOURCE=..\src\dxf2rad\writerad.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\src\dxfconv\dxfnum.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\dxf2rad\writerad.h
 # End Source File
 # End Group
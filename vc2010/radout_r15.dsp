@@ -43,7 +43,7 @@ RSC=rc.exe
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MT /W3 /GX /O2 /D "WIN32" /D "NDEBUG" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "RADOUT15_EXPORTS" /YX /FD /c
-# ADD CPP /nologo /G6 /MD /W3 /Gi /GX /O2 /Ob2 /I "..\src\radout" /I "..\src\adslib" /I "..\src\dll" /I "..\src\acis" /I "..\src\geom" /I "$(arx15dir)\utils\brep\inc" /I "$(arx15dir)\inc" /D "NDEBUG" /D "ACRXAPP" /D "_WINDLL" /D "_WINDOWS" /D "R15" /D "ACIS" /FR /YX /FD /c
+# ADD CPP /nologo /G6 /MD /W3 /Gi /GX /O2 /Ob2 /I "..\src\radout" /I "..\src\adslib" /I "..\src\dll" /I "..\src\acis" /I "..\src\geom" /I "..\src\dxfconv" /I "$(arx15dir)\utils\brep\inc" /I "$(arx15dir)\inc" /D "NDEBUG" /D "ACRXAPP" /D "_WINDLL" /D "_WINDOWS" /D "R15" /D "ACIS" /FR /YX /FD /c
 # ADD BASE MTL /nologo /D "NDEBUG" /mktyplib203 /win32
 # ADD MTL /nologo /D "NDEBUG" /win32
 # SUBTRACT MTL /mktyplib203
@@ -71,7 +71,7 @@ LINK32=link.exe
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MTd /W3 /GX /ZI /Od /D "WIN32" /D "_DEBUG" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "RADOUT15_EXPORTS" /YX /FD /c
-# ADD CPP /nologo /G6 /MD /W3 /Gi /GX /ZI /Od /I "..\src\radout" /I "..\src\adslib" /I "..\src\dll" /I "..\src\acis" /I "..\src\geom" /I "$(arx15dir)\utils\brep\inc" /I "$(arx15dir)\inc" /D "_DEBUG" /D "ACRXAPP" /D "_WINDLL" /D "_WINDOWS" /D "R15" /D "ACIS" /FR /YX /FD /c
+# ADD CPP /nologo /G6 /MD /W3 /Gi /GX /ZI /Od /I "..\src\radout" /I "..\src\adslib" /I "..\src\dll" /I "..\src\acis" /I "..\src\geom" /I "..\src\dxfconv" /I "$(arx15dir)\utils\brep\inc" /I "$(arx15dir)\inc" /D "_DEBUG" /D "ACRXAPP" /D "_WINDLL" /D "_WINDOWS" /D "R15" /D "ACIS" /FR /YX /FD /c
 # SUBTRACT CPP /u
 # ADD BASE MTL /nologo /D "_DEBUG" /mktyplib203 /win32
 # ADD MTL /nologo /D "_DEBUG" /mktyplib203 /win32
@@ -212,6 +212,10 @@ SOURCE=..\src\dll\dlltypes.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\src\geom\arena.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\geom\bulge.c
 # End Source File
 # Begin Source File
@@ -262,6 +266,10 @@ SOURCE=..\src\dxf2rad\writerad.h
 
 SOURCE=..\src\dxf2rad\writerad.c
 # End Source File
+# Begin Source File
+
+SOURCE=..\src\dxfconv\dxfnum.c
+# End Source File
 # End Group
 # End Target
 # End Project